@@ -0,0 +1,538 @@
+// codec benchmark
+//
+// runs every codec (and a selection of levels) over a corpus of synthetic and user-supplied data
+// and reports compression ratio, compression and decompression throughput, and peak memory
+//
+// usage:
+//
+//   bench-babel-compression [options] [files...]
+//
+//   --size <MB>        size of each synthetic sample (default: 16)
+//   --repeat <n>       runs per codec and sample, the fastest run is reported (default: 3)
+//   --codec <prefix>   only runs codecs whose name starts with prefix (e.g. "zstd")
+//   --no-synthetic     only benchmarks the given files
+//   --messages         compresses each sample as independent messages of 1, 4, and 16 KB instead of as a whole
+//                      (e.g. network packets or database rows), where the per-call setup of the codec dominates
+//                      compare the one-shot codecs (e.g. "zstd-1") with their reused contexts (e.g. "zstd-1-reused")
+//   --json             reports JSON instead of CSV
+//
+// NOTE: peak memory is how much the resident set size of the process grew at most during a run (Linux only)
+//       the high-water mark (VmHWM) is reset before each run via /proc/self/clear_refs
+//       (memory that the allocator kept from previous runs and reuses is not counted)
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <random>
+
+
+#include <clean-core/format.hh>
+#include <clean-core/from_string.hh>
+#include <clean-core/string.hh>
+#include <clean-core/string_view.hh>
+#include <clean-core/utility.hh>
+#include <clean-core/vector.hh>
+
+#include <babel-serializer/compression/adaptive.hh>
+#include <babel-serializer/compression/entropy.hh>
+#include <babel-serializer/compression/filter.hh>
+#include <babel-serializer/compression/lz4.hh>
+#include <babel-serializer/compression/snappy.hh>
+#include <babel-serializer/compression/zstd.hh>
+#include <babel-serializer/file.hh>
+
+namespace
+{
+struct sample
+{
+    cc::string name;
+    cc::vector<std::byte> data;
+};
+
+struct codec
+{
+    cc::string name;
+    std::function<cc::vector<std::byte>(cc::span<std::byte const>)> compress;
+    std::function<cc::vector<std::byte>(cc::span<std::byte const>, size_t)> uncompress; // (compressed data, uncompressed size)
+};
+
+struct result
+{
+    cc::string codec;
+    cc::string sample;
+    size_t message_size = 0; // 0 means "whole sample"
+    size_t size = 0;
+    size_t compressed_size = 0;
+    double compress_mbs = 0;
+    double uncompress_mbs = 0;
+    size_t peak_memory_kb = 0;
+    bool is_valid = true;
+};
+
+// =========================================
+// synthetic data
+
+void append(cc::vector<std::byte>& data, cc::string_view s)
+{
+    auto const pos = data.size();
+    data.resize(pos + s.size());
+    std::memcpy(data.data() + pos, s.data(), s.size());
+}
+
+template <class T>
+void append_value(cc::vector<std::byte>& data, T const& v)
+{
+    auto const pos = data.size();
+    data.resize(pos + sizeof(T));
+    std::memcpy(data.data() + pos, &v, sizeof(T));
+}
+
+char const* const words[] = {"the",    "of",   "and",       "to",     "in",         "is",     "that",   "for",   "it",       "as",
+                             "with",   "was",  "on",        "be",     "by",         "this",   "are",    "from",  "or",       "have",
+                             "vertex", "mesh", "serialize", "buffer", "throughput", "stream", "parser", "frame", "compress", "format"};
+
+// skewed word distribution, roughly like natural language
+cc::string_view random_word(std::mt19937& rng)
+{
+    auto const u = std::uniform_real_distribution<double>(0, 1)(rng);
+    return words[int(u * u * u * (sizeof(words) / sizeof(words[0])))];
+}
+
+cc::vector<std::byte> make_text(size_t size, std::mt19937& rng)
+{
+    cc::vector<std::byte> data;
+    data.reserve(size + 64);
+    while (data.size() < size)
+    {
+        auto const sentence_length = std::uniform_int_distribution<int>(4, 20)(rng);
+        for (auto i = 0; i < sentence_length; ++i)
+        {
+            append(data, random_word(rng));
+            append(data, i + 1 < sentence_length ? " " : ".\n");
+        }
+    }
+    return data;
+}
+
+cc::vector<std::byte> make_json(size_t size, std::mt19937& rng)
+{
+    auto pos = std::uniform_real_distribution<float>(-100, 100);
+
+    cc::vector<std::byte> data;
+    data.reserve(size + 256);
+    append(data, "[\n");
+    for (auto id = 0; data.size() < size; ++id)
+    {
+        auto const name0 = random_word(rng);
+        auto const name1 = random_word(rng);
+        char line[256];
+        auto const n = std::snprintf(line, sizeof(line), "  { \"id\": %d, \"name\": \"%.*s %.*s\", \"position\": [%.3f, %.3f, %.3f], \"active\": %s },\n", id,
+                                     int(name0.size()), name0.data(), int(name1.size()), name1.data(), pos(rng), pos(rng), pos(rng), rng() % 2 ? "true" : "false");
+        append(data, cc::string_view(line, size_t(n)));
+    }
+    append(data, "]\n");
+    return data;
+}
+
+// smooth signal with noise (e.g. sensor data)
+cc::vector<std::byte> make_floats(size_t size, std::mt19937& rng)
+{
+    auto noise = std::normal_distribution<float>(0, 0.01f);
+
+    cc::vector<std::byte> data;
+    data.reserve(size + 4);
+    for (auto i = 0; data.size() < size; ++i)
+        append_value(data, std::sin(i * 0.001f) * 10 + std::cos(i * 0.037f) + noise(rng));
+    return data;
+}
+
+// delta-coded quantized attributes (e.g. point positions), i.e. small residuals with a skewed distribution
+cc::vector<std::byte> make_quantized(size_t size, std::mt19937& rng)
+{
+    auto noise = std::normal_distribution<float>(0, 2);
+
+    cc::vector<std::byte> data;
+    data.reserve(size);
+    auto prev = 0;
+    for (auto i = 0; data.size() < size; ++i)
+    {
+        auto const value = int(std::sin(i * 0.01f) * 1000 + noise(rng));
+        data.push_back(std::byte(uint8_t(value - prev)));
+        prev = value;
+    }
+    return data;
+}
+
+// indexed triangle mesh of a displaced grid (positions and normals, followed by indices)
+cc::vector<std::byte> make_mesh(size_t size, std::mt19937& rng)
+{
+    auto noise = std::uniform_real_distribution<float>(-0.01f, 0.01f);
+
+    // 24 bytes per vertex + ~24 bytes of indices per vertex
+    auto const n = int(std::sqrt(double(size) / 48)) + 2;
+
+    cc::vector<std::byte> data;
+    data.reserve(size_t(n) * n * 48);
+    for (auto y = 0; y < n; ++y)
+        for (auto x = 0; x < n; ++x)
+        {
+            float const vertex[] = {float(x), float(y), std::sin(x * 0.1f) * std::cos(y * 0.1f) + noise(rng), 0, 0, 1};
+            append_value(data, vertex);
+        }
+    for (auto y = 0; y + 1 < n; ++y)
+        for (auto x = 0; x + 1 < n; ++x)
+        {
+            auto const i = uint32_t(y * n + x);
+            uint32_t const indices[] = {i, i + 1, i + uint32_t(n), i + 1, i + uint32_t(n) + 1, i + uint32_t(n)};
+            append_value(data, indices);
+        }
+    return data;
+}
+
+// =========================================
+// codecs
+
+cc::vector<codec> make_codecs()
+{
+    using namespace babel;
+
+    cc::vector<codec> codecs;
+
+    for (auto level : {1, 3, 9, 19})
+        codecs.push_back({cc::format("zstd-{}", level), [level](cc::span<std::byte const> d) { return zstd::compress(d, level); },
+                          [](cc::span<std::byte const> d, size_t) { return zstd::uncompress(d); }});
+
+    // reused contexts (compared to one-shot above)
+    for (auto level : {1, 3})
+    {
+        auto c = std::make_shared<zstd::compressor>(level);
+        auto dc = std::make_shared<zstd::decompressor>();
+        codecs.push_back({cc::format("zstd-{}-reused", level), [c](cc::span<std::byte const> d) { return c->compress(d); },
+                          [dc](cc::span<std::byte const> d, size_t) { return dc->uncompress(d); }});
+    }
+
+    {
+        auto cfg = zstd::compress_config();
+        cfg.level = 3;
+        cfg.worker_count = 4;
+        codecs.push_back({"zstd-3-mt4", [cfg](cc::span<std::byte const> d) { return zstd::compress(d, cfg); },
+                          [](cc::span<std::byte const> d, size_t) { return zstd::uncompress(d); }});
+    }
+
+    codecs.push_back({"lz4", [](cc::span<std::byte const> d) { return lz4::compress(d); },
+                      [](cc::span<std::byte const> d, size_t size) { return lz4::uncompress(d, size); }});
+
+    {
+        auto c = std::make_shared<lz4::compressor>();
+        codecs.push_back({"lz4-reused", [c](cc::span<std::byte const> d) { return c->compress(d); },
+                          [](cc::span<std::byte const> d, size_t size) { return lz4::uncompress(d, size); }});
+    }
+
+    for (auto linked : {false, true})
+    {
+        auto cfg = lz4::frame_config();
+        cfg.linked_blocks = linked;
+        codecs.push_back({linked ? "lz4-frame-linked" : "lz4-frame", [cfg](cc::span<std::byte const> d) { return lz4::compress_frame(d, cfg); },
+                          [](cc::span<std::byte const> d, size_t) { return lz4::uncompress_frame(d); }});
+    }
+
+    codecs.push_back({"snappy", [](cc::span<std::byte const> d) { return snappy::compress(d); },
+                      [](cc::span<std::byte const> d, size_t) { return snappy::uncompress(d); }});
+    codecs.push_back({"snappy-framed", [](cc::span<std::byte const> d) { return snappy::compress_framed(d); },
+                      [](cc::span<std::byte const> d, size_t) { return snappy::uncompress_framed(d); }});
+
+    for (auto c : {entropy::coder::huffman, entropy::coder::fse})
+        codecs.push_back({c == entropy::coder::fse ? "entropy-fse" : "entropy-huffman", [c](cc::span<std::byte const> d) { return entropy::compress(d, c); },
+                          [](cc::span<std::byte const> d, size_t) { return entropy::uncompress(d); }});
+
+    // pre-filters for 4-byte numeric data (most samples are float or uint32 arrays)
+    {
+        static filter::filter const shuffle4[] = {{filter::filter_type::shuffle, 4}};
+        static filter::filter const bitshuffle4[] = {{filter::filter_type::bitshuffle, 4}};
+        codecs.push_back({"shuffle4-zstd-3", [](cc::span<std::byte const> d) { return filter::compress(d, shuffle4, compression::codec::zstd); },
+                          [](cc::span<std::byte const> d, size_t) { return filter::uncompress(d); }});
+        codecs.push_back({"shuffle4-lz4", [](cc::span<std::byte const> d) { return filter::compress(d, shuffle4, compression::codec::lz4); },
+                          [](cc::span<std::byte const> d, size_t) { return filter::uncompress(d); }});
+        codecs.push_back({"bitshuffle4-lz4", [](cc::span<std::byte const> d) { return filter::compress(d, bitshuffle4, compression::codec::lz4); },
+                          [](cc::span<std::byte const> d, size_t) { return filter::uncompress(d); }});
+    }
+
+    codecs.push_back({"adaptive", [](cc::span<std::byte const> d) { return compression::compress_adaptive(d); },
+                      [](cc::span<std::byte const> d, size_t) { return compression::uncompress_adaptive(d); }});
+
+    return codecs;
+}
+
+// =========================================
+// measurement
+
+// returns a memory field of /proc/self/status in KB (e.g. "VmRSS:"), or 0 if not available
+size_t read_memory_status_kb(char const* field)
+{
+    size_t kb = 0;
+#ifdef __linux__
+    if (auto f = std::fopen("/proc/self/status", "r"))
+    {
+        char line[256];
+        auto const field_size = std::strlen(field);
+        while (std::fgets(line, sizeof(line), f))
+            if (std::strncmp(line, field, field_size) == 0)
+            {
+                std::sscanf(line + field_size, "%zu", &kb);
+                break;
+            }
+        std::fclose(f);
+    }
+#else
+    (void)field;
+#endif
+    return kb;
+}
+
+// measures the peak memory of a single run (independent of previous runs)
+struct peak_memory_scope
+{
+    peak_memory_scope()
+    {
+#ifdef __linux__
+        // "5" resets the peak resident set size (VmHWM) to the current one
+        if (auto f = std::fopen("/proc/self/clear_refs", "w"))
+        {
+            std::fputs("5", f);
+            std::fclose(f);
+        }
+#endif
+        _rss_before_kb = read_memory_status_kb("VmRSS:");
+    }
+
+    /// peak additional resident memory since construction
+    size_t peak_kb() const
+    {
+        auto const peak = read_memory_status_kb("VmHWM:");
+        return peak > _rss_before_kb ? peak - _rss_before_kb : 0;
+    }
+
+private:
+    size_t _rss_before_kb = 0;
+};
+
+template <class F>
+double best_seconds(int repeat, F&& f)
+{
+    auto best = 1e30;
+    for (auto i = 0; i < repeat; ++i)
+    {
+        auto const start = std::chrono::steady_clock::now();
+        f();
+        auto const end = std::chrono::steady_clock::now();
+        best = cc::min(best, std::chrono::duration<double>(end - start).count());
+    }
+    return best;
+}
+
+result run(codec const& c, sample const& s, int repeat)
+{
+    result r;
+    r.codec = c.name;
+    r.sample = s.name;
+    r.size = s.data.size();
+
+    auto const memory = peak_memory_scope();
+
+    cc::vector<std::byte> compressed;
+    auto const compress_time = best_seconds(repeat, [&] { compressed = c.compress(s.data); });
+    r.compressed_size = compressed.size();
+
+    cc::vector<std::byte> uncompressed;
+    auto const uncompress_time = best_seconds(repeat, [&] { uncompressed = c.uncompress(compressed, s.data.size()); });
+    r.is_valid = uncompressed == s.data;
+
+    auto const mb = double(s.data.size()) / (1024 * 1024);
+    r.compress_mbs = mb / cc::max(compress_time, 1e-9);
+    r.uncompress_mbs = mb / cc::max(uncompress_time, 1e-9);
+    r.peak_memory_kb = memory.peak_kb();
+    return r;
+}
+
+// compresses and decompresses every message_size bytes of the sample independently
+result run_messages(codec const& c, sample const& s, size_t message_size, int repeat)
+{
+    result r;
+    r.codec = c.name;
+    r.sample = s.name;
+    r.message_size = message_size;
+    r.size = s.data.size();
+
+    auto const memory = peak_memory_scope();
+
+    cc::vector<cc::span<std::byte const>> messages;
+    for (size_t pos = 0; pos < s.data.size(); pos += message_size)
+        messages.push_back(cc::span<std::byte const>(s.data).subspan(pos, cc::min(message_size, s.data.size() - pos)));
+
+    cc::vector<cc::vector<std::byte>> compressed;
+    compressed.resize(messages.size());
+    auto const compress_time = best_seconds(repeat,
+                                            [&]
+                                            {
+                                                for (size_t i = 0; i < messages.size(); ++i)
+                                                    compressed[i] = c.compress(messages[i]);
+                                            });
+    for (auto const& m : compressed)
+        r.compressed_size += m.size();
+
+    auto const uncompress_time = best_seconds(repeat,
+                                              [&]
+                                              {
+                                                  r.is_valid = true;
+                                                  for (size_t i = 0; i < messages.size(); ++i)
+                                                  {
+                                                      auto const m = c.uncompress(compressed[i], messages[i].size());
+                                                      r.is_valid = r.is_valid && m.size() == messages[i].size()
+                                                                   && std::memcmp(m.data(), messages[i].data(), m.size()) == 0;
+                                                  }
+                                              });
+
+    auto const mb = double(s.data.size()) / (1024 * 1024);
+    r.compress_mbs = mb / cc::max(compress_time, 1e-9);
+    r.uncompress_mbs = mb / cc::max(uncompress_time, 1e-9);
+    r.peak_memory_kb = memory.peak_kb();
+    return r;
+}
+
+void print_csv_header() { std::printf("codec,sample,message_size,size,compressed_size,ratio,compress_mbs,uncompress_mbs,peak_memory_kb,valid\n"); }
+
+void print_csv(result const& r)
+{
+    std::printf("%s,%s,%zu,%zu,%zu,%.3f,%.1f,%.1f,%zu,%d\n", r.codec.c_str(), r.sample.c_str(), r.message_size, r.size, r.compressed_size,
+                double(r.size) / cc::max(r.compressed_size, size_t(1)), r.compress_mbs, r.uncompress_mbs, r.peak_memory_kb, int(r.is_valid));
+    std::fflush(stdout);
+}
+
+cc::string json_escape(cc::string_view s)
+{
+    cc::string res;
+    for (auto c : s)
+    {
+        if (c == '"' || c == '\\')
+        {
+            res += '\\';
+            res += c;
+        }
+        else if (uint8_t(c) < 0x20)
+        {
+            char buffer[8];
+            std::snprintf(buffer, sizeof(buffer), "\\u%04x", unsigned(c));
+            res += buffer;
+        }
+        else
+            res += c;
+    }
+    return res;
+}
+
+void print_json(result const& r, bool is_first)
+{
+    std::printf("%s\n  {\"codec\": \"%s\", \"sample\": \"%s\", \"message_size\": %zu, \"size\": %zu, \"compressed_size\": %zu, \"ratio\": %.3f, "
+                "\"compress_mbs\": %.1f, \"uncompress_mbs\": %.1f, \"peak_memory_kb\": %zu, \"valid\": %s}",
+                is_first ? "" : ",", json_escape(r.codec).c_str(), json_escape(r.sample).c_str(), r.message_size, r.size, r.compressed_size,
+                double(r.size) / cc::max(r.compressed_size, size_t(1)), r.compress_mbs, r.uncompress_mbs, r.peak_memory_kb, r.is_valid ? "true" : "false");
+    std::fflush(stdout);
+}
+}
+
+int main(int argc, char** argv)
+{
+    size_t sample_size_mb = 16;
+    int repeat = 3;
+    bool use_json = false;
+    bool use_synthetic = true;
+    bool use_messages = false;
+    cc::string codec_prefix;
+    cc::vector<cc::string> files;
+
+    for (auto i = 1; i < argc; ++i)
+    {
+        auto const arg = cc::string_view(argv[i]);
+        auto const has_value = i + 1 < argc;
+        if (arg == "--size" && has_value)
+            cc::from_string(argv[++i], sample_size_mb);
+        else if (arg == "--repeat" && has_value)
+            cc::from_string(argv[++i], repeat);
+        else if (arg == "--codec" && has_value)
+            codec_prefix = argv[++i];
+        else if (arg == "--json")
+            use_json = true;
+        else if (arg == "--no-synthetic")
+            use_synthetic = false;
+        else if (arg == "--messages")
+            use_messages = true;
+        else if (arg.starts_with("--"))
+        {
+            std::fprintf(stderr, "unknown option '%s'\n", argv[i]);
+            return 1;
+        }
+        else
+            files.push_back(cc::string(arg));
+    }
+
+    cc::vector<sample> samples;
+    if (use_synthetic)
+    {
+        auto const size = sample_size_mb * 1024 * 1024;
+        std::mt19937 rng(12345);
+        samples.push_back({"text", make_text(size, rng)});
+        samples.push_back({"json", make_json(size, rng)});
+        samples.push_back({"floats", make_floats(size, rng)});
+        samples.push_back({"mesh", make_mesh(size, rng)});
+        samples.push_back({"quantized", make_quantized(size, rng)});
+    }
+    for (auto const& f : files)
+    {
+        auto const bytes = babel::file::read_all_bytes(f);
+        auto data = cc::vector<std::byte>::uninitialized(bytes.size());
+        std::memcpy(data.data(), bytes.data(), bytes.size());
+        samples.push_back({f, cc::move(data)});
+    }
+
+    auto const codecs = make_codecs();
+
+    auto is_first = true;
+    if (use_json)
+        std::printf("[");
+    else
+        print_csv_header();
+
+    auto all_valid = true;
+    auto report = [&](result const& r)
+    {
+        all_valid = all_valid && r.is_valid;
+        if (use_json)
+            print_json(r, is_first);
+        else
+            print_csv(r);
+        is_first = false;
+    };
+
+    for (auto const& s : samples)
+        for (auto const& c : codecs)
+        {
+            if (!cc::string_view(c.name).starts_with(codec_prefix))
+                continue;
+
+            if (use_messages)
+            {
+                for (size_t message_size : {1024, 4 * 1024, 16 * 1024})
+                    report(run_messages(c, s, message_size, repeat));
+            }
+            else
+                report(run(c, s, repeat));
+        }
+
+    if (use_json)
+        std::printf("\n]\n");
+
+    return all_valid ? 0 : 1;
+}
@@ -0,0 +1,159 @@
+// file reading benchmark
+//
+// compares babel::file::read configurations (buffer size, read-ahead thread) against the previous
+// implementation (std::ifstream with a 4 KB stack buffer) and reports the throughput in MB/s
+// each configuration is run with a trivial consumer and with a consumer that hashes the data (xxh64),
+// which shows how much read-ahead overlaps I/O with processing
+//
+// usage:
+//
+//   bench-babel-file-read [options] [files...]
+//
+//   --size <MB>        size of the generated test file if no files are given (default: 1024)
+//   --repeat <n>       runs per configuration, the fastest run is reported (default: 3)
+//
+// NOTE: unless the page cache is dropped between runs (e.g. "echo 3 > /proc/sys/vm/drop_caches"),
+//       this mostly measures memory bandwidth and per-chunk overhead rather than disk throughput
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+
+#include <clean-core/format.hh>
+#include <clean-core/from_string.hh>
+#include <clean-core/string.hh>
+#include <clean-core/string_view.hh>
+#include <clean-core/temp_cstr.hh>
+#include <clean-core/utility.hh>
+#include <clean-core/vector.hh>
+
+#include <babel-serializer/file.hh>
+#include <babel-serializer/hash.hh>
+
+namespace
+{
+// babel::file::read before it was based on raw file descriptors
+void read_ifstream_4k(cc::stream_ref<std::byte> out, cc::string_view filename)
+{
+    std::ifstream file(cc::temp_cstr(filename), std::ios_base::binary);
+
+    std::byte buffer[1024 * 4];
+    while (file)
+    {
+        file.read(reinterpret_cast<char*>(buffer), sizeof(buffer));
+        auto n = size_t(file.gcount());
+        if (n > 0)
+            out << cc::span(buffer, n);
+    }
+}
+
+template <class F>
+double best_seconds(int repeat, F&& f)
+{
+    auto best = 1e30;
+    for (auto i = 0; i < repeat; ++i)
+    {
+        auto const start = std::chrono::steady_clock::now();
+        f();
+        auto const end = std::chrono::steady_clock::now();
+        best = cc::min(best, std::chrono::duration<double>(end - start).count());
+    }
+    return best;
+}
+
+void generate_file(cc::string_view filename, size_t size)
+{
+    auto file = babel::file::file_output_stream(filename);
+    auto chunk = cc::vector<std::byte>::uninitialized(1 << 20);
+    uint64_t state = 12345;
+    for (size_t pos = 0; pos < size; pos += chunk.size())
+    {
+        for (auto& b : chunk)
+        {
+            state = state * 6364136223846793005ull + 1442695040888963407ull;
+            b = std::byte(state >> 56);
+        }
+        file(cc::span<std::byte const>(chunk).subspan(0, cc::min(chunk.size(), size - pos)));
+    }
+}
+}
+
+int main(int argc, char** argv)
+{
+    size_t size_mb = 1024;
+    int repeat = 3;
+    cc::vector<cc::string> files;
+
+    for (auto i = 1; i < argc; ++i)
+    {
+        auto const arg = cc::string_view(argv[i]);
+        auto const has_value = i + 1 < argc;
+        if (arg == "--size" && has_value)
+            cc::from_string(argv[++i], size_mb);
+        else if (arg == "--repeat" && has_value)
+            cc::from_string(argv[++i], repeat);
+        else if (arg.starts_with("--"))
+        {
+            std::fprintf(stderr, "unknown option '%s'\n", argv[i]);
+            return 1;
+        }
+        else
+            files.push_back(cc::string(arg));
+    }
+
+    auto const generated_file = cc::string("_bench_babel_file_read.bin");
+    if (files.empty())
+    {
+        generate_file(generated_file, size_mb * 1024 * 1024);
+        files.push_back(generated_file);
+    }
+
+    std::printf("reader,consumer,file,size,mbs\n");
+    for (auto const& f : files)
+    {
+        auto const size = babel::file::size_of(f);
+        auto const mb = double(size) / (1024 * 1024);
+
+        for (auto hashing : {false, true})
+        {
+            auto const consumer = hashing ? "xxh64" : "none";
+
+            auto report = [&](cc::string_view reader, auto&& read)
+            {
+                auto hasher = babel::hash::xxh64_stream();
+                size_t total = 0;
+                auto consume = [&](cc::span<std::byte const> d)
+                {
+                    total += d.size();
+                    if (hashing)
+                        hasher(d);
+                };
+                auto const seconds = best_seconds(repeat,
+                                                  [&]
+                                                  {
+                                                      total = 0;
+                                                      read(consume);
+                                                  });
+                if (total != size)
+                    std::fprintf(stderr, "%s read %zu of %zu bytes\n", cc::string(reader).c_str(), total, size);
+                std::printf("%s,%s,%s,%zu,%.1f\n", cc::string(reader).c_str(), consumer, f.c_str(), size, mb / cc::max(seconds, 1e-9));
+                std::fflush(stdout);
+            };
+
+            report("ifstream-4k", [&](cc::stream_ref<std::byte> out) { read_ifstream_4k(out, f); });
+
+            for (size_t buffer_kb : {64, 1024, 8192})
+                for (auto read_ahead : {false, true})
+                {
+                    auto cfg = babel::file::read_config();
+                    cfg.buffer_size = buffer_kb * 1024;
+                    cfg.read_ahead = read_ahead;
+                    report(cc::format("babel-{}k{}", buffer_kb, read_ahead ? "-read-ahead" : ""),
+                           [&](cc::stream_ref<std::byte> out) { babel::file::read(out, f, cfg); });
+                }
+        }
+    }
+
+    if (files.back() == generated_file)
+        std::remove(generated_file.c_str());
+}
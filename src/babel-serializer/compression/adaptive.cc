@@ -0,0 +1,238 @@
+#include "adaptive.hh"
+
+#include <cmath>
+#include <cstring>
+
+#include <clean-core/assert.hh>
+#include <clean-core/utility.hh>
+
+#include <babel-serializer/compression/lz4.hh>
+#include <babel-serializer/compression/zstd.hh>
+
+#define ZSTD_STATIC_LINKING_ONLY // for ZSTD_decompressBound
+#include <zstd/zstd.h>
+
+extern "C"
+{
+#include <zstd/compress/hist.h>
+}
+
+namespace
+{
+constexpr std::byte adaptive_magic[] = {std::byte('B'), std::byte('A'), std::byte('B'), std::byte(0x01)};
+constexpr size_t chunk_header_size = 9;
+constexpr size_t lz4_max_ratio = 255; // a match length byte encodes at most 255 bytes
+
+// estimate_entropy reads at most sample_count * sample_size bytes
+constexpr size_t sample_count = 16;
+constexpr size_t sample_size = 4096;
+
+uint32_t read_le32(std::byte const* p)
+{
+    return uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16 | uint32_t(p[3]) << 24;
+}
+
+void write_le32(std::byte* p, uint32_t v)
+{
+    for (auto i = 0; i < 4; ++i)
+        p[i] = std::byte(v >> (8 * i));
+}
+
+void append_chunk(cc::vector<std::byte>& res, babel::compression::adaptive_method method, size_t uncompressed_size, cc::span<std::byte const> payload)
+{
+    auto const pos = res.size();
+    res.resize(pos + chunk_header_size + payload.size());
+    res[pos] = std::byte(method);
+    write_le32(res.data() + pos + 1, uint32_t(uncompressed_size));
+    write_le32(res.data() + pos + 5, uint32_t(payload.size()));
+    std::memcpy(res.data() + pos + chunk_header_size, payload.data(), payload.size());
+}
+}
+
+double babel::compression::estimate_entropy(cc::span<std::byte const> data)
+{
+    if (data.empty())
+        return 0;
+
+    unsigned histogram[256] = {};
+    size_t total = 0;
+
+    auto add_histogram = [&](cc::span<std::byte const> d)
+    {
+        unsigned counts[256];
+        unsigned max_symbol = 255;
+        HIST_count_simple(counts, &max_symbol, d.data(), d.size());
+        for (unsigned s = 0; s <= max_symbol; ++s)
+            histogram[s] += counts[s];
+        total += d.size();
+    };
+
+    // evenly spaced samples for large inputs
+    if (data.size() <= sample_count * sample_size)
+        add_histogram(data);
+    else
+    {
+        auto const stride = (data.size() - sample_size) / (sample_count - 1);
+        for (size_t i = 0; i < sample_count; ++i)
+            add_histogram(data.subspan(i * stride, sample_size));
+    }
+
+    auto entropy = 0.0;
+    for (auto c : histogram)
+        if (c > 0)
+        {
+            auto const p = double(c) / double(total);
+            entropy -= p * std::log2(p);
+        }
+    return entropy;
+}
+
+babel::compression::adaptive_method babel::compression::choose_method(cc::span<std::byte const> data, adaptive_config const& cfg)
+{
+    auto const entropy = estimate_entropy(data);
+    if (entropy > cfg.store_threshold)
+        return adaptive_method::store;
+    if (entropy > cfg.lz4_threshold)
+        return adaptive_method::lz4;
+    return adaptive_method::zstd;
+}
+
+bool babel::compression::is_adaptive(cc::span<std::byte const> data)
+{
+    return data.size() >= sizeof(adaptive_magic) && std::memcmp(data.data(), adaptive_magic, sizeof(adaptive_magic)) == 0;
+}
+
+cc::vector<std::byte> babel::compression::compress_adaptive(cc::span<std::byte const> data, adaptive_config const& cfg, error_handler on_error)
+{
+    CC_ASSERT(0 < cfg.chunk_size && cfg.chunk_size <= 0x7FFFFFFF && "chunk size must fit into 32 bit");
+
+    cc::vector<std::byte> res;
+    res.reserve(sizeof(adaptive_magic) + data.size() + (data.size() / cfg.chunk_size + 1) * chunk_header_size);
+    res.resize(sizeof(adaptive_magic));
+    std::memcpy(res.data(), adaptive_magic, sizeof(adaptive_magic));
+
+    cc::vector<std::byte> buffer;
+    for (size_t pos = 0; pos < data.size(); pos += cfg.chunk_size)
+    {
+        auto const chunk = data.subspan(pos, cc::min(cfg.chunk_size, data.size() - pos));
+
+        auto method = choose_method(chunk, cfg);
+        size_t size = 0;
+        switch (method)
+        {
+        case adaptive_method::store:
+            break;
+        case adaptive_method::lz4:
+            buffer.resize(lz4::compress_bound(chunk.size()));
+            size = lz4::compress_to(buffer, chunk, on_error);
+            break;
+        case adaptive_method::zstd:
+            buffer.resize(zstd::compress_bound(chunk.size()));
+            size = zstd::compress_to(buffer, chunk, cfg.zstd_level, on_error);
+            break;
+        }
+
+        // not worth decompressing
+        if (size == 0 || size >= chunk.size())
+            method = adaptive_method::store;
+
+        append_chunk(res, method, chunk.size(), method == adaptive_method::store ? chunk : cc::span<std::byte const>(buffer).subspan(0, size));
+    }
+
+    return res;
+}
+
+cc::vector<std::byte> babel::compression::uncompress_adaptive(cc::span<std::byte const> data, error_handler on_error)
+{
+    if (!is_adaptive(data))
+    {
+        on_error(data, {}, "missing magic number (data was not created by compress_adaptive)", severity::error);
+        return {};
+    }
+
+    // first pass: validate headers and compute the total size
+    size_t total_size = 0;
+    for (auto pos = sizeof(adaptive_magic); pos < data.size();)
+    {
+        if (data.size() - pos < chunk_header_size)
+        {
+            on_error(data, data.subspan(pos), "truncated chunk header", severity::error);
+            return {};
+        }
+
+        auto const method = uint8_t(data[pos]);
+        auto const stored_size = size_t(read_le32(data.data() + pos + 5));
+        if (method > uint8_t(adaptive_method::zstd))
+        {
+            on_error(data, data.subspan(pos, 1), "unknown compression method", severity::error);
+            return {};
+        }
+        if (data.size() - pos - chunk_header_size < stored_size)
+        {
+            on_error(data, data.subspan(pos), "truncated chunk", severity::error);
+            return {};
+        }
+
+        // the uncompressed sizes are checked against the payload, so that corrupt sizes cannot exhaust the memory
+        auto const uncompressed_size = size_t(read_le32(data.data() + pos + 1));
+        auto const payload = data.subspan(pos + chunk_header_size, stored_size);
+        auto valid_size = true;
+        switch (adaptive_method(method))
+        {
+        case adaptive_method::store:
+            valid_size = uncompressed_size == stored_size;
+            break;
+        case adaptive_method::lz4:
+            valid_size = uncompressed_size <= stored_size * lz4_max_ratio;
+            break;
+        case adaptive_method::zstd:
+        {
+            auto const bound = ZSTD_decompressBound(payload.data(), payload.size());
+            valid_size = bound != ZSTD_CONTENTSIZE_ERROR && uncompressed_size <= bound;
+            break;
+        }
+        }
+        if (!valid_size)
+        {
+            on_error(data, data.subspan(pos, chunk_header_size), "chunk has an invalid uncompressed size", severity::error);
+            return {};
+        }
+
+        total_size += uncompressed_size;
+        pos += chunk_header_size + stored_size;
+    }
+
+    // second pass: decompress into the final buffer
+    auto res = cc::vector<std::byte>::uninitialized(total_size);
+    size_t out_pos = 0;
+    for (auto pos = sizeof(adaptive_magic); pos < data.size();)
+    {
+        auto const method = adaptive_method(data[pos]);
+        auto const uncompressed_size = size_t(read_le32(data.data() + pos + 1));
+        auto const stored_size = size_t(read_le32(data.data() + pos + 5));
+        auto const payload = data.subspan(pos + chunk_header_size, stored_size);
+        auto const target = cc::span<std::byte>(res).subspan(out_pos, uncompressed_size);
+
+        auto success = true;
+        switch (method)
+        {
+        case adaptive_method::store:
+            std::memcpy(target.data(), payload.data(), stored_size);
+            break;
+        case adaptive_method::lz4:
+            success = lz4::uncompress_to(target, payload, on_error);
+            break;
+        case adaptive_method::zstd:
+            success = zstd::uncompress_to(target, payload, on_error);
+            break;
+        }
+
+        if (!success)
+            return {};
+
+        out_pos += uncompressed_size;
+        pos += chunk_header_size + stored_size;
+    }
+
+    return res;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <clean-core/span.hh>
+#include <clean-core/vector.hh>
+
+#include <babel-serializer/errors.hh>
+
+// adaptive compression for heterogeneous data
+//
+// the input is split into chunks and the entropy of each chunk is estimated from a sampled byte histogram
+// depending on the estimate, each chunk is either stored as-is (e.g. already compressed JPEG/PNG data),
+// compressed with lz4 (fast, moderately compressible data), or compressed with zstd (well compressible data)
+// the choice is recorded in a small per-chunk header, so decompression needs no configuration
+//
+// format:
+//   magic "BAB\x01" (4 bytes)
+//   per chunk: method (1 byte) | uncompressed size (4 bytes LE) | stored size (4 bytes LE) | payload
+//   the payload is a raw lz4 block, a zstd frame, or the uncompressed data
+
+namespace babel::compression
+{
+enum class adaptive_method : uint8_t
+{
+    store = 0,
+    lz4 = 1,
+    zstd = 2,
+};
+
+struct adaptive_config
+{
+    /// uncompressed size of each chunk (the method is chosen per chunk)
+    size_t chunk_size = 1 << 20;
+
+    /// chunks with a higher entropy estimate (in bits per byte) are stored uncompressed
+    double store_threshold = 7.5;
+
+    /// chunks with a higher entropy estimate (but at most store_threshold) are compressed with lz4, all others with zstd
+    double lz4_threshold = 6.0;
+
+    /// zstd compression level (0 means "use default")
+    int zstd_level = 0;
+};
+
+/// estimates the order-0 entropy of data in bits per byte (0 = constant, 8 = random)
+/// NOTE: large inputs are sampled, i.e. the runtime is bounded
+/// NOTE: this ignores repetitions (which lz4/zstd exploit), so it is a lower bound on compressibility
+double estimate_entropy(cc::span<std::byte const> data);
+
+/// returns the method that compress_adaptive would choose for a chunk
+adaptive_method choose_method(cc::span<std::byte const> data, adaptive_config const& cfg = {});
+
+/// compresses data with a per-chunk choice of method (see above)
+/// NOTE: chunks that do not get smaller are stored uncompressed
+cc::vector<std::byte> compress_adaptive(cc::span<std::byte const> data, adaptive_config const& cfg = {}, error_handler on_error = default_error_handler);
+
+/// Tries to uncompress data created by compress_adaptive
+cc::vector<std::byte> uncompress_adaptive(cc::span<std::byte const> data, error_handler on_error = default_error_handler);
+
+/// returns true if data starts with the magic number of compress_adaptive
+bool is_adaptive(cc::span<std::byte const> data);
+}
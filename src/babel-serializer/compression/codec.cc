@@ -0,0 +1,224 @@
+#include "codec.hh"
+
+#include <cstring>
+
+#include <clean-core/assert.hh>
+#include <clean-core/utility.hh>
+
+#include <babel-serializer/file.hh>
+
+namespace
+{
+constexpr std::byte zstd_magic[] = {std::byte(0x28), std::byte(0xB5), std::byte(0x2F), std::byte(0xFD)};
+constexpr std::byte lz4_magic[] = {std::byte(0x04), std::byte(0x22), std::byte(0x4D), std::byte(0x18)};
+constexpr std::byte snappy_magic[] = {std::byte(0xFF), std::byte(0x06), std::byte(0x00), std::byte(0x00), std::byte('s'),
+                                      std::byte('N'),  std::byte('a'),  std::byte('P'),  std::byte('p'),  std::byte('Y')};
+
+constexpr size_t max_magic_size = sizeof(snappy_magic);
+
+cc::vector<std::byte> copy_of(cc::span<std::byte const> data)
+{
+    auto res = cc::vector<std::byte>::uninitialized(data.size());
+    std::memcpy(res.data(), data.data(), data.size());
+    return res;
+}
+
+template <size_t N>
+bool starts_with(cc::span<std::byte const> data, std::byte const (&magic)[N])
+{
+    return data.size() >= N && std::memcmp(data.data(), magic, N) == 0;
+}
+}
+
+babel::compression::codec babel::compression::detect(cc::span<std::byte const> data)
+{
+    if (starts_with(data, zstd_magic))
+        return codec::zstd;
+    if (starts_with(data, lz4_magic))
+        return codec::lz4;
+    if (starts_with(data, snappy_magic))
+        return codec::snappy;
+    return codec::none;
+}
+
+babel::compression::codec babel::compression::from_extension(cc::string_view filename)
+{
+    if (filename.ends_with(".zst") || filename.ends_with(".zstd"))
+        return codec::zstd;
+    if (filename.ends_with(".lz4"))
+        return codec::lz4;
+    if (filename.ends_with(".sz"))
+        return codec::snappy;
+    return codec::none;
+}
+
+cc::string_view babel::compression::extension_of(codec c)
+{
+    switch (c)
+    {
+    case codec::none:
+        return "";
+    case codec::zstd:
+        return ".zst";
+    case codec::lz4:
+        return ".lz4";
+    case codec::snappy:
+        return ".sz";
+    }
+    CC_UNREACHABLE("unknown codec");
+}
+
+cc::vector<std::byte> babel::compression::compress(cc::span<std::byte const> data, codec c, error_handler on_error)
+{
+    switch (c)
+    {
+    case codec::none:
+        return copy_of(data);
+    case codec::zstd:
+        return zstd::compress(data, zstd::compress_config{}, on_error);
+    case codec::lz4:
+        return lz4::compress_frame(data, {}, on_error);
+    case codec::snappy:
+        return snappy::compress_framed(data);
+    }
+    CC_UNREACHABLE("unknown codec");
+}
+
+cc::vector<std::byte> babel::compression::uncompress(cc::span<std::byte const> data, codec c, error_handler on_error)
+{
+    switch (c)
+    {
+    case codec::none:
+        return copy_of(data);
+    case codec::zstd:
+        return zstd::uncompress(data, on_error);
+    case codec::lz4:
+        return lz4::uncompress_frame(data, on_error);
+    case codec::snappy:
+        return snappy::uncompress_framed(data, on_error);
+    }
+    CC_UNREACHABLE("unknown codec");
+}
+
+cc::vector<std::byte> babel::compression::uncompress(cc::span<std::byte const> data, error_handler on_error)
+{
+    return uncompress(data, detect(data), on_error);
+}
+
+cc::vector<std::byte> babel::compression::read_all_bytes(cc::string_view filename, error_handler on_error)
+{
+    cc::vector<std::byte> res;
+    if (file::exists(filename))
+        res.reserve(file::size_of(filename));
+
+    auto append = [&](cc::span<std::byte const> d) { res.push_back_range(d); };
+    auto stream = decompress_stream(append, on_error);
+    file::read(stream, filename, on_error);
+    if (!stream.finish())
+        return {};
+
+    return res;
+}
+
+cc::string babel::compression::read_all_text(cc::string_view filename, error_handler on_error)
+{
+    cc::string res;
+    if (file::exists(filename))
+        res.reserve(file::size_of(filename));
+
+    auto append = [&](cc::span<std::byte const> d) { res += cc::string_view(reinterpret_cast<char const*>(d.data()), d.size()); };
+    auto stream = decompress_stream(append, on_error);
+    file::read(stream, filename, on_error);
+    if (!stream.finish())
+        return "";
+
+    return res;
+}
+
+babel::compression::decompress_stream::decompress_stream(cc::stream_ref<std::byte> output, error_handler on_error)
+  : _output(output), _on_error(on_error)
+{
+}
+
+babel::compression::decompress_stream::~decompress_stream() = default;
+
+void babel::compression::decompress_stream::operator()(cc::span<std::byte const> data)
+{
+    if (_is_started)
+        return forward(data);
+
+    // buffer until the longest magic number can be checked
+    auto const n = cc::min(max_magic_size - _header.size(), data.size());
+    _header.push_back_range(data.subspan(0, n));
+    if (_header.size() < max_magic_size)
+        return;
+
+    start();
+    forward(data.subspan(n));
+}
+
+bool babel::compression::decompress_stream::finish()
+{
+    // data shorter than any magic number
+    if (!_is_started)
+        start();
+
+    switch (_codec)
+    {
+    case codec::none:
+        return true;
+    case codec::zstd:
+        return _zstd->finish();
+    case codec::lz4:
+        return _lz4->finish();
+    case codec::snappy:
+        return _snappy->finish();
+    }
+    CC_UNREACHABLE("unknown codec");
+}
+
+void babel::compression::decompress_stream::start()
+{
+    _codec = detect(_header);
+    _is_started = true;
+
+    switch (_codec)
+    {
+    case codec::none:
+        break;
+    case codec::zstd:
+        _zstd = cc::make_unique<zstd::decompress_stream>(_output, _on_error);
+        break;
+    case codec::lz4:
+        _lz4 = cc::make_unique<lz4::decompress_stream>(_output, _on_error);
+        break;
+    case codec::snappy:
+        _snappy = cc::make_unique<snappy::decompress_stream>(_output, _on_error);
+        break;
+    }
+
+    forward(_header);
+    _header = {};
+}
+
+void babel::compression::decompress_stream::forward(cc::span<std::byte const> data)
+{
+    if (data.empty())
+        return;
+
+    switch (_codec)
+    {
+    case codec::none:
+        _output(data);
+        break;
+    case codec::zstd:
+        (*_zstd)(data);
+        break;
+    case codec::lz4:
+        (*_lz4)(data);
+        break;
+    case codec::snappy:
+        (*_snappy)(data);
+        break;
+    }
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <clean-core/span.hh>
+#include <clean-core/stream_ref.hh>
+#include <clean-core/string.hh>
+#include <clean-core/string_view.hh>
+#include <clean-core/unique_ptr.hh>
+#include <clean-core/vector.hh>
+
+#include <babel-serializer/compression/lz4.hh>
+#include <babel-serializer/compression/snappy.hh>
+#include <babel-serializer/compression/zstd.hh>
+#include <babel-serializer/errors.hh>
+
+// a codec-agnostic compression layer
+//
+// always uses the self-describing (framed) formats of each codec,
+// so compressed data can be identified by its magic number:
+//   - zstd frames
+//   - lz4 frames (see lz4::compress_frame)
+//   - snappy framing format (see snappy::compress_framed)
+//
+// usage:
+//
+//   auto mesh = babel::ply::read(babel::compression::read_all_bytes("mesh.ply.zst"));
+//   auto json = babel::json::read_ref(babel::compression::read_all_text("config.json.lz4"));
+//
+// NOTE: the read functions also accept uncompressed files, so they can be used whenever a file _might_ be compressed
+
+namespace babel::compression
+{
+enum class codec : uint8_t
+{
+    none,
+    zstd,
+    lz4,
+    snappy,
+};
+
+constexpr char const* to_string(codec c)
+{
+    switch (c)
+    {
+    case codec::none:
+        return "none";
+    case codec::zstd:
+        return "zstd";
+    case codec::lz4:
+        return "lz4";
+    case codec::snappy:
+        return "snappy";
+    }
+    return "<unknown codec>";
+}
+
+/// returns the codec of the given data based on its magic number (codec::none if it is not compressed with a known codec)
+/// NOTE: data must contain at least the first 10 bytes of a stream for a reliable detection
+codec detect(cc::span<std::byte const> data);
+
+/// returns the codec of the given filename based on its extension (".zst", ".lz4", ".sz")
+codec from_extension(cc::string_view filename);
+
+/// returns the common file extension of the given codec (including the dot, empty for codec::none)
+cc::string_view extension_of(codec c);
+
+/// compresses data with the given codec (codec::none copies the data)
+cc::vector<std::byte> compress(cc::span<std::byte const> data, codec c, error_handler on_error = default_error_handler);
+
+/// uncompresses data that was compressed with the given codec (codec::none copies the data)
+cc::vector<std::byte> uncompress(cc::span<std::byte const> data, codec c, error_handler on_error = default_error_handler);
+
+/// uncompresses data with the codec detected by detect(data)
+/// NOTE: uncompressed data is returned as a copy
+cc::vector<std::byte> uncompress(cc::span<std::byte const> data, error_handler on_error = default_error_handler);
+
+/// same as file::read_all_bytes but transparently decompresses the file (if compressed with a known codec)
+/// NOTE: the file is decompressed while reading, i.e. the compressed file is never fully held in memory
+cc::vector<std::byte> read_all_bytes(cc::string_view filename, error_handler on_error = default_error_handler);
+
+/// same as file::read_all_text but transparently decompresses the file (if compressed with a known codec)
+cc::string read_all_text(cc::string_view filename, error_handler on_error = default_error_handler);
+
+/// a streaming decompressor that detects the codec from the first bytes of the data
+/// uncompressed data is passed through unchanged
+///
+/// usage:
+///
+///   auto decompressor = babel::compression::decompress_stream(output);
+///   babel::file::read(decompressor, "data.bin.zst");
+///   if (!decompressor.finish())
+///       ... // error or truncated data
+///
+/// NOTE: the output stream and on_error must outlive this object
+/// NOTE: the codec is detected once, i.e. concatenated data must use the same codec
+struct decompress_stream
+{
+    explicit decompress_stream(cc::stream_ref<std::byte> output, error_handler on_error = default_error_handler);
+    ~decompress_stream();
+
+    // no copy or move (stream_refs point to this object)
+    decompress_stream(decompress_stream const&) = delete;
+    decompress_stream& operator=(decompress_stream const&) = delete;
+
+    /// decompresses the given data (the first few bytes are buffered until the codec is known)
+    void operator()(cc::span<std::byte const> data);
+
+    /// must be called after all data was pushed
+    /// returns true if all data was decompressed successfully
+    bool finish();
+
+    /// the detected codec (only valid after enough data was pushed or after finish())
+    codec detected_codec() const { return _codec; }
+
+private:
+    void start();
+    void forward(cc::span<std::byte const> data);
+
+    cc::stream_ref<std::byte> _output;
+    error_handler _on_error;
+    cc::vector<std::byte> _header; // first bytes until the codec is known
+    codec _codec = codec::none;
+    bool _is_started = false;
+    cc::unique_ptr<zstd::decompress_stream> _zstd;
+    cc::unique_ptr<lz4::decompress_stream> _lz4;
+    cc::unique_ptr<snappy::decompress_stream> _snappy;
+};
+}
@@ -0,0 +1,229 @@
+#include "entropy.hh"
+
+#include <cstring>
+
+#include <clean-core/utility.hh>
+
+#include <zstd/common/fse.h>
+#include <zstd/common/huf.h>
+
+namespace
+{
+constexpr size_t header_size = 9;
+constexpr size_t block_header_size = 4;
+
+static_assert(babel::entropy::block_size <= HUF_BLOCKSIZE_MAX, "huffman blocks are limited to 128 KB");
+
+enum class block_type : uint32_t
+{
+    raw = 0,
+    rle = 1,
+    compressed = 2,
+};
+
+uint32_t read_le32(std::byte const* p)
+{
+    return uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16 | uint32_t(p[3]) << 24;
+}
+
+void write_le32(std::byte* p, uint32_t v)
+{
+    for (auto i = 0; i < 4; ++i)
+        p[i] = std::byte(v >> (8 * i));
+}
+
+uint64_t read_le64(std::byte const* p) { return uint64_t(read_le32(p)) | uint64_t(read_le32(p + 4)) << 32; }
+
+void write_le64(std::byte* p, uint64_t v)
+{
+    write_le32(p, uint32_t(v));
+    write_le32(p + 4, uint32_t(v >> 32));
+}
+
+/// returns the size of the entropy coded block
+/// 0 means "not compressible", 1 means "single symbol", see FSE_compress and HUF_compress
+size_t compress_block(std::byte* dst, size_t dst_capacity, cc::span<std::byte const> block, babel::entropy::coder c)
+{
+    auto const res = c == babel::entropy::coder::fse ? FSE_compress(dst, dst_capacity, block.data(), block.size())
+                                                     : HUF_compress(dst, dst_capacity, block.data(), block.size());
+
+    // errors (e.g. dst too small) only mean that the block is not worth compressing
+    auto const is_error = c == babel::entropy::coder::fse ? FSE_isError(res) : HUF_isError(res);
+    return is_error ? 0 : res;
+}
+
+size_t decompress_block(cc::span<std::byte> dst, cc::span<std::byte const> block, babel::entropy::coder c)
+{
+    auto const res = c == babel::entropy::coder::fse ? FSE_decompress(dst.data(), dst.size(), block.data(), block.size())
+                                                     : HUF_decompress(dst.data(), dst.size(), block.data(), block.size());
+
+    auto const is_error = c == babel::entropy::coder::fse ? FSE_isError(res) : HUF_isError(res);
+    return is_error ? 0 : res;
+}
+
+bool has_valid_header(cc::span<std::byte const> data, babel::error_handler on_error)
+{
+    if (data.size() < header_size || uint8_t(data[0]) > uint8_t(babel::entropy::coder::fse))
+    {
+        on_error(data, {}, "data was not created by entropy::compress", babel::severity::error);
+        return false;
+    }
+
+    // each block holds at most block_size bytes and needs at least its header and one byte of payload
+    // (checked before anything is allocated, so that a corrupt size cannot exhaust the memory)
+    auto const max_block_count = (data.size() - header_size) / (block_header_size + 1);
+    if (read_le64(data.data() + 1) > uint64_t(max_block_count) * babel::entropy::block_size)
+    {
+        on_error(data, data.subspan(1, 8), "uncompressed size is too large for the compressed data", babel::severity::error);
+        return false;
+    }
+    return true;
+}
+}
+
+size_t babel::entropy::compress_bound(size_t size)
+{
+    auto const block_count = (size + block_size - 1) / block_size;
+    return header_size + block_count * block_header_size + size;
+}
+
+cc::vector<std::byte> babel::entropy::compress(cc::span<std::byte const> data, coder c, error_handler on_error)
+{
+    auto res = cc::vector<std::byte>::uninitialized(compress_bound(data.size()));
+    auto const size = compress_to(res, data, c, on_error);
+    res.resize(size);
+    return res;
+}
+
+size_t babel::entropy::compress_to(cc::span<std::byte> out_data, cc::span<std::byte const> data, coder c, error_handler on_error)
+{
+    if (out_data.size() < compress_bound(data.size()))
+    {
+        on_error(data, {}, "entropy compress_to requires an output buffer of at least compress_bound(data.size()) bytes", severity::error);
+        return 0;
+    }
+
+    auto out = out_data.data();
+    out[0] = std::byte(c);
+    write_le64(out + 1, data.size());
+    out += header_size;
+
+    for (size_t pos = 0; pos < data.size(); pos += block_size)
+    {
+        auto const block = data.subspan(pos, cc::min(block_size, data.size() - pos));
+        auto const payload = out + block_header_size;
+
+        // only keep the entropy coded block if it is actually smaller
+        auto size = compress_block(payload, block.size() - 1, block, c);
+        auto type = block_type::compressed;
+        if (size == 1)
+            type = block_type::rle;
+        if (size == 0 || block.size() == 1)
+        {
+            type = block_type::raw;
+            size = block.size();
+            std::memcpy(payload, block.data(), block.size());
+        }
+        if (type == block_type::rle)
+            payload[0] = block[0];
+
+        write_le32(out, uint32_t(size) << 2 | uint32_t(type));
+        out += block_header_size + size;
+    }
+
+    return out - out_data.data();
+}
+
+size_t babel::entropy::uncompressed_size(cc::span<std::byte const> data, error_handler on_error)
+{
+    if (!has_valid_header(data, on_error))
+        return 0;
+    return size_t(read_le64(data.data() + 1));
+}
+
+cc::vector<std::byte> babel::entropy::uncompress(cc::span<std::byte const> data, error_handler on_error)
+{
+    if (!has_valid_header(data, on_error))
+        return {};
+
+    auto res = cc::vector<std::byte>::uninitialized(size_t(read_le64(data.data() + 1)));
+    if (!uncompress_to(res, data, on_error))
+        return {};
+    return res;
+}
+
+bool babel::entropy::uncompress_to(cc::span<std::byte> out_data, cc::span<std::byte const> data, error_handler on_error)
+{
+    if (!has_valid_header(data, on_error))
+        return false;
+    if (read_le64(data.data() + 1) != out_data.size())
+    {
+        on_error(data, {}, "entropy uncompress_to requires the exact decompressed size", severity::error);
+        return false;
+    }
+
+    auto const c = coder(data[0]);
+    auto pos = header_size;
+    for (size_t out_pos = 0; out_pos < out_data.size(); out_pos += block_size)
+    {
+        auto const target = out_data.subspan(out_pos, cc::min(block_size, out_data.size() - out_pos));
+
+        if (data.size() - pos < block_header_size)
+        {
+            on_error(data, data.subspan(pos), "truncated block header", severity::error);
+            return false;
+        }
+        auto const header = read_le32(data.data() + pos);
+        auto const type = block_type(header & 3);
+        auto const size = size_t(header >> 2);
+        pos += block_header_size;
+        if (data.size() - pos < size)
+        {
+            on_error(data, data.subspan(pos - block_header_size), "truncated block", severity::error);
+            return false;
+        }
+        auto const payload = data.subspan(pos, size);
+        pos += size;
+
+        switch (type)
+        {
+        case block_type::raw:
+            if (size != target.size())
+            {
+                on_error(data, payload, "raw block has an invalid size", severity::error);
+                return false;
+            }
+            std::memcpy(target.data(), payload.data(), size);
+            break;
+
+        case block_type::rle:
+            if (size != 1)
+            {
+                on_error(data, payload, "rle block has an invalid size", severity::error);
+                return false;
+            }
+            std::memset(target.data(), int(payload[0]), target.size());
+            break;
+
+        case block_type::compressed:
+            if (decompress_block(target, payload, c) != target.size())
+            {
+                on_error(data, payload, "could not decode entropy coded block (corrupted data?)", severity::error);
+                return false;
+            }
+            break;
+
+        default:
+            on_error(data, payload, "unknown block type", severity::error);
+            return false;
+        }
+    }
+
+    if (pos != data.size())
+    {
+        on_error(data, data.subspan(pos), "trailing data after the last block", severity::error);
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <clean-core/span.hh>
+#include <clean-core/vector.hh>
+
+#include <babel-serializer/errors.hh>
+
+// raw entropy coding (order-0) using the Huffman and FSE (tANS) coders of zstd
+//
+// in contrast to zstd/lz4/snappy, there is no match finding, only symbol statistics are exploited
+// this is much faster than LZ compression and works well for data that was already transformed
+// into a skewed byte distribution (e.g. quantized attributes, delta-coded indices, see babel::filter)
+//
+// usage:
+//
+//   auto packed = babel::entropy::compress(data); // or compress(data, babel::entropy::coder::fse)
+//   ...
+//   auto data = babel::entropy::uncompress(packed);
+//
+// format:
+//   coder (1 byte) | uncompressed size (8 bytes LE)
+//   per block of at most block_size bytes: header (4 bytes LE, stored size << 2 | block type) | payload
+//   blocks that are not compressible are stored raw, blocks with a single symbol as RLE (1 byte payload)
+
+namespace babel::entropy
+{
+enum class coder : uint8_t
+{
+    /// fast, near-optimal for skewed distributions
+    huffman = 0,
+
+    /// finite state entropy (tANS), fractional bits per symbol, better for very skewed distributions
+    fse = 1,
+};
+
+/// the maximum uncompressed size of each block (each block has its own statistics)
+constexpr size_t block_size = 128 * 1024;
+
+/// returns the maximum compressed size of data with the given size (in bytes)
+size_t compress_bound(size_t size);
+
+/// compresses a range of bytes with the given entropy coder
+cc::vector<std::byte> compress(cc::span<std::byte const> data, coder c = coder::huffman, error_handler on_error = default_error_handler);
+
+/// compresses into a caller-provided buffer without allocating the result
+/// returns the compressed size or 0 on error
+/// NOTE: requires out_data.size() >= compress_bound(data.size())
+size_t compress_to(cc::span<std::byte> out_data, cc::span<std::byte const> data, coder c = coder::huffman, error_handler on_error = default_error_handler);
+
+/// Tries to uncompress the given data
+cc::vector<std::byte> uncompress(cc::span<std::byte const> data, error_handler on_error = default_error_handler);
+
+/// returns the uncompressed size stored in the compressed data
+size_t uncompressed_size(cc::span<std::byte const> data, error_handler on_error = default_error_handler);
+
+/// Tries to uncompress the given data into a caller-provided buffer
+/// NOTE: out_data must have exactly the uncompressed size (see uncompressed_size)
+bool uncompress_to(cc::span<std::byte> out_data, cc::span<std::byte const> data, error_handler on_error = default_error_handler);
+}
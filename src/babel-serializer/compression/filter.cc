@@ -0,0 +1,431 @@
+#include "filter.hh"
+
+#include <cstring>
+
+#include <clean-core/assert.hh>
+#include <clean-core/utility.hh>
+
+namespace
+{
+constexpr std::byte filter_magic[] = {std::byte('B'), std::byte('F'), std::byte('L'), std::byte(0x01)};
+constexpr size_t filter_header_size = 6;
+constexpr size_t header_prefix_size = sizeof(filter_magic) + 2; // magic | codec | filter count
+
+uint32_t read_le32(std::byte const* p)
+{
+    return uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16 | uint32_t(p[3]) << 24;
+}
+
+void write_le32(std::byte* p, uint32_t v)
+{
+    for (auto i = 0; i < 4; ++i)
+        p[i] = std::byte(v >> (8 * i));
+}
+
+void copy_tail(cc::span<std::byte> out_data, cc::span<std::byte const> data, size_t offset)
+{
+    if (out_data.data() != data.data())
+        std::memcpy(out_data.data() + offset, data.data() + offset, data.size() - offset);
+}
+
+// =========================================
+// transposition
+
+/// converts a records x columns matrix of ES-byte elements into a columns x records matrix (or back if Inverse)
+/// ES == 0 means "element_size is only known at runtime"
+template <size_t ES, bool Inverse>
+void transpose_impl(std::byte* out, std::byte const* in, size_t records, size_t columns, size_t element_size)
+{
+    auto const es = ES == 0 ? element_size : ES;
+
+    // blocking over records keeps the column-wise accesses in cache
+    constexpr size_t block_size = 256;
+    for (size_t r0 = 0; r0 < records; r0 += block_size)
+    {
+        auto const r1 = cc::min(r0 + block_size, records);
+        for (size_t c = 0; c < columns; ++c)
+        {
+            auto soa = (c * records + r0) * es;
+            auto aos = (r0 * columns + c) * es;
+            for (auto r = r0; r < r1; ++r)
+            {
+                if constexpr (Inverse)
+                    std::memcpy(out + aos, in + soa, ES == 0 ? es : ES);
+                else
+                    std::memcpy(out + soa, in + aos, ES == 0 ? es : ES);
+                soa += es;
+                aos += columns * es;
+            }
+        }
+    }
+}
+
+template <bool Inverse>
+void transpose_dispatch(cc::span<std::byte> out_data, cc::span<std::byte const> data, size_t stride, size_t element_size)
+{
+    CC_ASSERT(out_data.size() == data.size() && "filters require equally sized buffers");
+    CC_ASSERT(stride > 0 && element_size > 0 && stride % element_size == 0 && "stride must be a multiple of the element size");
+
+    auto const records = data.size() / stride;
+    auto const columns = stride / element_size;
+    auto const out = out_data.data();
+    auto const in = data.data();
+
+    switch (element_size)
+    {
+    case 1:
+        transpose_impl<1, Inverse>(out, in, records, columns, 1);
+        break;
+    case 2:
+        transpose_impl<2, Inverse>(out, in, records, columns, 2);
+        break;
+    case 4:
+        transpose_impl<4, Inverse>(out, in, records, columns, 4);
+        break;
+    case 8:
+        transpose_impl<8, Inverse>(out, in, records, columns, 8);
+        break;
+    default:
+        transpose_impl<0, Inverse>(out, in, records, columns, element_size);
+        break;
+    }
+
+    copy_tail(out_data, data, records * stride);
+}
+
+// =========================================
+// bit transposition
+
+/// transposes an 8x8 bit matrix (byte i is row i, bit j is column j)
+/// see Hacker's Delight, 7-3
+uint64_t transpose_bits(uint64_t x)
+{
+    uint64_t t;
+    t = (x ^ (x >> 7)) & 0x00AA00AA00AA00AAull;
+    x = x ^ t ^ (t << 7);
+    t = (x ^ (x >> 14)) & 0x0000CCCC0000CCCCull;
+    x = x ^ t ^ (t << 14);
+    t = (x ^ (x >> 28)) & 0x00000000F0F0F0F0ull;
+    x = x ^ t ^ (t << 28);
+    return x;
+}
+
+// =========================================
+// delta coding
+
+template <class T, bool Xor>
+void delta_encode_impl(std::byte* out, std::byte const* in, size_t count)
+{
+    T prev = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        T v;
+        std::memcpy(&v, in + i * sizeof(T), sizeof(T));
+        T const d = Xor ? T(v ^ prev) : T(v - prev);
+        prev = v;
+        std::memcpy(out + i * sizeof(T), &d, sizeof(T));
+    }
+}
+
+template <class T, bool Xor>
+void delta_decode_impl(std::byte* out, std::byte const* in, size_t count)
+{
+    T prev = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        T d;
+        std::memcpy(&d, in + i * sizeof(T), sizeof(T));
+        prev = Xor ? T(d ^ prev) : T(d + prev);
+        std::memcpy(out + i * sizeof(T), &prev, sizeof(T));
+    }
+}
+
+template <bool Decode, bool Xor>
+void delta_dispatch(cc::span<std::byte> out_data, cc::span<std::byte const> data, size_t element_size)
+{
+    CC_ASSERT(out_data.size() == data.size() && "filters require equally sized buffers");
+
+    auto const count = data.size() / element_size;
+    auto const out = out_data.data();
+    auto const in = data.data();
+
+    auto run = [&](auto zero)
+    {
+        using T = decltype(zero);
+        if constexpr (Decode)
+            delta_decode_impl<T, Xor>(out, in, count);
+        else
+            delta_encode_impl<T, Xor>(out, in, count);
+    };
+
+    switch (element_size)
+    {
+    case 1:
+        run(uint8_t(0));
+        break;
+    case 2:
+        run(uint16_t(0));
+        break;
+    case 4:
+        run(uint32_t(0));
+        break;
+    case 8:
+        run(uint64_t(0));
+        break;
+    default:
+        CC_UNREACHABLE("delta filters support element sizes of 1, 2, 4, and 8 bytes");
+    }
+
+    copy_tail(out_data, data, count * element_size);
+}
+
+bool is_valid(babel::filter::filter const& f)
+{
+    using babel::filter::filter_type;
+
+    switch (f.type)
+    {
+    case filter_type::shuffle:
+    case filter_type::bitshuffle:
+        return f.element_size > 0;
+    case filter_type::delta:
+    case filter_type::xor_delta:
+        return f.element_size == 1 || f.element_size == 2 || f.element_size == 4 || f.element_size == 8;
+    case filter_type::transpose:
+        return f.element_size > 0 && f.stride > 0 && f.stride % f.element_size == 0;
+    }
+    return false;
+}
+}
+
+void babel::filter::shuffle(cc::span<std::byte> out_data, cc::span<std::byte const> data, size_t element_size)
+{
+    transpose_dispatch<false>(out_data, data, element_size, 1);
+}
+
+void babel::filter::unshuffle(cc::span<std::byte> out_data, cc::span<std::byte const> data, size_t element_size)
+{
+    transpose_dispatch<true>(out_data, data, element_size, 1);
+}
+
+void babel::filter::transpose(cc::span<std::byte> out_data, cc::span<std::byte const> data, size_t stride, size_t element_size)
+{
+    transpose_dispatch<false>(out_data, data, stride, element_size);
+}
+
+void babel::filter::untranspose(cc::span<std::byte> out_data, cc::span<std::byte const> data, size_t stride, size_t element_size)
+{
+    transpose_dispatch<true>(out_data, data, stride, element_size);
+}
+
+void babel::filter::bitshuffle(cc::span<std::byte> out_data, cc::span<std::byte const> data, size_t element_size)
+{
+    CC_ASSERT(out_data.size() == data.size() && "filters require equally sized buffers");
+    CC_ASSERT(element_size > 0 && "invalid element size");
+
+    // bit planes are formed from groups of 8 elements
+    auto const group_count = data.size() / element_size / 8;
+    auto const count = group_count * 8;
+
+    // byte b of all elements is written to 8 consecutive bit planes
+    for (size_t b = 0; b < element_size; ++b)
+    {
+        auto const plane = out_data.data() + b * count;
+        for (size_t g = 0; g < group_count; ++g)
+        {
+            uint64_t x = 0;
+            for (size_t j = 0; j < 8; ++j)
+                x |= uint64_t(data[(g * 8 + j) * element_size + b]) << (8 * j);
+
+            x = transpose_bits(x);
+
+            for (size_t k = 0; k < 8; ++k)
+                plane[k * group_count + g] = std::byte(x >> (8 * k));
+        }
+    }
+
+    copy_tail(out_data, data, count * element_size);
+}
+
+void babel::filter::bitunshuffle(cc::span<std::byte> out_data, cc::span<std::byte const> data, size_t element_size)
+{
+    CC_ASSERT(out_data.size() == data.size() && "filters require equally sized buffers");
+    CC_ASSERT(element_size > 0 && "invalid element size");
+
+    auto const group_count = data.size() / element_size / 8;
+    auto const count = group_count * 8;
+
+    for (size_t b = 0; b < element_size; ++b)
+    {
+        auto const plane = data.data() + b * count;
+        for (size_t g = 0; g < group_count; ++g)
+        {
+            uint64_t x = 0;
+            for (size_t k = 0; k < 8; ++k)
+                x |= uint64_t(plane[k * group_count + g]) << (8 * k);
+
+            // the bit transposition is its own inverse
+            x = transpose_bits(x);
+
+            for (size_t j = 0; j < 8; ++j)
+                out_data[(g * 8 + j) * element_size + b] = std::byte(x >> (8 * j));
+        }
+    }
+
+    copy_tail(out_data, data, count * element_size);
+}
+
+void babel::filter::delta_encode(cc::span<std::byte> out_data, cc::span<std::byte const> data, size_t element_size)
+{
+    delta_dispatch<false, false>(out_data, data, element_size);
+}
+
+void babel::filter::delta_decode(cc::span<std::byte> out_data, cc::span<std::byte const> data, size_t element_size)
+{
+    delta_dispatch<true, false>(out_data, data, element_size);
+}
+
+void babel::filter::xor_delta_encode(cc::span<std::byte> out_data, cc::span<std::byte const> data, size_t element_size)
+{
+    delta_dispatch<false, true>(out_data, data, element_size);
+}
+
+void babel::filter::xor_delta_decode(cc::span<std::byte> out_data, cc::span<std::byte const> data, size_t element_size)
+{
+    delta_dispatch<true, true>(out_data, data, element_size);
+}
+
+void babel::filter::apply(cc::span<std::byte> out_data, cc::span<std::byte const> data, filter const& f)
+{
+    CC_ASSERT(is_valid(f) && "invalid filter description");
+
+    switch (f.type)
+    {
+    case filter_type::shuffle:
+        return shuffle(out_data, data, f.element_size);
+    case filter_type::bitshuffle:
+        return bitshuffle(out_data, data, f.element_size);
+    case filter_type::delta:
+        return delta_encode(out_data, data, f.element_size);
+    case filter_type::xor_delta:
+        return xor_delta_encode(out_data, data, f.element_size);
+    case filter_type::transpose:
+        return transpose(out_data, data, f.stride, f.element_size);
+    }
+}
+
+void babel::filter::revert(cc::span<std::byte> out_data, cc::span<std::byte const> data, filter const& f)
+{
+    CC_ASSERT(is_valid(f) && "invalid filter description");
+
+    switch (f.type)
+    {
+    case filter_type::shuffle:
+        return unshuffle(out_data, data, f.element_size);
+    case filter_type::bitshuffle:
+        return bitunshuffle(out_data, data, f.element_size);
+    case filter_type::delta:
+        return delta_decode(out_data, data, f.element_size);
+    case filter_type::xor_delta:
+        return xor_delta_decode(out_data, data, f.element_size);
+    case filter_type::transpose:
+        return untranspose(out_data, data, f.stride, f.element_size);
+    }
+}
+
+bool babel::filter::is_filtered(cc::span<std::byte const> data)
+{
+    return data.size() >= header_prefix_size && std::memcmp(data.data(), filter_magic, sizeof(filter_magic)) == 0;
+}
+
+cc::vector<std::byte> babel::filter::compress(cc::span<std::byte const> data, cc::span<filter const> filters, compression::codec c, error_handler on_error)
+{
+    CC_ASSERT(filters.size() <= 255 && "too many filters");
+
+    // ping-pong between two buffers
+    cc::vector<std::byte> filtered;
+    cc::vector<std::byte> buffer;
+    auto current = data;
+    for (auto const& f : filters)
+    {
+        buffer.resize(data.size());
+        apply(buffer, current, f);
+        cc::swap(filtered, buffer);
+        current = filtered;
+    }
+
+    auto const payload = compression::compress(current, c, on_error);
+
+    auto const header_size = header_prefix_size + filters.size() * filter_header_size;
+    auto res = cc::vector<std::byte>::uninitialized(header_size + payload.size());
+    std::memcpy(res.data(), filter_magic, sizeof(filter_magic));
+    res[sizeof(filter_magic)] = std::byte(c);
+    res[sizeof(filter_magic) + 1] = std::byte(filters.size());
+    for (size_t i = 0; i < filters.size(); ++i)
+    {
+        auto const p = res.data() + header_prefix_size + i * filter_header_size;
+        p[0] = std::byte(filters[i].type);
+        p[1] = std::byte(filters[i].element_size);
+        write_le32(p + 2, filters[i].stride);
+    }
+    if (!payload.empty())
+        std::memcpy(res.data() + header_size, payload.data(), payload.size());
+    return res;
+}
+
+cc::vector<std::byte> babel::filter::uncompress(cc::span<std::byte const> data, error_handler on_error)
+{
+    if (!is_filtered(data))
+    {
+        on_error(data, {}, "missing magic number (data was not created by filter::compress)", severity::error);
+        return {};
+    }
+
+    // the codec is stored explicitly, because detecting it fails for uncompressed payloads that happen to start with a magic number
+    auto const c = compression::codec(data[sizeof(filter_magic)]);
+    if (c != compression::codec::none && c != compression::codec::zstd && c != compression::codec::lz4 && c != compression::codec::snappy)
+    {
+        on_error(data, data.subspan(sizeof(filter_magic), 1), "unknown codec", severity::error);
+        return {};
+    }
+
+    auto const filter_count = size_t(data[sizeof(filter_magic) + 1]);
+    auto const header_size = header_prefix_size + filter_count * filter_header_size;
+    if (data.size() < header_size)
+    {
+        on_error(data, {}, "truncated filter header", severity::error);
+        return {};
+    }
+
+    cc::vector<filter> filters;
+    for (size_t i = 0; i < filter_count; ++i)
+    {
+        auto const p = data.data() + header_prefix_size + i * filter_header_size;
+        auto const f = filter{filter_type(p[0]), uint8_t(p[1]), read_le32(p + 2)};
+        if (!is_valid(f))
+        {
+            on_error(data, data.subspan(p - data.data(), filter_header_size), "invalid filter description", severity::error);
+            return {};
+        }
+        filters.push_back(f);
+    }
+
+    auto error = false;
+    auto detect_error = [&](cc::span<std::byte const> d, cc::span<std::byte const> pos, cc::string_view message, severity s)
+    {
+        error = error || s == severity::error;
+        on_error(d, pos, message, s);
+    };
+    auto res = compression::uncompress(data.subspan(header_size), c, detect_error);
+    if (error)
+        return {};
+
+    // revert the filters in reverse order
+    auto buffer = cc::vector<std::byte>::uninitialized(res.size());
+    for (size_t i = filters.size(); i > 0; --i)
+    {
+        revert(buffer, res, filters[i - 1]);
+        cc::swap(res, buffer);
+    }
+    return res;
+}
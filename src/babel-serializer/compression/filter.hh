@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <clean-core/span.hh>
+#include <clean-core/vector.hh>
+
+#include <babel-serializer/compression/codec.hh>
+#include <babel-serializer/errors.hh>
+
+// reversible pre-filters for numeric data (Blosc-style)
+//
+// raw interleaved numeric arrays (e.g. pcd::point_cloud::data or ply::geometry::data) compress poorly,
+// because bytes of similar significance are far apart and neighboring values are correlated but not equal
+// these filters rearrange or decorrelate the bytes (without changing the size) so that general codecs find more redundancy:
+//
+//   shuffle     groups byte i of all elements together (e.g. all exponent bytes of floats)
+//   bitshuffle  groups bit i of all elements together (very effective for small integers)
+//   delta       replaces each element by its difference to the previous one (integer arithmetic)
+//   xor_delta   replaces each element by its xor with the previous one (good for floats)
+//   transpose   converts an array of records (AoS) into one array per field (SoA)
+//
+// NOTE: delta and xor_delta operate on the bit patterns, so they are lossless for floats as well
+// NOTE: trailing bytes that do not form a full element (or record) are copied unchanged
+//
+// usage:
+//
+//   // xyz float positions
+//   babel::filter::filter const filters[] = {{babel::filter::filter_type::transpose, 4, 12}, //
+//                                            {babel::filter::filter_type::shuffle, 4}};
+//   auto packed = babel::filter::compress(cloud.data, filters);
+//   ...
+//   cloud.data = babel::filter::uncompress(packed);
+//
+// format (of compress):
+//   magic "BFL\x01" (4 bytes) | codec (1 byte, compression::codec) | filter count (1 byte)
+//   per filter: type (1 byte) | element size (1 byte) | stride (4 bytes LE)
+//   payload compressed with the stored codec of babel::compression
+
+namespace babel::filter
+{
+enum class filter_type : uint8_t
+{
+    shuffle = 1,
+    bitshuffle = 2,
+    delta = 3,
+    xor_delta = 4,
+    transpose = 5,
+};
+
+struct filter
+{
+    filter_type type = filter_type::shuffle;
+
+    /// size of each element in bytes (delta and xor_delta support 1, 2, 4, and 8)
+    uint8_t element_size = 4;
+
+    /// size of each record in bytes (only used by transpose, must be a multiple of element_size)
+    uint32_t stride = 0;
+};
+
+// =========================================
+// filters
+//
+// out_data and data must have the same size
+// NOTE: out_data and data must not overlap (except for delta and xor_delta, which also work in-place)
+
+void shuffle(cc::span<std::byte> out_data, cc::span<std::byte const> data, size_t element_size);
+void unshuffle(cc::span<std::byte> out_data, cc::span<std::byte const> data, size_t element_size);
+
+void bitshuffle(cc::span<std::byte> out_data, cc::span<std::byte const> data, size_t element_size);
+void bitunshuffle(cc::span<std::byte> out_data, cc::span<std::byte const> data, size_t element_size);
+
+void delta_encode(cc::span<std::byte> out_data, cc::span<std::byte const> data, size_t element_size);
+void delta_decode(cc::span<std::byte> out_data, cc::span<std::byte const> data, size_t element_size);
+
+void xor_delta_encode(cc::span<std::byte> out_data, cc::span<std::byte const> data, size_t element_size);
+void xor_delta_decode(cc::span<std::byte> out_data, cc::span<std::byte const> data, size_t element_size);
+
+/// converts records of stride bytes, consisting of fields of element_size bytes, into one array per field
+/// NOTE: shuffle(es) is the same as transpose(es, 1)
+void transpose(cc::span<std::byte> out_data, cc::span<std::byte const> data, size_t stride, size_t element_size = 1);
+void untranspose(cc::span<std::byte> out_data, cc::span<std::byte const> data, size_t stride, size_t element_size = 1);
+
+/// applies a filter (described by f)
+void apply(cc::span<std::byte> out_data, cc::span<std::byte const> data, filter const& f);
+
+/// reverts a filter that was applied by apply(..., f)
+void revert(cc::span<std::byte> out_data, cc::span<std::byte const> data, filter const& f);
+
+// =========================================
+// filtered compression
+
+/// applies the filters in order and compresses the result with the given codec
+/// the filters are stored in a small header, so uncompress needs no configuration
+cc::vector<std::byte> compress(cc::span<std::byte const> data,
+                               cc::span<filter const> filters,
+                               compression::codec c = compression::codec::zstd,
+                               error_handler on_error = default_error_handler);
+
+/// Tries to uncompress data created by filter::compress (reverting all filters)
+cc::vector<std::byte> uncompress(cc::span<std::byte const> data, error_handler on_error = default_error_handler);
+
+/// returns true if data starts with the magic number of filter::compress
+bool is_filtered(cc::span<std::byte const> data);
+}
@@ -1,7 +1,220 @@
 #include "lz4.hh"
 
+#include <cstring>
+
+#include <clean-core/utility.hh>
+
+#define LZ4_STATIC_LINKING_ONLY // for LZ4_compress_fast_extState_fastReset
 #include <lz4/lz4.h>
 
+#include <zstd/common/xxhash.h>
+
+namespace
+{
+// see https://github.com/lz4/lz4/blob/dev/doc/lz4_Frame_format.md
+constexpr uint32_t frame_magic = 0x184D2204;
+constexpr uint32_t skippable_magic = 0x184D2A50; // lower 4 bits are user-defined
+constexpr uint32_t uncompressed_block_bit = 0x80000000;
+constexpr size_t max_dict_size = 64 * 1024;
+constexpr uint64_t max_compression_ratio = 255; // a match length byte encodes at most 255 bytes
+
+constexpr uint8_t flag_version = 0x40;
+constexpr uint8_t flag_independent_blocks = 0x20;
+constexpr uint8_t flag_block_checksum = 0x10;
+constexpr uint8_t flag_content_size = 0x08;
+constexpr uint8_t flag_content_checksum = 0x04;
+constexpr uint8_t flag_dict_id = 0x01;
+
+size_t block_size_of(uint8_t block_descriptor) { return size_t(1) << (8 + 2 * ((block_descriptor >> 4) & 0x7)); }
+
+uint32_t read_le32(std::byte const* p)
+{
+    return uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16 | uint32_t(p[3]) << 24;
+}
+uint64_t read_le64(std::byte const* p) { return uint64_t(read_le32(p)) | uint64_t(read_le32(p + 4)) << 32; }
+
+void write_le32(std::byte* p, uint32_t v)
+{
+    for (auto i = 0; i < 4; ++i)
+        p[i] = std::byte(v >> (8 * i));
+}
+void write_le64(std::byte* p, uint64_t v)
+{
+    write_le32(p, uint32_t(v));
+    write_le32(p + 4, uint32_t(v >> 32));
+}
+
+// second byte of the xxhash32 of the frame descriptor
+std::byte header_checksum(std::byte const* descriptor, size_t size) { return std::byte(ZSTD_XXH32(descriptor, size, 0) >> 8); }
+
+// =========================================
+// high compression
+//
+// a hash-chain match finder with one step of lazy matching (the approach of lz4hc)
+// it emits regular lz4 blocks, see https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md
+
+constexpr int hc_hash_log = 15;
+constexpr size_t hc_hash_size = size_t(1) << hc_hash_log;
+constexpr size_t hc_chain_size = 64 * 1024; // must cover the maximum match distance
+constexpr size_t hc_max_distance = 65535;
+constexpr size_t hc_min_match = 4;
+constexpr size_t hc_last_literals = 5; // the last 5 bytes of a block are always literals
+constexpr size_t hc_match_limit = 12;  // the last match must start at least 12 bytes before the block end
+
+uint32_t read_u32(std::byte const* p)
+{
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+uint32_t hc_hash(std::byte const* p) { return (read_u32(p) * 2654435761u) >> (32 - hc_hash_log); }
+
+struct hc_match
+{
+    size_t length = 0;
+    size_t distance = 0;
+};
+
+struct hc_encoder
+{
+    std::byte const* base;
+    int32_t* head;
+    uint16_t* chain;
+    size_t next_insert;
+    int search_depth;
+
+    void insert_until(size_t pos)
+    {
+        for (; next_insert < pos; ++next_insert)
+        {
+            auto& h = head[hc_hash(base + next_insert)];
+            auto const delta = h < 0 ? 0 : next_insert - size_t(h);
+            chain[next_insert % hc_chain_size] = uint16_t(cc::min(delta, hc_max_distance));
+            h = int32_t(next_insert);
+        }
+    }
+
+    hc_match find(size_t pos, size_t end)
+    {
+        insert_until(pos);
+
+        hc_match best;
+        auto const seq = read_u32(base + pos);
+        auto cand = head[hc_hash(base + pos)];
+        for (auto attempts = search_depth; cand >= 0 && attempts > 0; --attempts)
+        {
+            auto const distance = pos - size_t(cand);
+            if (distance > hc_max_distance)
+                break;
+
+            if (read_u32(base + cand) == seq)
+            {
+                auto length = hc_min_match;
+                while (pos + length < end && base[cand + length] == base[pos + length])
+                    ++length;
+                if (length > best.length)
+                {
+                    best.length = length;
+                    best.distance = distance;
+                }
+            }
+
+            auto const delta = chain[size_t(cand) % hc_chain_size];
+            if (delta == 0)
+                break;
+            cand -= delta;
+        }
+        return best;
+    }
+};
+
+// lz4 length encoding: 4 bits in the token, 255-byte continuation for larger values
+std::byte* hc_write_length(std::byte* dst, size_t length)
+{
+    for (length -= 15; length >= 255; length -= 255)
+        *dst++ = std::byte(255);
+    *dst++ = std::byte(length);
+    return dst;
+}
+
+// compresses base[prefix, prefix + size) into dst
+// base[0, prefix) is history (of linked blocks) that matches may reference
+// returns the compressed size or 0 if dst is too small
+size_t hc_compress_block(std::byte const* base, size_t prefix, size_t size, std::byte* dst, size_t capacity, int32_t* head, uint16_t* chain, int search_depth)
+{
+    for (size_t i = 0; i < hc_hash_size; ++i)
+        head[i] = -1;
+
+    auto const block_end = prefix + size;
+    auto const match_end = block_end - cc::min(size, hc_last_literals);
+    auto const last_start = size > hc_match_limit ? block_end - hc_match_limit : prefix;
+
+    auto const dst_begin = dst;
+    auto const dst_end = dst + capacity;
+
+    auto const emit = [&](size_t anchor, size_t literals, hc_match const* m) -> bool {
+        // token + length bytes + literals + offset + match length bytes
+        auto const worst_case = 1 + literals / 255 + 1 + literals + 2 + (m ? m->length / 255 + 1 : 0);
+        if (size_t(dst_end - dst) < worst_case)
+            return false;
+
+        auto& token = *dst++;
+        auto t = uint8_t(cc::min(literals, size_t(15)) << 4);
+        if (literals >= 15)
+            dst = hc_write_length(dst, literals);
+        std::memcpy(dst, base + anchor, literals);
+        dst += literals;
+
+        if (m)
+        {
+            *dst++ = std::byte(m->distance);
+            *dst++ = std::byte(m->distance >> 8);
+            auto const ml = m->length - hc_min_match;
+            t |= uint8_t(cc::min(ml, size_t(15)));
+            if (ml >= 15)
+                dst = hc_write_length(dst, ml);
+        }
+        token = std::byte(t);
+        return true;
+    };
+
+    auto encoder = hc_encoder{base, head, chain, 0, cc::max(search_depth, 1)};
+    auto anchor = prefix;
+    auto pos = prefix;
+    while (pos < last_start)
+    {
+        auto m = encoder.find(pos, match_end);
+        if (m.length < hc_min_match)
+        {
+            ++pos;
+            continue;
+        }
+
+        // lazy matching: prefer a longer match starting at the next byte
+        while (pos + 1 < last_start)
+        {
+            auto const next = encoder.find(pos + 1, match_end);
+            if (next.length <= m.length)
+                break;
+            m = next;
+            ++pos;
+        }
+
+        if (!emit(anchor, pos - anchor, &m))
+            return 0;
+        pos += m.length;
+        anchor = pos;
+    }
+
+    if (!emit(anchor, block_end - anchor, nullptr))
+        return 0;
+    return size_t(dst - dst_begin);
+}
+}
+
+size_t babel::lz4::compress_bound(size_t size) { return size_t(LZ4_compressBound(int(size))); }
+
 cc::vector<std::byte> babel::lz4::compress(cc::span<std::byte const> data)
 {
     cc::vector<std::byte> res;
@@ -11,6 +224,17 @@ cc::vector<std::byte> babel::lz4::compress(cc::span<std::byte const> data)
     return res;
 }
 
+size_t babel::lz4::compress_to(cc::span<std::byte> out_data, cc::span<std::byte const> data, error_handler on_error)
+{
+    auto real_size = LZ4_compress_default(reinterpret_cast<char const*>(data.data()), reinterpret_cast<char*>(out_data.data()), data.size_bytes(), out_data.size());
+    if (real_size <= 0)
+    {
+        on_error(data, {}, "could not compress data (output buffer too small)", severity::error);
+        return 0;
+    }
+    return size_t(real_size);
+}
+
 bool babel::lz4::uncompress_to(cc::span<std::byte> out_data, cc::span<std::byte const> data, error_handler on_error)
 {
     auto r = LZ4_decompress_safe(reinterpret_cast<char const*>(data.data()), reinterpret_cast<char*>(out_data.data()), data.size(), out_data.size());
@@ -34,3 +258,518 @@ cc::vector<std::byte> babel::lz4::uncompress(cc::span<std::byte const> data, siz
     uncompress_to(res, data, on_error);
     return res;
 }
+
+cc::alloc_array<std::byte> babel::lz4::uncompress(cc::span<std::byte const> data, size_t uncompressedSize, cc::allocator* alloc, error_handler on_error)
+{
+    auto res = cc::alloc_array<std::byte>::uninitialized(uncompressedSize, alloc);
+    if (!uncompress_to(res, data, on_error))
+        return {};
+    return res;
+}
+
+babel::lz4::compressor::compressor()
+{
+    _state = LZ4_createStream();
+    CC_ASSERT(_state && "unable to create lz4 state");
+}
+
+babel::lz4::compressor::~compressor()
+{
+    if (_state)
+        LZ4_freeStream(_state);
+}
+
+babel::lz4::compressor::compressor(compressor&& rhs) noexcept
+{
+    _state = rhs._state;
+    rhs._state = nullptr;
+}
+
+babel::lz4::compressor& babel::lz4::compressor::operator=(compressor&& rhs) noexcept
+{
+    if (_state)
+        LZ4_freeStream(_state);
+    _state = rhs._state;
+    rhs._state = nullptr;
+    return *this;
+}
+
+cc::vector<std::byte> babel::lz4::compressor::compress(cc::span<std::byte const> data, int acceleration)
+{
+    CC_ASSERT(_state && "compressor was moved from");
+
+    cc::vector<std::byte> res;
+    res.resize(LZ4_compressBound(data.size()));
+    auto real_size = LZ4_compress_fast_extState_fastReset(_state, reinterpret_cast<char const*>(data.data()), reinterpret_cast<char*>(res.data()),
+                                                          data.size_bytes(), res.size(), acceleration);
+    res.resize(real_size); // preserves actual content
+    return res;
+}
+
+size_t babel::lz4::compressor::compress_to(cc::span<std::byte> out_data, cc::span<std::byte const> data, int acceleration, error_handler on_error)
+{
+    CC_ASSERT(_state && "compressor was moved from");
+
+    auto real_size = LZ4_compress_fast_extState_fastReset(_state, reinterpret_cast<char const*>(data.data()), reinterpret_cast<char*>(out_data.data()),
+                                                          data.size_bytes(), out_data.size(), acceleration);
+    if (real_size <= 0)
+    {
+        on_error(data, {}, "could not compress data (output buffer too small)", severity::error);
+        return 0;
+    }
+    return size_t(real_size);
+}
+
+cc::vector<std::byte> babel::lz4::compress_frame(cc::span<std::byte const> data, frame_config const& cfg, error_handler on_error)
+{
+    cc::vector<std::byte> res;
+    res.reserve(LZ4_compressBound(data.size()) + 32);
+    auto append = [&](cc::span<std::byte const> d) { res.push_back_range(d); };
+    {
+        auto stream = compress_stream(append, cfg, on_error);
+        stream.set_content_size(data.size());
+        stream(data);
+        stream.finish();
+    }
+    return res;
+}
+
+cc::vector<std::byte> babel::lz4::uncompress_frame(cc::span<std::byte const> data, error_handler on_error)
+{
+    cc::vector<std::byte> res;
+
+    // reserve the content size of the first frame if available
+    // (only with a valid descriptor and bounded by the maximum lz4 ratio, so that a corrupt size cannot exhaust the memory)
+    if (data.size() >= 15 && read_le32(data.data()) == frame_magic && (uint8_t(data[4]) & (flag_content_size | flag_dict_id)) == flag_content_size
+        && header_checksum(data.data() + 4, 10) == data[14])
+        res.reserve(size_t(cc::min(read_le64(data.data() + 6), uint64_t(data.size()) * max_compression_ratio)));
+
+    auto append = [&](cc::span<std::byte const> d) { res.push_back_range(d); };
+    auto stream = decompress_stream(append, on_error);
+    stream(data);
+    if (!stream.finish())
+        return {};
+
+    return res;
+}
+
+babel::lz4::compress_stream::compress_stream(cc::stream_ref<std::byte> output, frame_config const& cfg, error_handler on_error)
+  : _output(output), _on_error(on_error), _config(cfg)
+{
+    CC_ASSERT(block_size::max_64KB <= cfg.max_block_size && cfg.max_block_size <= block_size::max_4MB && "invalid block size");
+
+    _state = LZ4_createStream();
+    CC_ASSERT(_state && "unable to create lz4 state");
+    _checksum = ZSTD_XXH32_createState();
+    CC_ASSERT(_checksum && "unable to create xxhash state");
+
+    auto const max_block_size = block_size_of(uint8_t(cfg.max_block_size) << 4);
+    _block = cc::array<std::byte>::uninitialized(max_block_size);
+    _compressed = cc::array<std::byte>::uninitialized(4 + LZ4_compressBound(int(max_block_size)) + 4);
+    if (cfg.high_compression)
+    {
+        _hc_head = cc::array<int32_t>::uninitialized(hc_hash_size);
+        _hc_chain = cc::array<uint16_t>::uninitialized(hc_chain_size);
+        if (cfg.linked_blocks)
+            _window = cc::array<std::byte>::uninitialized(max_dict_size + max_block_size);
+    }
+    else if (cfg.linked_blocks)
+        _dict = cc::array<std::byte>::uninitialized(max_dict_size);
+}
+
+babel::lz4::compress_stream::~compress_stream()
+{
+    if (_has_unfinished_frame)
+        finish();
+
+    LZ4_freeStream(_state);
+    ZSTD_XXH32_freeState(_checksum);
+}
+
+void babel::lz4::compress_stream::set_content_size(uint64_t size)
+{
+    CC_ASSERT(!_has_frame_header && "content size must be set before data of the frame is pushed");
+    _content_size = size;
+    _has_content_size = true;
+}
+
+void babel::lz4::compress_stream::operator()(cc::span<std::byte const> data)
+{
+    if (!_has_frame_header)
+        begin_frame();
+
+    while (!data.empty())
+    {
+        // full blocks are compressed without copying them first
+        if (_block_fill == 0 && data.size() >= _block.size())
+        {
+            write_block(data.subspan(0, _block.size()));
+            data = data.subspan(_block.size());
+            continue;
+        }
+
+        auto const n = cc::min(_block.size() - _block_fill, data.size());
+        std::memcpy(_block.data() + _block_fill, data.data(), n);
+        _block_fill += n;
+        data = data.subspan(n);
+
+        if (_block_fill == _block.size())
+        {
+            write_block(_block);
+            _block_fill = 0;
+        }
+    }
+}
+
+void babel::lz4::compress_stream::flush()
+{
+    if (_block_fill == 0)
+        return;
+
+    write_block(cc::span<std::byte const>(_block.data(), _block_fill));
+    _block_fill = 0;
+}
+
+void babel::lz4::compress_stream::finish()
+{
+    if (!_has_unfinished_frame)
+        return;
+
+    if (!_has_frame_header)
+        begin_frame();
+
+    flush();
+
+    std::byte end[8];
+    size_t end_size = 4;
+    write_le32(end, 0); // end mark
+    if (_config.content_checksum)
+    {
+        write_le32(end + 4, ZSTD_XXH32_digest(_checksum));
+        end_size += 4;
+    }
+    _output(cc::span<std::byte const>(end, end_size));
+
+    if (_has_content_size && _frame_size != _content_size)
+        _on_error({}, {}, "amount of compressed data does not match the content size stored in the lz4 frame", severity::error);
+
+    _has_content_size = false;
+    _has_frame_header = false;
+    _has_unfinished_frame = false;
+}
+
+void babel::lz4::compress_stream::begin_frame()
+{
+    std::byte header[4 + 2 + 8 + 1];
+    write_le32(header, frame_magic);
+
+    auto flags = flag_version;
+    if (!_config.linked_blocks)
+        flags |= flag_independent_blocks;
+    if (_config.block_checksum)
+        flags |= flag_block_checksum;
+    if (_has_content_size)
+        flags |= flag_content_size;
+    if (_config.content_checksum)
+        flags |= flag_content_checksum;
+    header[4] = std::byte(flags);
+    header[5] = std::byte(uint8_t(_config.max_block_size) << 4);
+
+    size_t size = 6;
+    if (_has_content_size)
+    {
+        write_le64(header + size, _content_size);
+        size += 8;
+    }
+    header[size] = header_checksum(header + 4, size - 4);
+    ++size;
+
+    _output(cc::span<std::byte const>(header, size));
+
+    if (_config.linked_blocks)
+        LZ4_resetStream_fast(_state);
+    _window_fill = 0;
+    ZSTD_XXH32_reset(_checksum, 0);
+    _frame_size = 0;
+    _has_frame_header = true;
+    _has_unfinished_frame = true;
+}
+
+void babel::lz4::compress_stream::write_block(cc::span<std::byte const> data)
+{
+    auto const src = reinterpret_cast<char const*>(data.data());
+    auto const dst = reinterpret_cast<char*>(_compressed.data() + 4);
+    auto const capacity = int(_compressed.size() - 8);
+
+    int size;
+    if (_config.high_compression && _config.linked_blocks)
+    {
+        // matches may reference the last 64 KB of previous blocks, so history and block must be contiguous
+        std::memcpy(_window.data() + _window_fill, data.data(), data.size());
+        size = int(hc_compress_block(_window.data(), _window_fill, data.size(), reinterpret_cast<std::byte*>(dst), size_t(capacity), _hc_head.data(),
+                                     _hc_chain.data(), _config.search_depth));
+
+        auto const total = _window_fill + data.size();
+        _window_fill = cc::min(total, max_dict_size);
+        std::memmove(_window.data(), _window.data() + (total - _window_fill), _window_fill);
+    }
+    else if (_config.high_compression)
+        size = int(hc_compress_block(data.data(), 0, data.size(), reinterpret_cast<std::byte*>(dst), size_t(capacity), _hc_head.data(),
+                                     _hc_chain.data(), _config.search_depth));
+    else if (_config.linked_blocks)
+    {
+        size = LZ4_compress_fast_continue(_state, src, dst, int(data.size()), capacity, _config.acceleration);
+        // data might not outlive this call, so the history is copied
+        LZ4_saveDict(_state, reinterpret_cast<char*>(_dict.data()), int(_dict.size()));
+    }
+    else
+        size = LZ4_compress_fast_extState_fastReset(_state, src, dst, int(data.size()), capacity, _config.acceleration);
+
+    auto block_header = uint32_t(size);
+    if (size <= 0 || size_t(size) >= data.size()) // incompressible data is stored as-is
+    {
+        std::memcpy(dst, data.data(), data.size());
+        size = int(data.size());
+        block_header = uint32_t(size) | uncompressed_block_bit;
+    }
+    write_le32(_compressed.data(), block_header);
+
+    auto block_end = 4 + size_t(size);
+    if (_config.block_checksum)
+    {
+        write_le32(_compressed.data() + block_end, ZSTD_XXH32(dst, size, 0));
+        block_end += 4;
+    }
+
+    _output(cc::span<std::byte const>(_compressed.data(), block_end));
+
+    if (_config.content_checksum)
+        ZSTD_XXH32_update(_checksum, data.data(), data.size());
+    _frame_size += data.size();
+}
+
+babel::lz4::decompress_stream::decompress_stream(cc::stream_ref<std::byte> output, error_handler on_error) : _output(output), _on_error(on_error)
+{
+    _checksum = ZSTD_XXH32_createState();
+    CC_ASSERT(_checksum && "unable to create xxhash state");
+}
+
+babel::lz4::decompress_stream::~decompress_stream() { ZSTD_XXH32_freeState(_checksum); }
+
+void babel::lz4::decompress_stream::operator()(cc::span<std::byte const> data)
+{
+    while (!data.empty() && !_has_error)
+    {
+        // skippable frames are not buffered
+        if (_stage == stage::skippable_data)
+        {
+            auto const n = size_t(cc::min(_skip_size, uint64_t(data.size())));
+            data = data.subspan(n);
+            _skip_size -= n;
+            if (_skip_size == 0)
+            {
+                _stage = stage::magic;
+                _needed = 4;
+            }
+            continue;
+        }
+
+        // complete input is processed in-place, partial input is buffered until enough data is available
+        if (_pending.empty() && data.size() >= _needed)
+        {
+            auto const n = _needed;
+            process(data.subspan(0, n));
+            data = data.subspan(n);
+        }
+        else
+        {
+            auto const n = cc::min(_needed - _pending.size(), data.size());
+            _pending.push_back_range(data.subspan(0, n));
+            data = data.subspan(n);
+
+            if (_pending.size() == _needed)
+            {
+                process(_pending);
+                _pending.clear();
+            }
+        }
+    }
+}
+
+bool babel::lz4::decompress_stream::finish()
+{
+    if (_has_error)
+        return false;
+
+    if (_stage != stage::magic || !_pending.empty())
+    {
+        _on_error({}, {}, "compressed data ended in the middle of a frame (truncated data?)", severity::error);
+        return false;
+    }
+
+    return true;
+}
+
+void babel::lz4::decompress_stream::process(cc::span<std::byte const> data)
+{
+    switch (_stage)
+    {
+    case stage::magic:
+    {
+        auto const magic = read_le32(data.data());
+        if (magic == frame_magic)
+        {
+            _stage = stage::frame_descriptor;
+            _needed = 2;
+        }
+        else if ((magic & 0xFFFFFFF0) == skippable_magic)
+        {
+            _stage = stage::skippable_size;
+            _needed = 4;
+        }
+        else
+            report(data, "unknown magic number (data is not in the lz4 frame format)");
+        return;
+    }
+
+    case stage::skippable_size:
+        _skip_size = read_le32(data.data());
+        _stage = _skip_size == 0 ? stage::magic : stage::skippable_data;
+        _needed = 4;
+        return;
+
+    case stage::frame_descriptor:
+        _flags = uint8_t(data[0]);
+        _block_descriptor = uint8_t(data[1]);
+        if ((_flags & 0xC0) != flag_version)
+            return report(data, "unsupported lz4 frame version");
+        if (_flags & flag_dict_id)
+            return report(data, "lz4 frames with dictionaries are not supported");
+        if ((_flags & 0x02) || (_block_descriptor & 0x8F) || (_block_descriptor >> 4) < uint8_t(block_size::max_64KB))
+            return report(data, "invalid lz4 frame descriptor");
+
+        _stage = stage::frame_descriptor_end;
+        _needed = (_flags & flag_content_size ? 8 : 0) + 1;
+        return;
+
+    case stage::frame_descriptor_end:
+    {
+        std::byte descriptor[2 + 8];
+        descriptor[0] = std::byte(_flags);
+        descriptor[1] = std::byte(_block_descriptor);
+        std::memcpy(descriptor + 2, data.data(), data.size() - 1);
+        if (header_checksum(descriptor, 2 + data.size() - 1) != data.back())
+            return report(data, "lz4 frame header checksum mismatch");
+
+        _content_size = _flags & flag_content_size ? read_le64(data.data()) : 0;
+        _frame_size = 0;
+        _history.clear();
+        ZSTD_XXH32_reset(_checksum, 0);
+
+        auto const max_block_size = block_size_of(_block_descriptor);
+        if (_block.size() < max_block_size)
+            _block = cc::array<std::byte>::uninitialized(max_block_size);
+
+        _stage = stage::block_header;
+        _needed = 4;
+        return;
+    }
+
+    case stage::block_header:
+        _block_header = read_le32(data.data());
+        if (_block_header == 0) // end mark
+        {
+            if (_flags & flag_content_checksum)
+            {
+                _stage = stage::content_checksum;
+                _needed = 4;
+            }
+            else
+                end_frame();
+            return;
+        }
+
+        if ((_block_header & ~uncompressed_block_bit) > block_size_of(_block_descriptor))
+            return report(data, "lz4 block is larger than the maximum block size of the frame");
+
+        _needed = (_block_header & ~uncompressed_block_bit) + (_flags & flag_block_checksum ? 4 : 0);
+        if (_needed == 0) // empty uncompressed block
+            _needed = 4;
+        else
+            _stage = stage::block;
+        return;
+
+    case stage::block:
+        decode_block(data);
+        if (!_has_error)
+        {
+            _stage = stage::block_header;
+            _needed = 4;
+        }
+        return;
+
+    case stage::content_checksum:
+        if (read_le32(data.data()) != ZSTD_XXH32_digest(_checksum))
+            return report(data, "lz4 content checksum mismatch (corrupted data?)");
+        end_frame();
+        return;
+
+    case stage::skippable_data:
+        CC_UNREACHABLE("skippable data is handled in operator()");
+    }
+}
+
+void babel::lz4::decompress_stream::decode_block(cc::span<std::byte const> data)
+{
+    auto const size = _block_header & ~uncompressed_block_bit;
+    auto const block = data.subspan(0, size);
+
+    if ((_flags & flag_block_checksum) && read_le32(data.data() + size) != ZSTD_XXH32(block.data(), block.size(), 0))
+        return report(data, "lz4 block checksum mismatch (corrupted data?)");
+
+    auto content = block;
+    if (!(_block_header & uncompressed_block_bit))
+    {
+        auto const src = reinterpret_cast<char const*>(block.data());
+        auto const dst = reinterpret_cast<char*>(_block.data());
+        auto const capacity = int(block_size_of(_block_descriptor));
+        auto const r = (_flags & flag_independent_blocks)
+                           ? LZ4_decompress_safe(src, dst, int(size), capacity)
+                           : LZ4_decompress_safe_usingDict(src, dst, int(size), capacity, reinterpret_cast<char const*>(_history.data()), int(_history.size()));
+        if (r < 0)
+            return report(data, "could not decompress lz4 block (internal lz4 error)");
+
+        content = cc::span<std::byte const>(_block.data(), size_t(r));
+    }
+
+    // linked blocks need the last 64 KB of uncompressed data
+    if (!(_flags & flag_independent_blocks))
+    {
+        auto const added = cc::min(content.size(), max_dict_size);
+        auto const kept = cc::min(_history.size(), max_dict_size - added);
+        std::memmove(_history.data(), _history.data() + _history.size() - kept, kept);
+        _history.resize(kept + added);
+        std::memcpy(_history.data() + kept, content.data() + content.size() - added, added);
+    }
+
+    if (_flags & flag_content_checksum)
+        ZSTD_XXH32_update(_checksum, content.data(), content.size());
+    _frame_size += content.size();
+
+    _output(content);
+}
+
+void babel::lz4::decompress_stream::end_frame()
+{
+    if ((_flags & flag_content_size) && _frame_size != _content_size)
+        return report({}, "lz4 frame content size does not match the decompressed size");
+
+    _stage = stage::magic;
+    _needed = 4;
+}
+
+void babel::lz4::decompress_stream::report(cc::span<std::byte const> data, cc::string_view message)
+{
+    _on_error(data, {}, message, severity::error);
+    _has_error = true;
+}
@@ -1,25 +1,247 @@
 #pragma once
 
 #include <cstddef>
+#include <cstdint>
 
+#include <clean-core/alloc_array.hh>
+#include <clean-core/array.hh>
 #include <clean-core/span.hh>
+#include <clean-core/stream_ref.hh>
 #include <clean-core/vector.hh>
 
 #include <babel-serializer/errors.hh>
 
 // TODO: more of lz4's API can be exposed if required
 
+// fwd (LZ4_stream_t)
+union LZ4_stream_u;
+// fwd (xxhash32 state, vendored with zstd)
+struct ZSTD_XXH32_state_s;
+
 namespace babel::lz4
 {
+/// returns the maximum compressed size of data with the given size (in bytes)
+size_t compress_bound(size_t size);
+
 /// compresses a range of bytes using lz4
 /// NOTE: the result has more capacity than data
 ///       if it is stored long-term, a shrink_to_fit is advised
 cc::vector<std::byte> compress(cc::span<std::byte const> data);
 
+/// compresses into a caller-provided buffer without allocating the result
+/// returns the compressed size or 0 on error (e.g. if out_data is too small)
+/// NOTE: out_data.size() >= compress_bound(data.size()) always suffices
+size_t compress_to(cc::span<std::byte> out_data, cc::span<std::byte const> data, error_handler on_error = default_error_handler);
+
 /// Tries to uncompress the given data
 /// NOTE: lz4 does not store the uncompressed size, so it out_data must already be sized appropriately
 bool uncompress_to(cc::span<std::byte> out_data, cc::span<std::byte const> data, error_handler on_error = default_error_handler);
 /// same as uncompress_to but allocates target buffer
 /// NOTE: lz4 does not store the uncompressed size, so it must be transmitted separately
 cc::vector<std::byte> uncompress(cc::span<std::byte const> data, size_t uncompressedSize, error_handler on_error = default_error_handler);
+/// same as uncompress but the result is allocated with the given allocator
+cc::alloc_array<std::byte> uncompress(cc::span<std::byte const> data, size_t uncompressedSize, cc::allocator* alloc, error_handler on_error = default_error_handler);
+
+/// a reusable lz4 compression state
+/// avoids fully re-initializing the lz4 hash table for every call (beneficial for many small payloads)
+/// NOTE: not thread-safe, use one compressor per thread
+/// NOTE: lz4 decompression is stateless and thus needs no context
+struct compressor
+{
+    compressor();
+    ~compressor();
+
+    compressor(compressor const&) = delete;
+    compressor& operator=(compressor const&) = delete;
+    compressor(compressor&& rhs) noexcept;
+    compressor& operator=(compressor&& rhs) noexcept;
+
+    /// same as lz4::compress but reuses this state
+    /// NOTE: a higher acceleration is faster but compresses worse (1 is the lz4 default)
+    cc::vector<std::byte> compress(cc::span<std::byte const> data, int acceleration = 1);
+    /// same as lz4::compress_to but reuses this state
+    size_t compress_to(cc::span<std::byte> out_data, cc::span<std::byte const> data, int acceleration = 1, error_handler on_error = default_error_handler);
+
+private:
+    LZ4_stream_u* _state = nullptr;
+};
+
+// =========================================
+// frame format
+//
+// the lz4 frame format is self-describing (stores sizes and checksums)
+// and compatible with the lz4 command line tool
+// raw blocks (see above) are smaller but require the uncompressed size to be transmitted separately
+
+/// maximum uncompressed size of a single block inside a frame
+/// larger blocks compress slightly better but need more memory for (de)compression
+enum class block_size : uint8_t
+{
+    max_64KB = 4,
+    max_256KB = 5,
+    max_1MB = 6,
+    max_4MB = 7,
+};
+
+struct frame_config
+{
+    block_size max_block_size = block_size::max_64KB;
+
+    /// if true, blocks can reference data of previous blocks (better ratio, especially for small blocks)
+    /// otherwise, each block is independent
+    bool linked_blocks = false;
+
+    /// stores an xxhash32 of the uncompressed content at the end of the frame
+    bool content_checksum = true;
+
+    /// stores an xxhash32 of each compressed block
+    bool block_checksum = false;
+
+    /// a higher acceleration is faster but compresses worse (1 is the lz4 default)
+    /// NOTE: ignored if high_compression is set
+    int acceleration = 1;
+
+    /// uses a slower hash-chain match finder (similar to lz4hc) for a better ratio
+    /// the output is a regular lz4 frame, decompression speed is unaffected
+    bool high_compression = false;
+
+    /// number of match candidates tested per position in high_compression mode
+    /// higher values compress better but slower
+    int search_depth = 64;
+};
+
+/// compresses a range of bytes into a single lz4 frame (including the content size)
+cc::vector<std::byte> compress_frame(cc::span<std::byte const> data, frame_config const& cfg = {}, error_handler on_error = default_error_handler);
+
+/// Tries to uncompress the given lz4 frame(s)
+/// NOTE: supports concatenated and skippable frames
+/// NOTE: frames with dictionary ids are not supported
+cc::vector<std::byte> uncompress_frame(cc::span<std::byte const> data, error_handler on_error = default_error_handler);
+
+/// a streaming lz4 frame compressor with bounded memory
+/// uncompressed data is pushed via operator() (thus it can be used as a cc::stream_ref<std::byte>)
+/// and compressed data is written to the output stream block by block
+///
+/// usage:
+///
+///   auto file = babel::file::file_output_stream("data.lz4");
+///   auto compressor = babel::lz4::compress_stream(file);
+///   babel::file::read(compressor, "data.raw"); // or compressor(some_data);
+///   compressor.finish();
+///
+/// NOTE: the output stream and on_error must outlive this object
+/// NOTE: finish() ends the current frame, data pushed afterwards starts a new frame
+///       the dtor calls finish() if there is unfinished data
+struct compress_stream
+{
+    explicit compress_stream(cc::stream_ref<std::byte> output, frame_config const& cfg = {}, error_handler on_error = default_error_handler);
+    ~compress_stream();
+
+    // no copy or move (stream_refs point to this object)
+    compress_stream(compress_stream const&) = delete;
+    compress_stream& operator=(compress_stream const&) = delete;
+
+    /// stores the total uncompressed size of the next frame in its header
+    /// NOTE: must be called before any data of the frame is pushed
+    ///       finish() reports an error if a different amount of data was pushed
+    void set_content_size(uint64_t size);
+
+    /// compresses the given data (output is only written once a block is full)
+    void operator()(cc::span<std::byte const> data);
+
+    /// writes all buffered data to the output as a (smaller) block without ending the frame
+    void flush();
+
+    /// ends the current frame and writes all remaining data to the output
+    void finish();
+
+private:
+    void begin_frame();
+    void write_block(cc::span<std::byte const> data);
+
+    LZ4_stream_u* _state = nullptr;
+    ZSTD_XXH32_state_s* _checksum = nullptr;
+    cc::stream_ref<std::byte> _output;
+    error_handler _on_error;
+    frame_config _config;
+    cc::array<std::byte> _block;      // uncompressed data of the current block
+    cc::array<std::byte> _compressed; // block size + compressed block + block checksum
+    cc::array<std::byte> _dict;       // history of linked blocks
+    cc::array<std::byte> _window;     // high_compression: history + current block of linked blocks
+    cc::array<int32_t> _hc_head;      // high_compression: last position per hash
+    cc::array<uint16_t> _hc_chain;    // high_compression: distance to the previous position with the same hash
+    size_t _window_fill = 0;
+    size_t _block_fill = 0;
+    uint64_t _content_size = 0;
+    uint64_t _frame_size = 0;
+    bool _has_content_size = false;
+    bool _has_frame_header = false;
+    bool _has_unfinished_frame = true; // an empty stream still produces an (empty) frame
+};
+
+/// a streaming lz4 frame decompressor with bounded memory
+/// compressed data is pushed via operator() (thus it can be used as a cc::stream_ref<std::byte>)
+/// and uncompressed data is written to the output stream block by block
+/// concatenated frames are decompressed one after another, skippable frames are ignored
+///
+/// usage:
+///
+///   auto file = babel::file::file_output_stream("data.raw");
+///   auto decompressor = babel::lz4::decompress_stream(file);
+///   babel::file::read(decompressor, "data.lz4");
+///   if (!decompressor.finish())
+///       ... // error or truncated data
+///
+/// NOTE: the output stream and on_error must outlive this object
+struct decompress_stream
+{
+    explicit decompress_stream(cc::stream_ref<std::byte> output, error_handler on_error = default_error_handler);
+    ~decompress_stream();
+
+    // no copy or move (stream_refs point to this object)
+    decompress_stream(decompress_stream const&) = delete;
+    decompress_stream& operator=(decompress_stream const&) = delete;
+
+    /// decompresses the given data (frames may be split arbitrarily between calls)
+    void operator()(cc::span<std::byte const> data);
+
+    /// must be called after all data was pushed
+    /// reports an error if the data ended in the middle of a frame
+    /// returns true if all data was decompressed successfully
+    bool finish();
+
+private:
+    enum class stage : uint8_t
+    {
+        magic,
+        frame_descriptor,
+        frame_descriptor_end,
+        block_header,
+        block,
+        content_checksum,
+        skippable_size,
+        skippable_data,
+    };
+
+    void process(cc::span<std::byte const> data);
+    void decode_block(cc::span<std::byte const> data);
+    void end_frame();
+    void report(cc::span<std::byte const> data, cc::string_view message);
+
+    ZSTD_XXH32_state_s* _checksum = nullptr;
+    cc::stream_ref<std::byte> _output;
+    error_handler _on_error;
+    cc::vector<std::byte> _pending; // incomplete input of the current stage
+    cc::array<std::byte> _block;    // uncompressed data of the current block
+    cc::vector<std::byte> _history; // history of linked blocks
+    stage _stage = stage::magic;
+    size_t _needed = 4;
+    uint64_t _skip_size = 0;
+    uint64_t _content_size = 0;
+    uint64_t _frame_size = 0;
+    uint32_t _block_header = 0;
+    uint8_t _flags = 0;
+    uint8_t _block_descriptor = 0;
+    bool _has_error = false;
+};
 }
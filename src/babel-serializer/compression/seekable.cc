@@ -0,0 +1,382 @@
+#include "seekable.hh"
+
+#include <atomic>
+#include <cstring>
+
+#include <clean-core/assert.hh>
+#include <clean-core/function_ref.hh>
+#include <clean-core/utility.hh>
+
+#include <babel-serializer/detail/parallel.hh>
+#include <babel-serializer/hash.hh>
+
+namespace
+{
+// see zstd/contrib/seekable_format/zstd_seekable_compression_format.md
+constexpr uint32_t seek_table_magic = 0x184D2A5E; // a skippable frame for zstd and lz4
+constexpr uint32_t seekable_magic = 0x8F92EAB1;
+constexpr size_t seek_table_footer_size = 9;
+constexpr uint8_t seek_table_checksum_flag = 0x80;
+
+// the seekable format stores the lower 32 bit of the xxhash64 of each chunk
+uint32_t chunk_checksum(uint64_t hash) { return uint32_t(hash); }
+
+uint32_t read_le32(std::byte const* p)
+{
+    return uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16 | uint32_t(p[3]) << 24;
+}
+
+void write_le32(std::byte* p, uint32_t v)
+{
+    for (auto i = 0; i < 4; ++i)
+        p[i] = std::byte(v >> (8 * i));
+}
+
+cc::vector<std::byte> compress_chunk(cc::span<std::byte const> data, babel::compression::seekable_config const& cfg, babel::error_handler on_error)
+{
+    using namespace babel;
+
+    switch (cfg.chunk_codec)
+    {
+    case compression::codec::zstd:
+        return zstd::compress(data, zstd::compress_config{cfg.compression_level}, on_error);
+    case compression::codec::lz4:
+        return lz4::compress_frame(data, {}, on_error);
+    default:
+        CC_UNREACHABLE("unsupported chunk codec");
+    }
+}
+
+bool verify_checksum(cc::span<std::byte const> chunk, uint32_t const* expected_checksum, uint64_t hash, babel::error_handler on_error)
+{
+    if (expected_checksum && *expected_checksum != chunk_checksum(hash))
+    {
+        on_error(chunk, {}, "chunk checksum mismatch (corrupted data?)", babel::severity::error);
+        return false;
+    }
+    return true;
+}
+
+/// decompresses the chunk containing the uncompressed range [chunk_begin, chunk_end)
+/// and calls on_data with the (consecutive) uncompressed data
+/// NOTE: expected_checksum is optional
+bool uncompress_chunk(cc::span<std::byte const> chunk,
+                      uint64_t chunk_begin,
+                      uint64_t chunk_end,
+                      uint32_t const* expected_checksum,
+                      babel::error_handler on_error,
+                      cc::function_ref<void(uint64_t pos, cc::span<std::byte const> data)> on_data)
+{
+    using namespace babel;
+
+    auto hasher = hash::xxh64_stream();
+    auto pos = chunk_begin;
+    auto forward = [&](cc::span<std::byte const> d)
+    {
+        on_data(pos, d);
+        if (expected_checksum)
+            hasher(d);
+        pos += d.size();
+    };
+    auto stream = compression::decompress_stream(forward, on_error);
+    stream(chunk);
+    if (!stream.finish())
+        return false;
+
+    if (pos != chunk_end)
+    {
+        on_error(chunk, {}, "uncompressed chunk size does not match the seek table", severity::error);
+        return false;
+    }
+
+    return verify_checksum(chunk, expected_checksum, hasher.digest(), on_error);
+}
+
+/// decompresses the part of a chunk that overlaps [offset, offset + out_data.size()) into out_data
+bool uncompress_chunk_to(cc::span<std::byte> out_data,
+                         uint64_t offset,
+                         cc::span<std::byte const> chunk,
+                         uint64_t chunk_begin,
+                         uint64_t chunk_end,
+                         uint32_t const* expected_checksum,
+                         babel::error_handler on_error)
+{
+    using namespace babel;
+
+    auto const begin = cc::max(offset, chunk_begin);
+    auto const end = cc::min(offset + out_data.size(), chunk_end);
+    auto const target = out_data.subspan(begin - offset, end - begin);
+
+    // fully covered zstd chunks are decompressed in-place
+    if (begin == chunk_begin && end == chunk_end && compression::detect(chunk) == compression::codec::zstd)
+    {
+        if (!zstd::uncompress_to(target, chunk, on_error))
+            return false;
+        return !expected_checksum || verify_checksum(chunk, expected_checksum, hash::xxh64(target), on_error);
+    }
+
+    return uncompress_chunk(chunk, chunk_begin, chunk_end, expected_checksum, on_error,
+                            [&](uint64_t pos, cc::span<std::byte const> d)
+                            {
+                                auto const d_begin = cc::max(pos, begin);
+                                auto const d_end = cc::min(pos + d.size(), end);
+                                if (d_begin < d_end)
+                                    std::memcpy(target.data() + (d_begin - begin), d.data() + (d_begin - pos), d_end - d_begin);
+                            });
+}
+}
+
+cc::vector<std::byte> babel::compression::compress_seekable(cc::span<std::byte const> data, seekable_config const& cfg, error_handler on_error)
+{
+    cc::vector<std::byte> res;
+    auto append = [&](cc::span<std::byte const> d) { res.push_back_range(d); };
+    {
+        auto stream = seekable_compress_stream(append, cfg, on_error);
+        stream(data);
+        stream.finish();
+    }
+    return res;
+}
+
+babel::compression::seekable_compress_stream::seekable_compress_stream(cc::stream_ref<std::byte> output, seekable_config const& cfg, error_handler on_error)
+  : _output(output), _on_error(on_error), _config(cfg)
+{
+    CC_ASSERT((cfg.chunk_codec == codec::zstd || cfg.chunk_codec == codec::lz4) && "seekable containers support zstd and lz4 chunks");
+    CC_ASSERT(0 < cfg.chunk_size && cfg.chunk_size <= 0xFFFFFFFF && "chunk size must fit into 32 bit");
+
+    _batch_size = cfg.chunk_size * babel::detail::resolve_thread_count(cfg.thread_count, 0);
+}
+
+babel::compression::seekable_compress_stream::~seekable_compress_stream()
+{
+    if (!_is_finished)
+        finish();
+}
+
+void babel::compression::seekable_compress_stream::operator()(cc::span<std::byte const> data)
+{
+    CC_ASSERT(!_is_finished && "cannot push data after finish()");
+
+    while (!data.empty())
+    {
+        // full batches are compressed without copying them first
+        if (_buffer.empty() && data.size() >= _batch_size)
+        {
+            compress_chunks(data.subspan(0, _batch_size));
+            data = data.subspan(_batch_size);
+            continue;
+        }
+
+        auto const n = cc::min(_batch_size - _buffer.size(), data.size());
+        _buffer.push_back_range(data.subspan(0, n));
+        data = data.subspan(n);
+
+        if (_buffer.size() == _batch_size)
+        {
+            compress_chunks(_buffer);
+            _buffer.clear();
+        }
+    }
+}
+
+void babel::compression::seekable_compress_stream::finish()
+{
+    if (_is_finished)
+        return;
+
+    if (!_buffer.empty())
+    {
+        compress_chunks(_buffer);
+        _buffer = {};
+    }
+
+    auto const entry_size = _config.checksum ? 12 : 8;
+    auto const entry_count = _seek_table.size() * 4 / entry_size;
+    auto const frame_size = entry_count * entry_size + seek_table_footer_size;
+
+    auto table = cc::vector<std::byte>::uninitialized(8 + frame_size);
+    write_le32(table.data(), seek_table_magic);
+    write_le32(table.data() + 4, uint32_t(frame_size));
+    for (size_t i = 0; i < _seek_table.size(); ++i)
+        write_le32(table.data() + 8 + 4 * i, _seek_table[i]);
+
+    auto const footer = table.data() + 8 + entry_count * entry_size;
+    write_le32(footer, uint32_t(entry_count));
+    footer[4] = std::byte(_config.checksum ? seek_table_checksum_flag : 0);
+    write_le32(footer + 5, seekable_magic);
+
+    _output(table);
+    _is_finished = true;
+}
+
+void babel::compression::seekable_compress_stream::compress_chunks(cc::span<std::byte const> data)
+{
+    auto const chunk_size = _config.chunk_size;
+    auto const chunk_count = (data.size() + chunk_size - 1) / chunk_size;
+
+    _chunks.resize(chunk_count);
+    _checksums.resize(chunk_count);
+    babel::detail::parallel_for(chunk_count, _config.thread_count, _on_error,
+                                [&](size_t i, error_handler on_error)
+                                {
+                                    auto const chunk = data.subspan(i * chunk_size, cc::min(chunk_size, data.size() - i * chunk_size));
+                                    _chunks[i] = compress_chunk(chunk, _config, on_error);
+                                    if (_config.checksum)
+                                        _checksums[i] = chunk_checksum(hash::xxh64(chunk));
+                                });
+
+    for (size_t i = 0; i < chunk_count; ++i)
+    {
+        _output(_chunks[i]);
+        _seek_table.push_back(uint32_t(_chunks[i].size()));
+        _seek_table.push_back(uint32_t(cc::min(chunk_size, data.size() - i * chunk_size)));
+        if (_config.checksum)
+            _seek_table.push_back(_checksums[i]);
+    }
+}
+
+babel::compression::seekable_reader::seekable_reader(cc::span<std::byte const> data, error_handler on_error) : _data(data)
+{
+    if (data.size() < 8 + seek_table_footer_size)
+    {
+        on_error(data, {}, "data is too small for a seekable container", severity::error);
+        return;
+    }
+
+    auto const footer = data.data() + data.size() - seek_table_footer_size;
+    auto const entry_count = size_t(read_le32(footer));
+    auto const descriptor = uint8_t(footer[4]);
+    if (read_le32(footer + 5) != seekable_magic)
+    {
+        on_error(data, {}, "missing seek table (data is not a seekable container)", severity::error);
+        return;
+    }
+    if (descriptor & 0x7C)
+    {
+        on_error(data, {}, "invalid seek table descriptor", severity::error);
+        return;
+    }
+
+    auto const entry_size = size_t(descriptor & seek_table_checksum_flag ? 12 : 8);
+    auto const table_size = 8 + entry_count * entry_size + seek_table_footer_size;
+    if (table_size > data.size())
+    {
+        on_error(data, {}, "seek table is larger than the container", severity::error);
+        return;
+    }
+
+    auto const table = data.data() + data.size() - table_size;
+    if (read_le32(table) != seek_table_magic || read_le32(table + 4) != table_size - 8)
+    {
+        on_error(data, {}, "invalid seek table frame", severity::error);
+        return;
+    }
+
+    auto const has_checksums = bool(descriptor & seek_table_checksum_flag);
+    auto compressed_offsets = cc::vector<uint64_t>::uninitialized(entry_count + 1);
+    auto uncompressed_offsets = cc::vector<uint64_t>::uninitialized(entry_count + 1);
+    auto checksums = cc::vector<uint32_t>::uninitialized(has_checksums ? entry_count : 0);
+    compressed_offsets[0] = 0;
+    uncompressed_offsets[0] = 0;
+    for (size_t i = 0; i < entry_count; ++i)
+    {
+        auto const entry = table + 8 + i * entry_size;
+        compressed_offsets[i + 1] = compressed_offsets[i] + read_le32(entry);
+        uncompressed_offsets[i + 1] = uncompressed_offsets[i] + read_le32(entry + 4);
+        if (has_checksums)
+            checksums[i] = read_le32(entry + 8);
+    }
+
+    if (compressed_offsets.back() != data.size() - table_size)
+    {
+        on_error(data, {}, "seek table does not match the size of the compressed chunks", severity::error);
+        return;
+    }
+
+    _compressed_offsets = cc::move(compressed_offsets);
+    _uncompressed_offsets = cc::move(uncompressed_offsets);
+    _checksums = cc::move(checksums);
+}
+
+bool babel::compression::seekable_reader::read_to(cc::span<std::byte> out_data, uint64_t offset, int thread_count, error_handler on_error) const
+{
+    if (offset > size() || out_data.size() > size() - offset)
+    {
+        on_error(_data, {}, "requested range is out of bounds of the seekable container", severity::error);
+        return false;
+    }
+
+    if (out_data.empty())
+        return true;
+
+    // chunks overlapping [offset, offset + size)
+    auto chunk_of = [&](uint64_t pos)
+    {
+        size_t lo = 0;
+        size_t hi = chunk_count();
+        while (hi - lo > 1)
+        {
+            auto const mid = (lo + hi) / 2;
+            if (_uncompressed_offsets[mid] <= pos)
+                lo = mid;
+            else
+                hi = mid;
+        }
+        return lo;
+    };
+    auto const first_chunk = chunk_of(offset);
+    auto const last_chunk = chunk_of(offset + out_data.size() - 1);
+
+    std::atomic<bool> success = true;
+    babel::detail::parallel_for(last_chunk - first_chunk + 1, thread_count, on_error,
+                                [&](size_t i, error_handler on_error)
+                                {
+                                    auto const c = first_chunk + i;
+                                    auto const chunk = _data.subspan(_compressed_offsets[c], _compressed_offsets[c + 1] - _compressed_offsets[c]);
+                                    auto const checksum = _checksums.empty() ? nullptr : &_checksums[c];
+                                    if (!uncompress_chunk_to(out_data, offset, chunk, _uncompressed_offsets[c], _uncompressed_offsets[c + 1], checksum,
+                                                             on_error))
+                                        success = false;
+                                });
+
+    return success;
+}
+
+cc::vector<std::byte> babel::compression::seekable_reader::read(uint64_t offset, size_t size, int thread_count, error_handler on_error) const
+{
+    auto res = cc::vector<std::byte>::uninitialized(size);
+    if (!read_to(res, offset, thread_count, on_error))
+        return {};
+    return res;
+}
+
+bool babel::compression::seekable_reader::stream_to(cc::stream_ref<std::byte> output, uint64_t offset, uint64_t size, error_handler on_error) const
+{
+    if (offset > this->size() || size > this->size() - offset)
+    {
+        on_error(_data, {}, "requested range is out of bounds of the seekable container", severity::error);
+        return false;
+    }
+
+    auto const end = offset + size;
+    for (size_t c = 0; c < chunk_count() && _uncompressed_offsets[c] < end; ++c)
+    {
+        if (_uncompressed_offsets[c + 1] <= offset)
+            continue;
+
+        auto forward_overlap = [&](uint64_t pos, cc::span<std::byte const> d)
+        {
+            auto const d_begin = cc::max(pos, offset);
+            auto const d_end = cc::min(pos + d.size(), end);
+            if (d_begin < d_end)
+                output(d.subspan(d_begin - pos, d_end - d_begin));
+        };
+
+        auto const chunk = _data.subspan(_compressed_offsets[c], _compressed_offsets[c + 1] - _compressed_offsets[c]);
+        auto const checksum = _checksums.empty() ? nullptr : &_checksums[c];
+        if (!uncompress_chunk(chunk, _uncompressed_offsets[c], _uncompressed_offsets[c + 1], checksum, on_error, forward_overlap))
+            return false;
+    }
+
+    return true;
+}
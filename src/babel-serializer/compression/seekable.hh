@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <clean-core/span.hh>
+#include <clean-core/stream_ref.hh>
+#include <clean-core/vector.hh>
+
+#include <babel-serializer/compression/codec.hh>
+#include <babel-serializer/errors.hh>
+
+// a seekable container for compressed data
+//
+// the input is split into fixed-size chunks that are compressed independently (zstd or lz4 frames)
+// a seek table is appended (in a skippable frame) that allows decompressing only the chunks overlapping a requested range
+// the layout follows the zstd seekable format (see zstd/contrib/seekable_format), thus:
+//   - zstd containers can be read by other implementations of the seekable format
+//   - the whole container is still valid zstd/lz4 data (e.g. for compression::uncompress or the command line tools)
+//
+// usage:
+//
+//   auto packed = babel::compression::compress_seekable(data);
+//   ...
+//   auto reader = babel::compression::seekable_reader(packed);
+//   auto part = reader.read(offset, size); // only decompresses the required chunks
+
+namespace babel::compression
+{
+struct seekable_config
+{
+    /// codec of the chunks (must be zstd or lz4)
+    codec chunk_codec = codec::zstd;
+
+    /// uncompressed size of each chunk (the last chunk might be smaller)
+    /// smaller chunks allow more fine-grained access but compress worse
+    size_t chunk_size = 1 << 20;
+
+    /// zstd compression level (0 means "use default")
+    int compression_level = 0;
+
+    /// number of threads used for compressing chunks (0 means "use all hardware threads")
+    int thread_count = 0;
+
+    /// stores a checksum of each uncompressed chunk in the seek table (verified by seekable_reader)
+    bool checksum = false;
+};
+
+/// compresses data into the seekable container format
+cc::vector<std::byte> compress_seekable(cc::span<std::byte const> data, seekable_config const& cfg = {}, error_handler on_error = default_error_handler);
+
+/// a streaming compressor for the seekable container format
+/// uncompressed data is pushed via operator() (thus it can be used as a cc::stream_ref<std::byte>)
+/// and compressed chunks are written to the output stream (the seek table is written by finish())
+///
+/// NOTE: the output stream and on_error must outlive this object
+/// NOTE: buffers up to thread_count chunks so that they can be compressed in parallel
+/// NOTE: the dtor calls finish() if it was not called before
+struct seekable_compress_stream
+{
+    explicit seekable_compress_stream(cc::stream_ref<std::byte> output, seekable_config const& cfg = {}, error_handler on_error = default_error_handler);
+    ~seekable_compress_stream();
+
+    // no copy or move (stream_refs point to this object)
+    seekable_compress_stream(seekable_compress_stream const&) = delete;
+    seekable_compress_stream& operator=(seekable_compress_stream const&) = delete;
+
+    /// compresses the given data (output is only written once enough chunks are buffered)
+    void operator()(cc::span<std::byte const> data);
+
+    /// compresses all remaining data and writes the seek table
+    /// NOTE: no data can be pushed afterwards
+    void finish();
+
+private:
+    void compress_chunks(cc::span<std::byte const> data);
+
+    cc::stream_ref<std::byte> _output;
+    error_handler _on_error;
+    seekable_config _config;
+    cc::vector<std::byte> _buffer;               // uncompressed data of the next chunks
+    cc::vector<cc::vector<std::byte>> _chunks;   // compressed chunks of the current batch
+    cc::vector<uint32_t> _checksums;             // checksums of the current batch
+    cc::vector<uint32_t> _seek_table;            // compressed size, uncompressed size (and checksum) per chunk
+    size_t _batch_size = 0;
+    bool _is_finished = false;
+};
+
+/// random access to data in the seekable container format
+/// NOTE: references the compressed data, which must outlive this object
+struct seekable_reader
+{
+    /// parses the seek table of the given data
+    /// reports an error (and results in an empty reader) if data is not a seekable container
+    explicit seekable_reader(cc::span<std::byte const> data, error_handler on_error = default_error_handler);
+
+    /// total uncompressed size
+    uint64_t size() const { return _uncompressed_offsets.back(); }
+
+    size_t chunk_count() const { return _uncompressed_offsets.size() - 1; }
+
+    /// decompresses the range [offset, offset + out_data.size()) into out_data
+    /// only chunks overlapping the range are decompressed, using up to thread_count threads (0 means "use all hardware threads")
+    /// returns false on error (e.g. if the range is out of bounds)
+    /// NOTE: on_error might be called from different threads (calls are serialized)
+    bool read_to(cc::span<std::byte> out_data, uint64_t offset, int thread_count = 0, error_handler on_error = default_error_handler) const;
+
+    /// same as read_to but allocates the result
+    cc::vector<std::byte> read(uint64_t offset, size_t size, int thread_count = 0, error_handler on_error = default_error_handler) const;
+
+    /// decompresses the range [offset, offset + size) chunk by chunk and writes it to the output stream
+    /// returns false on error (e.g. if the range is out of bounds)
+    bool stream_to(cc::stream_ref<std::byte> output, uint64_t offset, uint64_t size, error_handler on_error = default_error_handler) const;
+
+private:
+    cc::span<std::byte const> _data;
+    cc::vector<uint64_t> _compressed_offsets = {0};   // chunk_count + 1 entries
+    cc::vector<uint64_t> _uncompressed_offsets = {0}; // chunk_count + 1 entries
+    cc::vector<uint32_t> _checksums;                  // empty or chunk_count entries
+};
+}
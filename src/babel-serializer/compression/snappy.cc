@@ -1,7 +1,66 @@
 #include "snappy.hh"
 
+#include <cstring>
+
+#include <clean-core/utility.hh>
+
 #include <snappy/snappy.h>
 
+namespace
+{
+// see https://github.com/google/snappy/blob/main/framing_format.txt
+constexpr size_t max_chunk_size = 65536;
+constexpr uint8_t chunk_compressed = 0x00;
+constexpr uint8_t chunk_uncompressed = 0x01;
+constexpr uint8_t chunk_stream_identifier = 0xFF;
+constexpr char stream_identifier[] = {'\xFF', 0x06, 0x00, 0x00, 's', 'N', 'a', 'P', 'p', 'Y'};
+
+uint32_t read_le32(std::byte const* p)
+{
+    return uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16 | uint32_t(p[3]) << 24;
+}
+
+void write_le32(std::byte* p, uint32_t v)
+{
+    for (auto i = 0; i < 4; ++i)
+        p[i] = std::byte(v >> (8 * i));
+}
+
+// tables for slicing-by-8 (processes 8 bytes per iteration)
+struct crc32c_tables
+{
+    uint32_t table[8][256];
+
+    crc32c_tables()
+    {
+        for (uint32_t i = 0; i < 256; ++i)
+        {
+            auto c = i;
+            for (auto k = 0; k < 8; ++k)
+                c = (c >> 1) ^ (0x82F63B78 & (0u - (c & 1))); // reversed Castagnoli polynomial
+            table[0][i] = c;
+        }
+        for (auto i = 0; i < 256; ++i)
+            for (auto k = 1; k < 8; ++k)
+                table[k][i] = (table[k - 1][i] >> 8) ^ table[0][table[k - 1][i] & 0xFF];
+    }
+};
+
+crc32c_tables const& get_crc32c_tables()
+{
+    static crc32c_tables const tables;
+    return tables;
+}
+
+uint32_t masked_crc32c(cc::span<std::byte const> data)
+{
+    auto const crc = babel::snappy::crc32c(data);
+    return ((crc >> 15) | (crc << 17)) + 0xA282EAD8;
+}
+}
+
+size_t babel::snappy::compress_bound(size_t size) { return ::snappy::MaxCompressedLength(size); }
+
 cc::vector<std::byte> babel::snappy::compress(cc::span<std::byte const> data)
 {
     cc::vector<std::byte> res;
@@ -12,6 +71,59 @@ cc::vector<std::byte> babel::snappy::compress(cc::span<std::byte const> data)
     return res;
 }
 
+size_t babel::snappy::compress_to(cc::span<std::byte> out_data, cc::span<std::byte const> data, error_handler on_error)
+{
+    // RawCompress does not check the output size
+    if (out_data.size() < ::snappy::MaxCompressedLength(data.size()))
+    {
+        on_error(data, {}, "snappy compress_to requires an output buffer of at least compress_bound(data.size()) bytes", severity::error);
+        return 0;
+    }
+
+    size_t real_size = 0;
+    ::snappy::RawCompress(reinterpret_cast<char const*>(data.data()), data.size(), reinterpret_cast<char*>(out_data.data()), &real_size);
+    return real_size;
+}
+
+bool babel::snappy::is_valid_compressed(cc::span<std::byte const> data)
+{
+    return ::snappy::IsValidCompressedBuffer(reinterpret_cast<char const*>(data.data()), data.size());
+}
+
+size_t babel::snappy::uncompressed_size(cc::span<std::byte const> data, error_handler on_error)
+{
+    size_t res_size = 0;
+    if (!::snappy::GetUncompressedLength(reinterpret_cast<char const*>(data.data()), data.size(), &res_size))
+    {
+        on_error(data, {}, "unable to get length of uncompressed data (internal snappy error)", severity::error);
+        return 0;
+    }
+    return res_size;
+}
+
+bool babel::snappy::uncompress_to(cc::span<std::byte> out_data, cc::span<std::byte const> data, error_handler on_error)
+{
+    size_t res_size = 0;
+    if (!::snappy::GetUncompressedLength(reinterpret_cast<char const*>(data.data()), data.size(), &res_size))
+    {
+        on_error(data, {}, "unable to get length of uncompressed data (internal snappy error)", severity::error);
+        return false;
+    }
+    if (res_size != out_data.size())
+    {
+        on_error(data, {}, "snappy uncompress_to requires the exact decompressed size", severity::error);
+        return false;
+    }
+
+    if (!::snappy::RawUncompress(reinterpret_cast<char const*>(data.data()), data.size(), reinterpret_cast<char*>(out_data.data())))
+    {
+        on_error(data, {}, "could not decompress data (internal snappy error)", severity::error);
+        return false;
+    }
+
+    return true;
+}
+
 cc::vector<std::byte> babel::snappy::uncompress(cc::span<std::byte const> data, babel::error_handler on_error)
 {
     size_t res_size = 0;
@@ -31,3 +143,286 @@ cc::vector<std::byte> babel::snappy::uncompress(cc::span<std::byte const> data,
 
     return res;
 }
+
+cc::alloc_array<std::byte> babel::snappy::uncompress(cc::span<std::byte const> data, cc::allocator* alloc, error_handler on_error)
+{
+    size_t res_size = 0;
+    if (!::snappy::GetUncompressedLength(reinterpret_cast<char const*>(data.data()), data.size(), &res_size))
+    {
+        on_error(data, {}, "unable to get length of uncompressed data (internal snappy error)", severity::error);
+        return {};
+    }
+
+    auto res = cc::alloc_array<std::byte>::uninitialized(res_size, alloc);
+    if (!uncompress_to(res, data, on_error))
+        return {};
+    return res;
+}
+
+uint32_t babel::snappy::crc32c(cc::span<std::byte const> data, uint32_t crc)
+{
+    auto const& t = get_crc32c_tables().table;
+
+    auto p = data.data();
+    auto n = data.size();
+    crc = ~crc;
+
+    while (n >= 8)
+    {
+        auto const lo = read_le32(p) ^ crc;
+        auto const hi = read_le32(p + 4);
+        crc = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF] ^ t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24] //
+              ^ t[3][hi & 0xFF] ^ t[2][(hi >> 8) & 0xFF] ^ t[1][(hi >> 16) & 0xFF] ^ t[0][hi >> 24];
+        p += 8;
+        n -= 8;
+    }
+    while (n > 0)
+    {
+        crc = (crc >> 8) ^ t[0][(crc ^ uint32_t(*p)) & 0xFF];
+        ++p;
+        --n;
+    }
+
+    return ~crc;
+}
+
+cc::vector<std::byte> babel::snappy::compress_framed(cc::span<std::byte const> data)
+{
+    cc::vector<std::byte> res;
+    res.reserve(sizeof(stream_identifier) + ::snappy::MaxCompressedLength(data.size()) + (data.size() / max_chunk_size + 1) * 8);
+    auto append = [&](cc::span<std::byte const> d) { res.push_back_range(d); };
+    {
+        auto stream = compress_stream(append);
+        stream(data);
+        stream.finish();
+    }
+    return res;
+}
+
+cc::vector<std::byte> babel::snappy::uncompress_framed(cc::span<std::byte const> data, error_handler on_error)
+{
+    cc::vector<std::byte> res;
+    auto append = [&](cc::span<std::byte const> d) { res.push_back_range(d); };
+    auto stream = decompress_stream(append, on_error);
+    stream(data);
+    if (!stream.finish())
+        return {};
+
+    return res;
+}
+
+babel::snappy::compress_stream::compress_stream(cc::stream_ref<std::byte> output) : _output(output)
+{
+    _chunk = cc::array<std::byte>::uninitialized(max_chunk_size);
+    _compressed = cc::array<std::byte>::uninitialized(8 + ::snappy::MaxCompressedLength(max_chunk_size));
+}
+
+babel::snappy::compress_stream::~compress_stream()
+{
+    if (_chunk_fill > 0 || !_has_stream_identifier)
+        finish();
+}
+
+void babel::snappy::compress_stream::operator()(cc::span<std::byte const> data)
+{
+    while (!data.empty())
+    {
+        // full chunks are compressed without copying them first
+        if (_chunk_fill == 0 && data.size() >= _chunk.size())
+        {
+            write_chunk(data.subspan(0, _chunk.size()));
+            data = data.subspan(_chunk.size());
+            continue;
+        }
+
+        auto const n = cc::min(_chunk.size() - _chunk_fill, data.size());
+        std::memcpy(_chunk.data() + _chunk_fill, data.data(), n);
+        _chunk_fill += n;
+        data = data.subspan(n);
+
+        if (_chunk_fill == _chunk.size())
+        {
+            write_chunk(_chunk);
+            _chunk_fill = 0;
+        }
+    }
+}
+
+void babel::snappy::compress_stream::flush()
+{
+    // an empty stream still consists of the stream identifier
+    if (!_has_stream_identifier)
+    {
+        _output(cc::as_byte_span(stream_identifier));
+        _has_stream_identifier = true;
+    }
+
+    if (_chunk_fill == 0)
+        return;
+
+    write_chunk(cc::span<std::byte const>(_chunk.data(), _chunk_fill));
+    _chunk_fill = 0;
+}
+
+void babel::snappy::compress_stream::write_chunk(cc::span<std::byte const> data)
+{
+    if (!_has_stream_identifier)
+    {
+        _output(cc::as_byte_span(stream_identifier));
+        _has_stream_identifier = true;
+    }
+
+    auto const payload = _compressed.data() + 8;
+    size_t size = 0;
+    ::snappy::RawCompress(reinterpret_cast<char const*>(data.data()), data.size(), reinterpret_cast<char*>(payload), &size);
+
+    auto type = chunk_compressed;
+    if (size >= data.size() - data.size() / 8) // not worth decompressing, stored as-is
+    {
+        std::memcpy(payload, data.data(), data.size());
+        size = data.size();
+        type = chunk_uncompressed;
+    }
+
+    // chunk header: type (1 byte) + size of checksum and payload (3 bytes)
+    write_le32(_compressed.data(), uint32_t(type) | uint32_t(size + 4) << 8);
+    write_le32(_compressed.data() + 4, masked_crc32c(data));
+
+    _output(cc::span<std::byte const>(_compressed.data(), 8 + size));
+}
+
+babel::snappy::decompress_stream::decompress_stream(cc::stream_ref<std::byte> output, error_handler on_error) : _output(output), _on_error(on_error)
+{
+    _chunk = cc::array<std::byte>::uninitialized(max_chunk_size);
+}
+
+void babel::snappy::decompress_stream::operator()(cc::span<std::byte const> data)
+{
+    while (!data.empty() && !_has_error)
+    {
+        // skippable chunks are not buffered
+        if (_skip_size > 0)
+        {
+            auto const n = cc::min(_skip_size, data.size());
+            data = data.subspan(n);
+            _skip_size -= n;
+            continue;
+        }
+
+        // complete input is processed in-place, partial input is buffered until enough data is available
+        if (_pending.empty() && data.size() >= _needed)
+        {
+            auto const n = _needed;
+            process(data.subspan(0, n));
+            data = data.subspan(n);
+        }
+        else
+        {
+            auto const n = cc::min(_needed - _pending.size(), data.size());
+            _pending.push_back_range(data.subspan(0, n));
+            data = data.subspan(n);
+
+            if (_pending.size() == _needed)
+            {
+                process(_pending);
+                _pending.clear();
+            }
+        }
+    }
+}
+
+bool babel::snappy::decompress_stream::finish()
+{
+    if (_has_error)
+        return false;
+
+    if (_is_in_chunk || _skip_size > 0 || !_pending.empty())
+    {
+        _on_error({}, {}, "compressed data ended in the middle of a chunk (truncated data?)", severity::error);
+        return false;
+    }
+
+    return true;
+}
+
+void babel::snappy::decompress_stream::process(cc::span<std::byte const> data)
+{
+    if (_is_in_chunk)
+    {
+        decode_chunk(data);
+        _is_in_chunk = false;
+        _needed = 4;
+        return;
+    }
+
+    auto const header = read_le32(data.data());
+    _chunk_type = uint8_t(header & 0xFF);
+    auto const size = size_t(header >> 8);
+
+    if (_chunk_type != chunk_stream_identifier && !_has_stream_identifier)
+        return report(data, "snappy framing format must start with a stream identifier");
+
+    switch (_chunk_type)
+    {
+    case chunk_stream_identifier:
+        if (size != sizeof(stream_identifier) - 4)
+            return report(data, "invalid snappy stream identifier");
+        break;
+    case chunk_compressed:
+        if (size < 4 || size > 4 + ::snappy::MaxCompressedLength(max_chunk_size))
+            return report(data, "invalid size of compressed snappy chunk");
+        break;
+    case chunk_uncompressed:
+        if (size < 4 || size > 4 + max_chunk_size)
+            return report(data, "invalid size of uncompressed snappy chunk");
+        break;
+    default:
+        if (_chunk_type < 0x80)
+            return report(data, "unskippable reserved chunk in snappy framing format");
+
+        // padding (0xFE) and reserved skippable chunks (0x80 - 0xFD)
+        _skip_size = size;
+        return;
+    }
+
+    _is_in_chunk = true;
+    _needed = size;
+}
+
+void babel::snappy::decompress_stream::decode_chunk(cc::span<std::byte const> data)
+{
+    if (_chunk_type == chunk_stream_identifier)
+    {
+        if (std::memcmp(data.data(), stream_identifier + 4, data.size()) != 0)
+            return report(data, "invalid snappy stream identifier");
+        _has_stream_identifier = true;
+        return;
+    }
+
+    auto const checksum = read_le32(data.data());
+    auto const payload = data.subspan(4);
+
+    auto content = payload;
+    if (_chunk_type == chunk_compressed)
+    {
+        size_t size = 0;
+        if (!::snappy::GetUncompressedLength(reinterpret_cast<char const*>(payload.data()), payload.size(), &size) || size > max_chunk_size)
+            return report(data, "invalid uncompressed size of snappy chunk");
+
+        if (!::snappy::RawUncompress(reinterpret_cast<char const*>(payload.data()), payload.size(), reinterpret_cast<char*>(_chunk.data())))
+            return report(data, "could not decompress snappy chunk (internal snappy error)");
+
+        content = cc::span<std::byte const>(_chunk.data(), size);
+    }
+
+    if (masked_crc32c(content) != checksum)
+        return report(data, "snappy chunk checksum mismatch (corrupted data?)");
+
+    _output(content);
+}
+
+void babel::snappy::decompress_stream::report(cc::span<std::byte const> data, cc::string_view message)
+{
+    _on_error(data, {}, message, severity::error);
+    _has_error = true;
+}
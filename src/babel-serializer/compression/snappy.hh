@@ -1,8 +1,12 @@
 #pragma once
 
 #include <cstddef>
+#include <cstdint>
 
+#include <clean-core/alloc_array.hh>
+#include <clean-core/array.hh>
 #include <clean-core/span.hh>
+#include <clean-core/stream_ref.hh>
 #include <clean-core/vector.hh>
 
 #include <babel-serializer/errors.hh>
@@ -11,11 +15,135 @@
 
 namespace babel::snappy
 {
+/// returns the maximum compressed size of data with the given size (in bytes)
+size_t compress_bound(size_t size);
+
 /// compresses a range of bytes using google's snappy
 /// NOTE: the result has more capacity than data
 ///       if it is stored long-term, a shrink_to_fit is advised
 cc::vector<std::byte> compress(cc::span<std::byte const> data);
 
+/// compresses into a caller-provided buffer without allocating the result
+/// returns the compressed size or 0 on error
+/// NOTE: snappy requires out_data.size() >= compress_bound(data.size())
+size_t compress_to(cc::span<std::byte> out_data, cc::span<std::byte const> data, error_handler on_error = default_error_handler);
+
 /// Tries to uncompress the given data
 cc::vector<std::byte> uncompress(cc::span<std::byte const> data, error_handler on_error = default_error_handler);
+/// same as uncompress but the result is allocated with the given allocator
+cc::alloc_array<std::byte> uncompress(cc::span<std::byte const> data, cc::allocator* alloc, error_handler on_error = default_error_handler);
+
+/// cheaply checks if the given data can be uncompressed (without actually uncompressing it)
+bool is_valid_compressed(cc::span<std::byte const> data);
+
+/// returns the uncompressed size stored in the compressed data
+size_t uncompressed_size(cc::span<std::byte const> data, error_handler on_error = default_error_handler);
+
+/// Tries to uncompress the given data into a caller-provided buffer
+/// NOTE: out_data must have exactly the uncompressed size (see uncompressed_size)
+bool uncompress_to(cc::span<std::byte> out_data, cc::span<std::byte const> data, error_handler on_error = default_error_handler);
+
+// =========================================
+// framing format
+//
+// the snappy framing format splits data into chunks of at most 64 KB with a CRC32C of each chunk
+// it is used for streaming (e.g. by Hadoop or Kafka producers)
+// see https://github.com/google/snappy/blob/main/framing_format.txt
+
+/// compresses a range of bytes into the snappy framing format
+cc::vector<std::byte> compress_framed(cc::span<std::byte const> data);
+
+/// Tries to uncompress the given data in the snappy framing format
+/// NOTE: supports concatenated streams and skips padding and reserved skippable chunks
+cc::vector<std::byte> uncompress_framed(cc::span<std::byte const> data, error_handler on_error = default_error_handler);
+
+/// computes the CRC32C (Castagnoli) checksum of the given data
+/// NOTE: the framing format stores this checksum in masked form
+uint32_t crc32c(cc::span<std::byte const> data, uint32_t crc = 0);
+
+/// a streaming snappy compressor (framing format) with bounded memory
+/// uncompressed data is pushed via operator() (thus it can be used as a cc::stream_ref<std::byte>)
+/// and compressed data is written to the output stream chunk by chunk
+///
+/// usage:
+///
+///   auto file = babel::file::file_output_stream("data.sz");
+///   auto compressor = babel::snappy::compress_stream(file);
+///   babel::file::read(compressor, "data.raw"); // or compressor(some_data);
+///   compressor.finish();
+///
+/// NOTE: the output stream must outlive this object
+/// NOTE: the dtor calls finish() if there is unwritten data
+struct compress_stream
+{
+    explicit compress_stream(cc::stream_ref<std::byte> output);
+    ~compress_stream();
+
+    // no copy or move (stream_refs point to this object)
+    compress_stream(compress_stream const&) = delete;
+    compress_stream& operator=(compress_stream const&) = delete;
+
+    /// compresses the given data (output is only written once a chunk is full)
+    void operator()(cc::span<std::byte const> data);
+
+    /// writes all buffered data to the output as a (smaller) chunk
+    /// NOTE: the framing format has no end marker, so this is equivalent to finish()
+    void flush();
+    void finish() { flush(); }
+
+private:
+    void write_chunk(cc::span<std::byte const> data);
+
+    cc::stream_ref<std::byte> _output;
+    cc::array<std::byte> _chunk;      // uncompressed data of the current chunk
+    cc::array<std::byte> _compressed; // chunk header + checksum + compressed chunk
+    size_t _chunk_fill = 0;
+    bool _has_stream_identifier = false;
+};
+
+/// a streaming snappy decompressor (framing format) with bounded memory
+/// compressed data is pushed via operator() (thus it can be used as a cc::stream_ref<std::byte>)
+/// and uncompressed data is written to the output stream chunk by chunk
+///
+/// usage:
+///
+///   auto file = babel::file::file_output_stream("data.raw");
+///   auto decompressor = babel::snappy::decompress_stream(file);
+///   babel::file::read(decompressor, "data.sz");
+///   if (!decompressor.finish())
+///       ... // error or truncated data
+///
+/// NOTE: the output stream and on_error must outlive this object
+struct decompress_stream
+{
+    explicit decompress_stream(cc::stream_ref<std::byte> output, error_handler on_error = default_error_handler);
+
+    // no copy or move (stream_refs point to this object)
+    decompress_stream(decompress_stream const&) = delete;
+    decompress_stream& operator=(decompress_stream const&) = delete;
+
+    /// decompresses the given data (chunks may be split arbitrarily between calls)
+    void operator()(cc::span<std::byte const> data);
+
+    /// must be called after all data was pushed
+    /// reports an error if the data ended in the middle of a chunk
+    /// returns true if all data was decompressed successfully
+    bool finish();
+
+private:
+    void process(cc::span<std::byte const> data);
+    void decode_chunk(cc::span<std::byte const> data);
+    void report(cc::span<std::byte const> data, cc::string_view message);
+
+    cc::stream_ref<std::byte> _output;
+    error_handler _on_error;
+    cc::vector<std::byte> _pending; // incomplete input of the current chunk (or chunk header)
+    cc::array<std::byte> _chunk;    // uncompressed data of the current chunk
+    size_t _needed = 4;
+    size_t _skip_size = 0;
+    uint8_t _chunk_type = 0;
+    bool _is_in_chunk = false; // false: next input is a chunk header
+    bool _has_stream_identifier = false;
+    bool _has_error = false;
+};
 }
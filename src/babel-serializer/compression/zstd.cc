@@ -2,36 +2,141 @@
 
 #include <clean-core/format.hh>
 #include <clean-core/to_string.hh>
+#include <clean-core/utility.hh>
 
+#define ZSTD_STATIC_LINKING_ONLY // for ZSTD_findDecompressedSize
 #include <zstd/zstd.h>
 
-cc::vector<std::byte> babel::zstd::compress(cc::span<std::byte const> data, int compression_level)
+namespace
+{
+void apply_config(ZSTD_CCtx* ctx, babel::zstd::compress_config const& cfg, babel::error_handler on_error)
+{
+    using namespace babel;
+
+    auto set = [&](ZSTD_cParameter param, int value, char const* name)
+    {
+        auto const r = ZSTD_CCtx_setParameter(ctx, param, value);
+        if (ZSTD_isError(r))
+            on_error({}, {}, cc::format("unable to set zstd parameter {} to {} (internal zstd error: {})", name, value, ZSTD_getErrorName(r)),
+                     severity::warning);
+    };
+
+    set(ZSTD_c_compressionLevel, cfg.level, "compression level");
+
+    if (cfg.window_log != 0)
+        set(ZSTD_c_windowLog, cfg.window_log, "window log");
+
+    if (cfg.long_distance_matching)
+        set(ZSTD_c_enableLongDistanceMatching, 1, "long distance matching");
+
+    if (cfg.checksum)
+        set(ZSTD_c_checksumFlag, 1, "checksum flag");
+
+    if (cfg.worker_count > 0)
+    {
+        set(ZSTD_c_nbWorkers, cfg.worker_count, "worker count");
+
+        if (cfg.job_size != 0)
+            set(ZSTD_c_jobSize, cfg.job_size, "job size");
+
+        if (cfg.overlap_log != 0)
+            set(ZSTD_c_overlapLog, cfg.overlap_log, "overlap log");
+    }
+}
+
+size_t compress_to_with(ZSTD_CCtx* ctx, cc::span<std::byte> out_data, cc::span<std::byte const> data, babel::error_handler on_error)
+{
+    using namespace babel;
+
+    auto real_size = ZSTD_compress2(ctx, out_data.data(), out_data.size(), data.data(), data.size());
+
+    if (ZSTD_isError(real_size))
+    {
+        on_error(data, {}, cc::format("could not compress data (internal zstd error: {})", ZSTD_getErrorName(real_size)), severity::error);
+        return 0;
+    }
+
+    return real_size;
+}
+
+cc::vector<std::byte> compress_with(ZSTD_CCtx* ctx, cc::span<std::byte const> data, babel::error_handler on_error)
 {
     cc::vector<std::byte> res;
     res.resize(ZSTD_compressBound(data.size()));
-    auto real_size = ZSTD_compress(res.data(), res.size(), data.data(), data.size(), compression_level);
-    res.resize(real_size); // preserves actual content
+    res.resize(compress_to_with(ctx, res, data, on_error)); // preserves actual content
     return res;
 }
 
-cc::vector<std::byte> babel::zstd::uncompress(cc::span<std::byte const> data, babel::error_handler on_error)
+// decompresses frames with unknown content size by growing the result
+cc::vector<std::byte> uncompress_streaming_with(ZSTD_DCtx* ctx, cc::span<std::byte const> data, babel::error_handler on_error)
 {
-    auto res_size = ZSTD_getFrameContentSize(data.data(), data.size());
+    using namespace babel;
 
-    if (res_size == ZSTD_CONTENTSIZE_UNKNOWN)
+    ZSTD_DCtx_reset(ctx, ZSTD_reset_session_only);
+
+    auto res = cc::vector<std::byte>::uninitialized(cc::max(2 * data.size(), ZSTD_DStreamOutSize()));
+
+    ZSTD_inBuffer in = {data.data(), data.size(), 0};
+    ZSTD_outBuffer out = {res.data(), res.size(), 0};
+    auto is_in_frame = false;
+    while (true)
     {
-        on_error(data, {}, "cannot determine length of uncompressed data (internal zstd error)", severity::error);
+        if (out.pos == out.size)
+        {
+            res.resize(2 * res.size());
+            out.dst = res.data();
+            out.size = res.size();
+        }
+
+        auto const prev_in_pos = in.pos;
+        auto const prev_out_pos = out.pos;
+        auto const r = ZSTD_decompressStream(ctx, &out, &in);
+        if (ZSTD_isError(r))
+        {
+            on_error(data, {}, cc::format("could not decompress data (internal zstd error: {})", ZSTD_getErrorName(r)), severity::error);
+            return {};
+        }
+
+        // see decompress_stream::operator()
+        if (r == 0)
+            is_in_frame = false;
+        else if (in.pos != prev_in_pos || out.pos != prev_out_pos)
+            is_in_frame = true;
+
+        if (in.pos == in.size && out.pos < out.size)
+            break;
+    }
+
+    if (is_in_frame)
+    {
+        on_error(data, {}, "compressed data ended in the middle of a frame (truncated data?)", severity::error);
         return {};
     }
+
+    res.resize(out.pos);
+    return res;
+}
+
+cc::vector<std::byte> uncompress_with(ZSTD_DCtx* ctx, cc::span<std::byte const> data, babel::error_handler on_error)
+{
+    using namespace babel;
+
+    // NOTE: sums up the content size of all frames
+    auto res_size = ZSTD_findDecompressedSize(data.data(), data.size());
+
     if (res_size == ZSTD_CONTENTSIZE_ERROR)
     {
         on_error(data, {}, "unable to get length of uncompressed data (internal zstd error)", severity::error);
         return {};
     }
 
+    // at least one frame does not know its size
+    if (res_size == ZSTD_CONTENTSIZE_UNKNOWN)
+        return uncompress_streaming_with(ctx, data, on_error);
+
     auto res = cc::vector<std::byte>::uninitialized(res_size);
 
-    auto real_size = ZSTD_decompress(res.data(), res.size(), data.data(), data.size());
+    auto real_size = ZSTD_decompressDCtx(ctx, res.data(), res.size(), data.data(), data.size());
 
     if (ZSTD_isError(real_size))
     {
@@ -43,3 +148,334 @@ cc::vector<std::byte> babel::zstd::uncompress(cc::span<std::byte const> data, ba
 
     return res;
 }
+
+bool uncompress_to_with(ZSTD_DCtx* ctx, cc::span<std::byte> out_data, cc::span<std::byte const> data, babel::error_handler on_error)
+{
+    using namespace babel;
+
+    auto real_size = ZSTD_decompressDCtx(ctx, out_data.data(), out_data.size(), data.data(), data.size());
+
+    if (ZSTD_isError(real_size))
+    {
+        on_error(data, {}, cc::format("could not decompress data (internal zstd error: {})", ZSTD_getErrorName(real_size)), severity::error);
+        return false;
+    }
+    if (real_size != out_data.size())
+    {
+        on_error(data, {}, "zstd uncompress_to requires the exact decompressed size", severity::error);
+        return false;
+    }
+
+    return true;
+}
+}
+
+size_t babel::zstd::compress_bound(size_t size) { return ZSTD_compressBound(size); }
+
+cc::vector<std::byte> babel::zstd::compress(cc::span<std::byte const> data, int compression_level)
+{
+    cc::vector<std::byte> res;
+    res.resize(ZSTD_compressBound(data.size()));
+    res.resize(compress_to(res, data, compression_level)); // preserves actual content
+    return res;
+}
+
+size_t babel::zstd::compress_to(cc::span<std::byte> out_data, cc::span<std::byte const> data, int compression_level, error_handler on_error)
+{
+    auto real_size = ZSTD_compress(out_data.data(), out_data.size(), data.data(), data.size(), compression_level);
+
+    if (ZSTD_isError(real_size))
+    {
+        on_error(data, {}, cc::format("could not compress data (internal zstd error: {})", ZSTD_getErrorName(real_size)), severity::error);
+        return 0;
+    }
+
+    return real_size;
+}
+
+size_t babel::zstd::compress_to(cc::span<std::byte> out_data, cc::span<std::byte const> data, compress_config const& cfg, error_handler on_error)
+{
+    auto ctx = ZSTD_createCCtx();
+    CC_ASSERT(ctx && "unable to create zstd context");
+    apply_config(ctx, cfg, on_error);
+    auto res = compress_to_with(ctx, out_data, data, on_error);
+    ZSTD_freeCCtx(ctx);
+    return res;
+}
+
+cc::vector<std::byte> babel::zstd::compress(cc::span<std::byte const> data, compress_config const& cfg, error_handler on_error)
+{
+    auto ctx = ZSTD_createCCtx();
+    CC_ASSERT(ctx && "unable to create zstd context");
+    apply_config(ctx, cfg, on_error);
+    auto res = compress_with(ctx, data, on_error);
+    ZSTD_freeCCtx(ctx);
+    return res;
+}
+
+cc::vector<std::byte> babel::zstd::uncompress(cc::span<std::byte const> data, babel::error_handler on_error)
+{
+    auto ctx = ZSTD_createDCtx();
+    CC_ASSERT(ctx && "unable to create zstd context");
+    auto res = uncompress_with(ctx, data, on_error);
+    ZSTD_freeDCtx(ctx);
+    return res;
+}
+
+size_t babel::zstd::uncompressed_size(cc::span<std::byte const> data, error_handler on_error)
+{
+    auto res_size = ZSTD_findDecompressedSize(data.data(), data.size());
+
+    if (res_size == ZSTD_CONTENTSIZE_ERROR)
+    {
+        on_error(data, {}, "unable to get length of uncompressed data (internal zstd error)", severity::error);
+        return 0;
+    }
+    if (res_size == ZSTD_CONTENTSIZE_UNKNOWN)
+    {
+        on_error(data, {}, "cannot determine length of uncompressed data (frame without content size)", severity::error);
+        return 0;
+    }
+
+    return res_size;
+}
+
+bool babel::zstd::uncompress_to(cc::span<std::byte> out_data, cc::span<std::byte const> data, error_handler on_error)
+{
+    auto ctx = ZSTD_createDCtx();
+    CC_ASSERT(ctx && "unable to create zstd context");
+    auto res = uncompress_to_with(ctx, out_data, data, on_error);
+    ZSTD_freeDCtx(ctx);
+    return res;
+}
+
+cc::alloc_array<std::byte> babel::zstd::uncompress(cc::span<std::byte const> data, cc::allocator* alloc, error_handler on_error)
+{
+    auto res_size = ZSTD_findDecompressedSize(data.data(), data.size());
+
+    // at least one frame does not know its size, decompress into a growing buffer first
+    if (res_size == ZSTD_CONTENTSIZE_UNKNOWN)
+        return cc::alloc_array<std::byte>(uncompress(data, on_error), alloc);
+
+    if (res_size == ZSTD_CONTENTSIZE_ERROR)
+    {
+        on_error(data, {}, "unable to get length of uncompressed data (internal zstd error)", severity::error);
+        return {};
+    }
+
+    auto res = cc::alloc_array<std::byte>::uninitialized(size_t(res_size), alloc);
+    if (!uncompress_to(res, data, on_error))
+        return {};
+
+    return res;
+}
+
+babel::zstd::compressor::compressor(int compression_level) : compressor(compress_config{compression_level}) {}
+
+babel::zstd::compressor::compressor(compress_config const& cfg, error_handler on_error)
+{
+    _ctx = ZSTD_createCCtx();
+    CC_ASSERT(_ctx && "unable to create zstd context");
+    apply_config(_ctx, cfg, on_error);
+}
+
+babel::zstd::compressor::~compressor() { ZSTD_freeCCtx(_ctx); }
+
+babel::zstd::compressor::compressor(compressor&& rhs) noexcept
+{
+    _ctx = rhs._ctx;
+    rhs._ctx = nullptr;
+}
+
+babel::zstd::compressor& babel::zstd::compressor::operator=(compressor&& rhs) noexcept
+{
+    ZSTD_freeCCtx(_ctx);
+    _ctx = rhs._ctx;
+    rhs._ctx = nullptr;
+    return *this;
+}
+
+cc::vector<std::byte> babel::zstd::compressor::compress(cc::span<std::byte const> data, error_handler on_error)
+{
+    CC_ASSERT(_ctx && "compressor was moved from");
+    return compress_with(_ctx, data, on_error);
+}
+
+size_t babel::zstd::compressor::compress_to(cc::span<std::byte> out_data, cc::span<std::byte const> data, error_handler on_error)
+{
+    CC_ASSERT(_ctx && "compressor was moved from");
+    return compress_to_with(_ctx, out_data, data, on_error);
+}
+
+babel::zstd::decompressor::decompressor()
+{
+    _ctx = ZSTD_createDCtx();
+    CC_ASSERT(_ctx && "unable to create zstd context");
+}
+
+babel::zstd::decompressor::~decompressor() { ZSTD_freeDCtx(_ctx); }
+
+babel::zstd::decompressor::decompressor(decompressor&& rhs) noexcept
+{
+    _ctx = rhs._ctx;
+    rhs._ctx = nullptr;
+}
+
+babel::zstd::decompressor& babel::zstd::decompressor::operator=(decompressor&& rhs) noexcept
+{
+    ZSTD_freeDCtx(_ctx);
+    _ctx = rhs._ctx;
+    rhs._ctx = nullptr;
+    return *this;
+}
+
+cc::vector<std::byte> babel::zstd::decompressor::uncompress(cc::span<std::byte const> data, error_handler on_error)
+{
+    CC_ASSERT(_ctx && "decompressor was moved from");
+    return uncompress_with(_ctx, data, on_error);
+}
+
+bool babel::zstd::decompressor::uncompress_to(cc::span<std::byte> out_data, cc::span<std::byte const> data, error_handler on_error)
+{
+    CC_ASSERT(_ctx && "decompressor was moved from");
+    return uncompress_to_with(_ctx, out_data, data, on_error);
+}
+
+babel::zstd::compress_stream::compress_stream(cc::stream_ref<std::byte> output, int compression_level, error_handler on_error)
+  : compress_stream(output, compress_config{compression_level}, on_error)
+{
+}
+
+babel::zstd::compress_stream::compress_stream(cc::stream_ref<std::byte> output, compress_config const& cfg, error_handler on_error)
+  : _output(output), _on_error(on_error)
+{
+    _stream = ZSTD_createCStream();
+    CC_ASSERT(_stream && "unable to create zstd stream");
+    apply_config(_stream, cfg, on_error);
+
+    _buffer = cc::array<std::byte>::uninitialized(ZSTD_CStreamOutSize());
+}
+
+babel::zstd::compress_stream::~compress_stream()
+{
+    if (_has_unfinished_frame)
+        finish();
+
+    ZSTD_freeCStream(_stream);
+}
+
+void babel::zstd::compress_stream::operator()(cc::span<std::byte const> data)
+{
+    _has_unfinished_frame = true;
+
+    ZSTD_inBuffer in = {data.data(), data.size(), 0};
+    while (in.pos < in.size)
+    {
+        ZSTD_outBuffer out = {_buffer.data(), _buffer.size(), 0};
+        auto const r = ZSTD_compressStream2(_stream, &out, &in, ZSTD_e_continue);
+        if (ZSTD_isError(r))
+        {
+            _on_error(data, {}, cc::format("could not compress data (internal zstd error: {})", ZSTD_getErrorName(r)), severity::error);
+            return;
+        }
+
+        if (out.pos > 0)
+            _output(cc::span<std::byte const>(_buffer.data(), out.pos));
+    }
+}
+
+void babel::zstd::compress_stream::flush() { drain(ZSTD_e_flush); }
+
+void babel::zstd::compress_stream::finish()
+{
+    if (!_has_unfinished_frame)
+        return;
+
+    drain(ZSTD_e_end);
+    _has_unfinished_frame = false;
+}
+
+void babel::zstd::compress_stream::drain(int end_directive)
+{
+    ZSTD_inBuffer in = {nullptr, 0, 0};
+    size_t remaining = 0;
+    do
+    {
+        ZSTD_outBuffer out = {_buffer.data(), _buffer.size(), 0};
+        remaining = ZSTD_compressStream2(_stream, &out, &in, ZSTD_EndDirective(end_directive));
+        if (ZSTD_isError(remaining))
+        {
+            _on_error({}, {}, cc::format("could not compress data (internal zstd error: {})", ZSTD_getErrorName(remaining)), severity::error);
+            return;
+        }
+
+        if (out.pos > 0)
+            _output(cc::span<std::byte const>(_buffer.data(), out.pos));
+    } while (remaining > 0);
+}
+
+babel::zstd::decompress_stream::decompress_stream(cc::stream_ref<std::byte> output, error_handler on_error, int window_log_max)
+  : _output(output), _on_error(on_error)
+{
+    _stream = ZSTD_createDStream();
+    CC_ASSERT(_stream && "unable to create zstd stream");
+
+    if (window_log_max != 0)
+    {
+        auto const r = ZSTD_DCtx_setParameter(_stream, ZSTD_d_windowLogMax, window_log_max);
+        if (ZSTD_isError(r))
+            on_error({}, {}, cc::format("unable to set zstd window log max (internal zstd error: {})", ZSTD_getErrorName(r)), severity::warning);
+    }
+
+    _buffer = cc::array<std::byte>::uninitialized(ZSTD_DStreamOutSize());
+}
+
+babel::zstd::decompress_stream::~decompress_stream() { ZSTD_freeDStream(_stream); }
+
+void babel::zstd::decompress_stream::operator()(cc::span<std::byte const> data)
+{
+    if (_has_error)
+        return; // the stream cannot recover from corrupted data
+
+    ZSTD_inBuffer in = {data.data(), data.size(), 0};
+    auto output_full = false;
+    // NOTE: if the output buffer is full, zstd might still hold data even if all input is consumed
+    while (in.pos < in.size || output_full)
+    {
+        ZSTD_outBuffer out = {_buffer.data(), _buffer.size(), 0};
+        auto const prev_in_pos = in.pos;
+        auto const r = ZSTD_decompressStream(_stream, &out, &in);
+        if (ZSTD_isError(r))
+        {
+            auto const pos = data.subspan(in.pos < data.size() ? in.pos : data.size(), 0);
+            _on_error(data, pos, cc::format("could not decompress data (internal zstd error: {})", ZSTD_getErrorName(r)), severity::error);
+            _has_error = true;
+            return;
+        }
+
+        if (out.pos > 0)
+            _output(cc::span<std::byte const>(_buffer.data(), out.pos));
+
+        // 0 means a frame was completely decoded and flushed
+        // (calls without progress after a completed frame must not count as the start of a new one)
+        if (r == 0)
+            _is_in_frame = false;
+        else if (in.pos != prev_in_pos || out.pos > 0)
+            _is_in_frame = true;
+        output_full = out.pos == out.size;
+    }
+}
+
+bool babel::zstd::decompress_stream::finish()
+{
+    if (_has_error)
+        return false;
+
+    if (_is_in_frame)
+    {
+        _on_error({}, {}, "compressed data ended in the middle of a frame (truncated data?)", severity::error);
+        return false;
+    }
+
+    return true;
+}
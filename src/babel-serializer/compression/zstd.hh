@@ -2,21 +2,209 @@
 
 #include <cstddef>
 
+#include <clean-core/alloc_array.hh>
+#include <clean-core/array.hh>
 #include <clean-core/span.hh>
+#include <clean-core/stream_ref.hh>
 #include <clean-core/vector.hh>
 
 #include <babel-serializer/errors.hh>
 
 // TODO: more of zstd's API can be exposed if required
 
+// fwd (ZSTD_CStream and ZSTD_DStream)
+struct ZSTD_CCtx_s;
+struct ZSTD_DCtx_s;
+
 namespace babel::zstd
 {
+/// advanced compression parameters
+/// NOTE: 0 means "use default" for all integer values
+struct compress_config
+{
+    /// compression level (for values please consult zstd)
+    int level = 0;
+
+    /// number of worker threads (zstdmt)
+    /// 0 compresses on the calling thread, otherwise input is split into jobs that are compressed in parallel
+    int worker_count = 0;
+
+    /// size of a single compression job in bytes (only used with worker_count > 0)
+    int job_size = 0;
+
+    /// overlap between jobs as fraction of the window size (1 = no overlap, 9 = full window)
+    /// (only used with worker_count > 0)
+    int overlap_log = 0;
+
+    /// long distance matching finds repetitions far apart in large inputs (increases window size to 128 MB)
+    bool long_distance_matching = false;
+
+    /// maximum back-reference distance as power of 2
+    /// NOTE: frames with a window_log above 27 require a decompress_stream with a matching window_log_max
+    int window_log = 0;
+
+    /// stores a checksum (xxhash64) of the content in each frame, which is verified during decompression
+    bool checksum = false;
+};
+
+/// returns the maximum compressed size of data with the given size (in bytes)
+size_t compress_bound(size_t size);
+
 /// compresses a range of bytes using facebook's zstd
 /// NOTE: the result has more capacity than data
 ///       if it is stored long-term, a shrink_to_fit is advised
 /// NOTE: a compression level of 0 means "use default" (for other values please consult zstd)
 cc::vector<std::byte> compress(cc::span<std::byte const> data, int compression_level = 0);
+/// same as compress but with advanced parameters (e.g. multithreading)
+cc::vector<std::byte> compress(cc::span<std::byte const> data, compress_config const& cfg, error_handler on_error = default_error_handler);
+
+/// compresses into a caller-provided buffer without allocating the result
+/// returns the compressed size or 0 on error (e.g. if out_data is too small)
+/// NOTE: out_data.size() >= compress_bound(data.size()) always suffices
+size_t compress_to(cc::span<std::byte> out_data, cc::span<std::byte const> data, int compression_level = 0, error_handler on_error = default_error_handler);
+size_t compress_to(cc::span<std::byte> out_data, cc::span<std::byte const> data, compress_config const& cfg, error_handler on_error = default_error_handler);
 
 /// Tries to uncompress the given data
+/// NOTE: supports concatenated frames and frames without stored content size
 cc::vector<std::byte> uncompress(cc::span<std::byte const> data, error_handler on_error = default_error_handler);
+/// same as uncompress but the result is allocated with the given allocator
+/// NOTE: frames without stored content size require an intermediate copy
+cc::alloc_array<std::byte> uncompress(cc::span<std::byte const> data, cc::allocator* alloc, error_handler on_error = default_error_handler);
+
+/// returns the uncompressed size stored in the frame headers (summed over all frames)
+/// NOTE: reports an error if a frame does not store its content size (e.g. if created by compress_stream)
+size_t uncompressed_size(cc::span<std::byte const> data, error_handler on_error = default_error_handler);
+
+/// Tries to uncompress the given data into a caller-provided buffer
+/// NOTE: out_data must have exactly the uncompressed size (see uncompressed_size)
+bool uncompress_to(cc::span<std::byte> out_data, cc::span<std::byte const> data, error_handler on_error = default_error_handler);
+
+/// a reusable zstd compression context
+/// keeps the internal zstd state alive across calls, avoiding its setup cost for many small payloads
+/// NOTE: not thread-safe, use one compressor per thread
+struct compressor
+{
+    explicit compressor(int compression_level = 0);
+    explicit compressor(compress_config const& cfg, error_handler on_error = default_error_handler);
+    ~compressor();
+
+    compressor(compressor const&) = delete;
+    compressor& operator=(compressor const&) = delete;
+    compressor(compressor&& rhs) noexcept;
+    compressor& operator=(compressor&& rhs) noexcept;
+
+    /// same as zstd::compress but reuses this context
+    cc::vector<std::byte> compress(cc::span<std::byte const> data, error_handler on_error = default_error_handler);
+    /// same as zstd::compress_to but reuses this context
+    size_t compress_to(cc::span<std::byte> out_data, cc::span<std::byte const> data, error_handler on_error = default_error_handler);
+
+private:
+    ZSTD_CCtx_s* _ctx = nullptr;
+};
+
+/// a reusable zstd decompression context
+/// NOTE: not thread-safe, use one decompressor per thread
+struct decompressor
+{
+    decompressor();
+    ~decompressor();
+
+    decompressor(decompressor const&) = delete;
+    decompressor& operator=(decompressor const&) = delete;
+    decompressor(decompressor&& rhs) noexcept;
+    decompressor& operator=(decompressor&& rhs) noexcept;
+
+    /// same as zstd::uncompress but reuses this context
+    cc::vector<std::byte> uncompress(cc::span<std::byte const> data, error_handler on_error = default_error_handler);
+    /// same as zstd::uncompress_to but reuses this context
+    bool uncompress_to(cc::span<std::byte> out_data, cc::span<std::byte const> data, error_handler on_error = default_error_handler);
+
+private:
+    ZSTD_DCtx_s* _ctx = nullptr;
+};
+
+/// a streaming zstd compressor with bounded memory
+/// uncompressed data is pushed via operator() (thus it can be used as a cc::stream_ref<std::byte>)
+/// and compressed data is written to the output stream in chunks
+///
+/// usage:
+///
+///   auto file = babel::file::file_output_stream("data.zst");
+///   auto compressor = babel::zstd::compress_stream(file);
+///   babel::file::read(compressor, "data.raw"); // or compressor(some_data);
+///   compressor.finish();
+///
+/// NOTE: the output stream and on_error must outlive this object
+/// NOTE: finish() ends the current frame, data pushed afterwards starts a new frame
+///       the dtor calls finish() if there is unfinished data
+struct compress_stream
+{
+    explicit compress_stream(cc::stream_ref<std::byte> output, int compression_level = 0, error_handler on_error = default_error_handler);
+    compress_stream(cc::stream_ref<std::byte> output, compress_config const& cfg, error_handler on_error = default_error_handler);
+    ~compress_stream();
+
+    // no copy or move (stream_refs point to this object)
+    compress_stream(compress_stream const&) = delete;
+    compress_stream& operator=(compress_stream const&) = delete;
+
+    /// compresses the given data (output is only written once enough data is buffered)
+    void operator()(cc::span<std::byte const> data);
+
+    /// writes all buffered data to the output without ending the frame
+    void flush();
+
+    /// ends the current frame and writes all remaining data to the output
+    void finish();
+
+private:
+    void drain(int end_directive);
+
+    ZSTD_CCtx_s* _stream = nullptr;
+    cc::stream_ref<std::byte> _output;
+    error_handler _on_error;
+    cc::array<std::byte> _buffer;
+    bool _has_unfinished_frame = true; // an empty stream still produces an (empty) frame
+};
+
+/// a streaming zstd decompressor with bounded memory
+/// compressed data is pushed via operator() (thus it can be used as a cc::stream_ref<std::byte>)
+/// and uncompressed data is written to the output stream in chunks
+/// concatenated frames are decompressed one after another
+///
+/// usage:
+///
+///   auto file = babel::file::file_output_stream("data.raw");
+///   auto decompressor = babel::zstd::decompress_stream(file);
+///   babel::file::read(decompressor, "data.zst");
+///   if (!decompressor.finish())
+///       ... // error or truncated data
+///
+/// NOTE: the output stream and on_error must outlive this object
+/// NOTE: window_log_max limits the memory used for decompression (0 means zstd default, i.e. 27)
+///       it must be raised for frames compressed with a larger compress_config::window_log
+struct decompress_stream
+{
+    explicit decompress_stream(cc::stream_ref<std::byte> output, error_handler on_error = default_error_handler, int window_log_max = 0);
+    ~decompress_stream();
+
+    // no copy or move (stream_refs point to this object)
+    decompress_stream(decompress_stream const&) = delete;
+    decompress_stream& operator=(decompress_stream const&) = delete;
+
+    /// decompresses the given data (frames may be split arbitrarily between calls)
+    void operator()(cc::span<std::byte const> data);
+
+    /// must be called after all data was pushed
+    /// reports an error if the data ended in the middle of a frame
+    /// returns true if all data was decompressed successfully
+    bool finish();
+
+private:
+    ZSTD_DCtx_s* _stream = nullptr;
+    cc::stream_ref<std::byte> _output;
+    error_handler _on_error;
+    cc::array<std::byte> _buffer;
+    bool _is_in_frame = false;
+    bool _has_error = false;
+};
 }
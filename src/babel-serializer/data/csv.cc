@@ -1,6 +1,10 @@
 #include "csv.hh"
 
+#include <cstring>
+#include <limits>
+
 #include <clean-core/from_string.hh>
+#include <clean-core/utility.hh>
 
 namespace
 {
@@ -21,61 +25,107 @@ cc::string csv_to_string(cc::string_view sv)
     }
     return s;
 }
-}
 
-babel::csv::csv_ref babel::csv::read(cc::string_view csv_string, read_config const& config, error_handler on_error)
+// advances p to the end of the current token (the next unescaped separator or newline)
+// returns false if the token contains an unmatched escape character
+bool skip_token(char const*& p, char const* end, char separator)
 {
-    csv_ref csv;
+    auto is_escaped = false;
 
-    auto const end = csv_string.end();
+    while (p != end)
+    {
+        if (*p == '"')
+            is_escaped = !is_escaped;
 
-    auto p = csv_string.begin();
+        else if (!is_escaped && (*p == separator || *p == '\n'))
+            break;
 
-    auto parse_token = [&]() -> cc::string_view
-    {
-        auto is_escaped = false;
+        ++p;
+    }
 
-        auto const start = p;
+    return !is_escaped;
+}
 
-        while (p != end)
+// returns the position of the unescaped newline that terminates the row starting at p (or end)
+// uses memchr to quickly skip over rows without escape characters
+char const* find_row_end(char const* p, char const* end, bool& is_escaped, bool& has_quotes)
+{
+    is_escaped = false;
+    has_quotes = false;
+    while (p != end)
+    {
+        auto nl = static_cast<char const*>(std::memchr(p, '\n', end - p));
+        if (!nl)
+            nl = end;
+
+        for (auto q = static_cast<char const*>(std::memchr(p, '"', nl - p)); q; q = static_cast<char const*>(std::memchr(q + 1, '"', nl - q - 1)))
         {
-            if (*p == '"')
-                is_escaped = !is_escaped;
+            is_escaped = !is_escaped;
+            has_quotes = true;
+        }
 
-            else if (!is_escaped && (*p == config.separator || *p == '\n'))
-                break;
+        if (!is_escaped || nl == end)
+            return nl;
 
-            ++p;
-        }
+        p = nl + 1;
+    }
+    return end;
+}
 
-        if (is_escaped)
-            on_error(cc::as_byte_span(csv_string), cc::as_byte_span(cc::string_view(start, p)), "unmatched escape character <\">", severity::error);
+// parses the header line (if configured) and returns the start of the data rows
+char const* parse_header(cc::string_view csv_string, babel::csv::read_config const& config, babel::error_handler on_error, cc::vector<cc::string>& header)
+{
+    using namespace babel;
 
-        return cc::string_view(start, p).trim();
-    };
+    auto const end = csv_string.end();
+    auto p = csv_string.begin();
+
+    if (!config.has_header)
+        return p;
 
-    if (config.has_header)
+    while (p != end && *p != '\n')
     {
-        csv.header = cc::vector<cc::string>();
-        while (p != end && *p != '\n')
-        {
-            auto name = csv_to_string(parse_token());
+        auto const start = p;
+        if (!skip_token(p, end, config.separator))
+            on_error(cc::as_byte_span(csv_string), cc::as_byte_span(cc::string_view(start, p)), "unmatched escape character <\">", severity::error);
 
-            if (name.empty())
-                on_error(cc::as_byte_span(csv_string), cc::as_byte_span(name), "header has empty token", severity::warning);
+        auto const token = cc::string_view(start, p).trim();
+        auto name = csv_to_string(token);
 
-            csv.header.push_back(name);
+        if (name.empty())
+            on_error(cc::as_byte_span(csv_string), cc::as_byte_span(token), "header has empty token", severity::warning);
 
-            if (p != end && *p == config.separator) // no data lines, just a header
-                ++p;
-        }
+        header.push_back(name);
 
-        if (p != end)
+        if (p != end && *p == config.separator) // no data lines, just a header
             ++p;
-
-        csv.column_count = csv.header.size();
     }
 
+    if (p != end)
+        ++p;
+
+    return p;
+}
+
+// parses all data rows starting at p and feeds their tokens into the sink
+// (a sink provides begin_row(char const*), add_token(cc::string_view), add_empty(), and clear())
+// column_count is the expected number of tokens per row (0 if unknown) and is updated if no header is present
+template <class Sink>
+void parse_rows(cc::string_view csv_string, char const* p, babel::csv::read_config const& config, babel::error_handler on_error, size_t& column_count, Sink& sink)
+{
+    using namespace babel;
+
+    auto const end = csv_string.end();
+
+    auto parse_token = [&]() -> cc::string_view
+    {
+        auto const start = p;
+
+        if (!skip_token(p, end, config.separator))
+            on_error(cc::as_byte_span(csv_string), cc::as_byte_span(cc::string_view(start, p)), "unmatched escape character <\">", severity::error);
+
+        return cc::string_view(start, p).trim();
+    };
 
     // the workflow here is as follows:
     // if there was a header, we expect at most as many tokens per row, as header entries, otherwise it's an error.
@@ -89,11 +139,11 @@ babel::csv::csv_ref babel::csv::read(cc::string_view csv_string, read_config con
     {
         // parse line
         auto const line_start = p;
-        auto token_count = 0;
+        size_t token_count = 0;
+        sink.begin_row(line_start);
         while (p != end && *p != '\n')
         {
-            auto token = parse_token();
-            csv.entries.push_back({token});
+            sink.add_token(parse_token());
             ++token_count;
             if (p != end && *p == config.separator)
                 ++p;
@@ -106,13 +156,13 @@ babel::csv::csv_ref babel::csv::read(cc::string_view csv_string, read_config con
         // instead of              <values, followed, by, empty,,,,>
         // they will only contain  <values, followed, by, empty>
         // we now make sure, we have the correct amount of tokens
-        for (; token_count < csv.column_count; ++token_count)
-            csv.entries.emplace_back();
+        for (; token_count < column_count; ++token_count)
+            sink.add_empty();
 
-        if (csv.column_count == 0) // first time the column width is set
-            csv.column_count = token_count;
+        if (column_count == 0) // first time the column width is set
+            column_count = token_count;
 
-        if (token_count > csv.column_count)
+        if (token_count > column_count)
         {
             if (config.has_header)
             {
@@ -122,15 +172,280 @@ babel::csv::csv_ref babel::csv::read(cc::string_view csv_string, read_config con
             else
             {
                 // restart
-                csv.entries.clear();
-                csv.column_count = token_count;
+                sink.clear();
+                column_count = token_count;
                 p = data_start;
             }
         }
     }
+}
+
+// resolves the projected columns of the config to column indices (-1 for unknown columns)
+cc::vector<int> resolve_projection(cc::string_view csv_string,
+                                   cc::span<cc::string const> header,
+                                   babel::csv::read_config const& config,
+                                   babel::error_handler on_error)
+{
+    using namespace babel;
+
+    CC_ASSERT((config.columns.empty() || config.column_indices.empty()) && "columns can either be selected by name or by index");
+
+    if (!config.column_indices.empty())
+        return config.column_indices;
+
+    cc::vector<int> columns;
+    if (!config.has_header)
+    {
+        on_error(cc::as_byte_span(csv_string), {}, "selecting columns by name requires a header", severity::error);
+        return columns;
+    }
+
+    auto const header_lookup = csv::header_index(header);
+    for (auto const& name : config.columns)
+    {
+        auto const idx = header_lookup.find(header, name);
+        if (idx < 0)
+            on_error(cc::as_byte_span(csv_string), {}, "projected column '" + name + "' does not exist", severity::error);
+        columns.push_back(idx);
+    }
+    return columns;
+}
+
+// parses all data rows starting at p but only feeds the cells of the projected columns into the sink (see parse_rows)
+// rows are found via find_row_end and unwanted cells are skipped via memchr (unless the row contains escape characters)
+template <class Sink>
+void parse_projected_rows(cc::string_view csv_string, char const* p, babel::csv::read_config const& config, babel::error_handler on_error, cc::span<int const> columns, Sink& sink)
+{
+    using namespace babel;
+
+    auto const end = csv_string.end();
+    auto const separator = config.separator;
+
+    auto max_column = -1;
+    for (auto c : columns)
+        max_column = cc::max(max_column, c);
+
+    cc::vector<cc::string_view> tokens; // first max_column + 1 tokens of the current row
+    while (p != end)
+    {
+        auto is_escaped = false;
+        auto has_quotes = false;
+        auto const row_end = find_row_end(p, end, is_escaped, has_quotes);
+        if (is_escaped)
+            on_error(cc::as_byte_span(csv_string), cc::as_byte_span(cc::string_view(p, row_end)), "unmatched escape character <\">", severity::error);
+
+        sink.begin_row(p);
+
+        tokens.clear();
+        auto q = p;
+        while (int(tokens.size()) <= max_column)
+        {
+            auto const token_start = q;
+            if (has_quotes)
+                skip_token(q, row_end, separator);
+            else if (auto const s = static_cast<char const*>(std::memchr(q, separator, row_end - q)))
+                q = s;
+            else
+                q = row_end;
+
+            tokens.push_back(cc::string_view(token_start, q).trim());
+
+            if (q == row_end)
+                break;
+            ++q; // separator
+        }
+
+        for (auto c : columns)
+        {
+            if (c >= 0 && c < int(tokens.size()))
+                sink.add_token(tokens[c]);
+            else
+                sink.add_empty();
+        }
+
+        p = row_end == end ? end : row_end + 1;
+    }
+}
+
+// returns the header entries of the projected columns (empty if there is no header)
+cc::vector<cc::string> project_header(cc::span<cc::string const> header, cc::span<int const> columns)
+{
+    cc::vector<cc::string> result;
+    if (header.empty())
+        return result;
+
+    for (auto c : columns)
+        result.push_back(c >= 0 && c < int(header.size()) ? header[c] : cc::string());
+    return result;
+}
+
+template <class T>
+bool parse_number(cc::string_view token, T& v)
+{
+    if (token.size() >= 2 && token.starts_with('"') && token.ends_with('"'))
+        token = token.subview(1, token.size() - 2).trim();
+    return cc::from_string(token, v);
+}
+
+// small integers are parsed via their 32 bit counterpart and range checked
+template <class T, class ParseT>
+bool parse_small_int(cc::string_view token, T& v)
+{
+    ParseT pv;
+    if (!parse_number(token, pv) || pv < ParseT(std::numeric_limits<T>::min()) || pv > ParseT(std::numeric_limits<T>::max()))
+        return false;
+    v = T(pv);
+    return true;
+}
+}
+
+babel::csv::csv_ref babel::csv::read(cc::string_view csv_string, read_config const& config, error_handler on_error)
+{
+    struct entry_sink
+    {
+        csv_ref& csv;
+
+        void begin_row(char const*) {}
+        void add_token(cc::string_view token) { csv.entries.push_back({token}); }
+        void add_empty() { csv.entries.emplace_back(); }
+        void clear() { csv.entries.clear(); }
+    };
+
+    csv_ref csv;
+
+    auto const data_start = parse_header(csv_string, config, on_error, csv.header);
+
+    auto sink = entry_sink{csv};
+    if (config.has_projection())
+    {
+        auto const columns = resolve_projection(csv_string, csv.header, config, on_error);
+        if (columns.empty()) // the projection could not be resolved (already reported)
+            return {};
+
+        csv.header = project_header(csv.header, columns);
+        csv.header_lookup = header_index(csv.header);
+        csv.column_count = columns.size();
+        parse_projected_rows(csv_string, data_start, config, on_error, columns, sink);
+    }
+    else
+    {
+        csv.header_lookup = header_index(csv.header);
+        csv.column_count = csv.header.size();
+        parse_rows(csv_string, data_start, config, on_error, csv.column_count, sink);
+    }
+
+    return csv;
+}
+
+babel::csv::compact_csv_ref babel::csv::read_compact(cc::string_view csv_string, read_config const& config, error_handler on_error)
+{
+    struct cell_sink
+    {
+        compact_csv_ref& csv;
+        error_handler on_error;
+        char const* row_start = nullptr;
+
+        void begin_row(char const* p)
+        {
+            row_start = p;
+            csv.row_offsets.push_back(uint64_t(p - csv.source.data()));
+        }
+        void add_token(cc::string_view token)
+        {
+            auto const offset = size_t(token.data() - row_start);
+            if (offset + token.size() > size_t(0xFFFFFFFFu))
+            {
+                on_error(cc::as_byte_span(csv.source), cc::as_byte_span(token), "compact csv rows must be smaller than 4 GB", severity::error);
+                csv.cells.emplace_back();
+                return;
+            }
+            csv.cells.push_back({uint32_t(offset), uint32_t(token.size())});
+        }
+        void add_empty() { csv.cells.emplace_back(); }
+        void clear()
+        {
+            csv.row_offsets.clear();
+            csv.cells.clear();
+        }
+    };
+
+    compact_csv_ref csv;
+    csv.source = csv_string;
+
+    auto const data_start = parse_header(csv_string, config, on_error, csv.header);
+
+    auto sink = cell_sink{csv, on_error};
+    if (config.has_projection())
+    {
+        auto const columns = resolve_projection(csv_string, csv.header, config, on_error);
+        if (columns.empty()) // the projection could not be resolved (already reported)
+            return {};
+
+        csv.header = project_header(csv.header, columns);
+        csv.header_lookup = header_index(csv.header);
+        csv.column_count = columns.size();
+        parse_projected_rows(csv_string, data_start, config, on_error, columns, sink);
+    }
+    else
+    {
+        csv.header_lookup = header_index(csv.header);
+        csv.column_count = csv.header.size();
+        parse_rows(csv_string, data_start, config, on_error, csv.column_count, sink);
+    }
+
     return csv;
 }
 
+babel::csv::header_index::header_index(cc::span<cc::string const> header)
+{
+    size_t slot_count = 8;
+    while (slot_count < 2 * header.size())
+        slot_count *= 2;
+    _slots.resize(slot_count);
+
+    for (size_t i = 0; i < header.size(); ++i)
+    {
+        auto const h = hash_name(header[i]);
+        auto si = h & (slot_count - 1);
+        while (_slots[si].column >= 0)
+        {
+            if (_slots[si].hash == h && header[_slots[si].column] == header[i])
+                break; // duplicate name, first one wins
+            si = (si + 1) & (slot_count - 1);
+        }
+        if (_slots[si].column < 0)
+            _slots[si] = {h, int32_t(i)};
+    }
+}
+
+int babel::csv::header_index::find(cc::span<cc::string const> header, cc::string_view name) const
+{
+    if (_slots.empty()) // not built, fall back to linear search
+    {
+        for (size_t i = 0; i < header.size(); ++i)
+            if (header[i] == name)
+                return int(i);
+        return -1;
+    }
+
+    auto const h = hash_name(name);
+    auto const mask = _slots.size() - 1;
+    for (auto si = h & mask; _slots[si].column >= 0; si = (si + 1) & mask)
+        if (_slots[si].hash == h && header[_slots[si].column] == name)
+            return _slots[si].column;
+
+    return -1;
+}
+
+uint32_t babel::csv::header_index::hash_name(cc::string_view name)
+{
+    // FNV-1a
+    uint32_t h = 2166136261u;
+    for (auto c : name)
+        h = (h ^ uint8_t(c)) * 16777619u;
+    return h;
+}
+
 cc::string babel::csv::csv_ref::entry::get_string() const { return csv_to_string(raw_token); }
 
 int32_t babel::csv::csv_ref::entry::get_int() const
@@ -180,3 +495,106 @@ uint64_t babel::csv::csv_ref::entry::get_uint64() const
     CC_ASSERT(ok); // TODO: proper error handling
     return v;
 }
+
+babel::csv::detail::row_partition babel::csv::detail::partition_rows(cc::string_view csv_string, read_config const& config, size_t block_size, error_handler on_error)
+{
+    row_partition partition;
+
+    auto const end = csv_string.end();
+    auto p = parse_header(csv_string, config, on_error, partition.header);
+
+    while (p != end)
+    {
+        row_block block;
+        block.first_row = partition.row_count;
+
+        auto const block_start = p;
+        while (p != end && size_t(p - block_start) < block_size)
+        {
+            auto is_escaped = false;
+            auto has_quotes = false;
+            auto const row_end = find_row_end(p, end, is_escaped, has_quotes);
+            if (is_escaped)
+                on_error(cc::as_byte_span(csv_string), cc::as_byte_span(cc::string_view(p, row_end)), "unmatched escape character <\">", severity::error);
+
+            p = row_end == end ? end : row_end + 1;
+            ++block.row_count;
+        }
+
+        block.text = cc::string_view(block_start, p);
+        partition.row_count += block.row_count;
+        partition.blocks.push_back(block);
+    }
+
+    return partition;
+}
+
+void babel::csv::detail::read_projected(cc::string_view csv_string, read_config const& config, error_handler on_error, cc::function_ref<void(cc::string_view)> on_cell)
+{
+    CC_ASSERT(config.has_projection() && "requires projected columns");
+
+    struct callback_sink
+    {
+        cc::function_ref<void(cc::string_view)> on_cell;
+
+        void begin_row(char const*) {}
+        void add_token(cc::string_view token) { on_cell(token); }
+        void add_empty() { on_cell({}); }
+    };
+
+    cc::vector<cc::string> header;
+    auto const data_start = parse_header(csv_string, config, on_error, header);
+    auto const columns = resolve_projection(csv_string, header, config, on_error);
+    if (columns.empty()) // the projection could not be resolved (already reported)
+        return;
+
+    auto sink = callback_sink{on_cell};
+    parse_projected_rows(csv_string, data_start, config, on_error, columns, sink);
+}
+
+char const* babel::csv::detail::split_row(char const* p, char const* end, char separator, cc::vector<cc::string_view>& tokens)
+{
+    while (p != end && *p != '\n')
+    {
+        auto const start = p;
+        skip_token(p, end, separator); // unmatched escapes are reported by partition_rows
+        tokens.push_back(cc::string_view(start, p).trim());
+
+        if (p != end && *p == separator)
+            ++p;
+    }
+
+    if (p != end)
+        ++p;
+
+    return p;
+}
+
+
+bool babel::csv::detail::parse_cell(cc::string_view token, bool& v)
+{
+    if (token == "true" || token == "1")
+        v = true;
+    else if (token == "false" || token == "0")
+        v = false;
+    else
+        return false;
+    return true;
+}
+
+bool babel::csv::detail::parse_cell(cc::string_view token, int8_t& v) { return parse_small_int<int8_t, int32_t>(token, v); }
+bool babel::csv::detail::parse_cell(cc::string_view token, uint8_t& v) { return parse_small_int<uint8_t, uint32_t>(token, v); }
+bool babel::csv::detail::parse_cell(cc::string_view token, int16_t& v) { return parse_small_int<int16_t, int32_t>(token, v); }
+bool babel::csv::detail::parse_cell(cc::string_view token, uint16_t& v) { return parse_small_int<uint16_t, uint32_t>(token, v); }
+bool babel::csv::detail::parse_cell(cc::string_view token, int32_t& v) { return parse_number(token, v); }
+bool babel::csv::detail::parse_cell(cc::string_view token, uint32_t& v) { return parse_number(token, v); }
+bool babel::csv::detail::parse_cell(cc::string_view token, int64_t& v) { return parse_number(token, v); }
+bool babel::csv::detail::parse_cell(cc::string_view token, uint64_t& v) { return parse_number(token, v); }
+bool babel::csv::detail::parse_cell(cc::string_view token, float& v) { return parse_number(token, v); }
+bool babel::csv::detail::parse_cell(cc::string_view token, double& v) { return parse_number(token, v); }
+
+bool babel::csv::detail::parse_cell(cc::string_view token, cc::string& v)
+{
+    v = csv_to_string(token);
+    return true;
+}
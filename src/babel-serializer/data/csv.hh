@@ -1,11 +1,15 @@
 #pragma once
 
+#include <clean-core/function_ref.hh>
 #include <clean-core/optional.hh>
 #include <clean-core/strided_span.hh>
 #include <clean-core/string.hh>
 #include <clean-core/string_view.hh>
 #include <clean-core/vector.hh>
 
+#include <reflector/introspect.hh>
+
+#include <babel-serializer/detail/parallel.hh>
 #include <babel-serializer/errors.hh>
 
 namespace babel::csv
@@ -17,6 +21,40 @@ struct read_config
 
     /// if true, the first line is parsed as a header and its entries can be used to access the columns of the csv
     bool has_header = true;
+
+    /// number of threads used by read_to (0 means "use all hardware threads")
+    int thread_count = 0;
+
+    /// if not empty, only these columns are extracted (in the given order), all other cells are skipped
+    /// (requires has_header)
+    cc::vector<cc::string> columns;
+
+    /// same as columns but selects by column index (cannot be combined with columns)
+    cc::vector<int> column_indices;
+
+    bool has_projection() const { return !columns.empty() || !column_indices.empty(); }
+};
+
+/// a hashed lookup from column name to column index
+/// NOTE: does not own the names, the header it was built from must be passed to find
+struct header_index
+{
+    header_index() = default;
+    explicit header_index(cc::span<cc::string const> header);
+
+    /// returns the index of the column with the given name, or -1 if no such column exists
+    /// NOTE: falls back to a linear search if the index was not built
+    int find(cc::span<cc::string const> header, cc::string_view name) const;
+
+private:
+    struct slot
+    {
+        uint32_t hash = 0;
+        int32_t column = -1; ///< -1 marks an empty slot
+    };
+    cc::vector<slot> _slots; // open addressing, power-of-two size
+
+    static uint32_t hash_name(cc::string_view name);
 };
 
 /// a non-owning read-only view on a csv string
@@ -38,25 +76,28 @@ struct csv_ref
 
     cc::vector<entry> entries;
     cc::vector<cc::string> header; // is empty if no header present
+    header_index header_lookup;    // accelerates column access by name
     size_t column_count = 0;
 
-    size_t row_count() const { return entries.size() / column_count; }
+    size_t row_count() const { return column_count == 0 ? 0 : entries.size() / column_count; }
     size_t col_count() const { return column_count; }
 
+    /// returns the index of the column with the given name, or -1 if no such column exists
+    int column_index(cc::string_view name) const { return header_lookup.find(header, name); }
+    bool has_column(cc::string_view name) const { return column_index(name) >= 0; }
+
     cc::strided_span<entry const> column(size_t index) const
     {
-        return cc::strided_span<entry const>(entries.data() + index, entries.size() / column_count, column_count * sizeof(entry));
+        CC_ASSERT(index < column_count && "column index out of bounds");
+        return cc::strided_span<entry const>(entries.data() + index, row_count(), column_count * sizeof(entry));
     }
 
     cc::strided_span<entry const> column(cc::string_view name) const
     {
         CC_ASSERT(!header.empty() && "a header must be present to access columns this way");
-        for (size_t i = 0; i < header.size(); ++i)
-        {
-            if (header[i] == name)
-                return column(i);
-        }
-        CC_UNREACHABLE("column name does not exist");
+        auto const idx = column_index(name);
+        CC_ASSERT(idx >= 0 && "column name does not exist");
+        return column(size_t(idx));
     }
 
     cc::span<entry const> row(size_t index) const
@@ -67,8 +108,235 @@ struct csv_ref
 
     cc::span<entry const> operator[](size_t row_index) const { return row(row_index); }
 
-    entry const& operator()(size_t row, size_t col) const { return entries[row + col * column_count]; }
+    entry const& operator()(size_t row, size_t col) const { return entries[row * column_count + col]; }
+};
+
+/// a memory-compact non-owning read-only view on a csv string
+/// instead of a 16 byte string view per cell, each cell is stored as a 32 bit offset/size pair relative to its row
+/// (rows themselves are stored as 64 bit offsets into the source, so sources can be larger than 4 GB)
+/// NOTE: - a single row must be smaller than 4 GB
+///       - entries are created on access and point into source
+struct compact_csv_ref
+{
+    struct cell
+    {
+        uint32_t offset = 0; ///< relative to the start of the row
+        uint32_t size = 0;
+    };
+
+    cc::string_view source;
+    cc::vector<uint64_t> row_offsets; ///< offset of each row into source
+    cc::vector<cell> cells;           ///< row-major, column_count cells per row
+    cc::vector<cc::string> header;    // is empty if no header present
+    header_index header_lookup;       // accelerates column access by name
+    size_t column_count = 0;
+
+    size_t row_count() const { return row_offsets.size(); }
+    size_t col_count() const { return column_count; }
+
+    /// returns the index of the column with the given name, or -1 if no such column exists
+    int column_index(cc::string_view name) const { return header_lookup.find(header, name); }
+    bool has_column(cc::string_view name) const { return column_index(name) >= 0; }
+
+    csv_ref::entry operator()(size_t row, size_t col) const
+    {
+        CC_ASSERT(row < row_count() && col < column_count);
+        auto const c = cells[row * column_count + col];
+        return {source.subview(row_offsets[row] + c.offset, c.size)};
+    }
+    csv_ref::entry operator()(size_t row, cc::string_view col) const
+    {
+        auto const idx = column_index(col);
+        CC_ASSERT(idx >= 0 && "column name does not exist");
+        return operator()(row, size_t(idx));
+    }
 };
 
 csv_ref read(cc::string_view csv_string, read_config const& config = {}, error_handler on_error = default_error_handler);
+
+/// same as read but produces the memory-compact representation (8 instead of 16 byte per cell)
+compact_csv_ref read_compact(cc::string_view csv_string, read_config const& config = {}, error_handler on_error = default_error_handler);
+
+/// NOTE on projections (read_config::columns / column_indices):
+///       read and read_compact then only index row starts and extract the requested cells,
+///       the result only contains the projected columns (and their header entries)
+
+/// reads a single column and directly converts its cells to T (empty cells are default-initialized)
+/// only the requested column is extracted, the rest of each row is skipped
+/// NOTE: supports the same types as read_to
+template <class T>
+cc::vector<T> read_column(cc::string_view csv_string, cc::string_view name, read_config const& config = {}, error_handler on_error = default_error_handler);
+template <class T>
+cc::vector<T> read_column(cc::string_view csv_string, int index, read_config const& config = {}, error_handler on_error = default_error_handler);
+
+/// parses the csv and deserializes each data row into one element of rows
+/// (uses rf::introspect, members are matched to columns by header name, or by order if there is no header)
+/// NOTE: - cells are parsed directly into the members, no csv_ref is created
+///       - members without a matching column (and empty cells) are left default-initialized
+///       - rows are parsed in parallel blocks (see read_config::thread_count)
+///         thus on_error might be called from different threads (calls are serialized)
+template <class T>
+void read_to(cc::vector<T>& rows, cc::string_view csv_string, read_config const& config = {}, error_handler on_error = default_error_handler);
+
+// ====== IMPLEMENTATION ======
+
+namespace detail
+{
+/// a contiguous range of data rows inside a csv string
+struct row_block
+{
+    cc::string_view text; ///< all rows of this block
+    size_t first_row = 0; ///< index of the first row of this block
+    size_t row_count = 0;
+};
+
+struct row_partition
+{
+    cc::vector<cc::string> header; ///< is empty if no header present
+    cc::vector<row_block> blocks;
+    size_t row_count = 0;
+};
+
+/// approximate size of a row block in bytes
+inline constexpr size_t row_block_size = 256 * 1024;
+
+/// parses the header (if configured) and splits the remaining rows into blocks of roughly block_size bytes
+/// NOTE: newlines inside escaped tokens do not start a new row
+row_partition partition_rows(cc::string_view csv_string, read_config const& config, size_t block_size, error_handler on_error);
+
+/// calls on_cell for each cell of the projected columns (row-major, empty cells included)
+/// NOTE: config must have a projection
+void read_projected(cc::string_view csv_string, read_config const& config, error_handler on_error, cc::function_ref<void(cc::string_view)> on_cell);
+
+/// splits the row starting at p into trimmed but still escaped tokens
+/// returns the start of the next row
+char const* split_row(char const* p, char const* end, char separator, cc::vector<cc::string_view>& tokens);
+
+/// converts a single (non-empty) csv token into a value
+/// returns false if the token cannot be converted
+bool parse_cell(cc::string_view token, bool& v);
+bool parse_cell(cc::string_view token, int8_t& v);
+bool parse_cell(cc::string_view token, uint8_t& v);
+bool parse_cell(cc::string_view token, int16_t& v);
+bool parse_cell(cc::string_view token, uint16_t& v);
+bool parse_cell(cc::string_view token, int32_t& v);
+bool parse_cell(cc::string_view token, uint32_t& v);
+bool parse_cell(cc::string_view token, int64_t& v);
+bool parse_cell(cc::string_view token, uint64_t& v);
+bool parse_cell(cc::string_view token, float& v);
+bool parse_cell(cc::string_view token, double& v);
+bool parse_cell(cc::string_view token, cc::string& v);
+template <class T>
+bool parse_cell(cc::string_view token, T& v)
+{
+    if constexpr (std::is_enum_v<T>)
+    {
+        std::underlying_type_t<T> nr = 0;
+        if (!parse_cell(token, nr))
+            return false;
+        v = T(nr);
+        return true;
+    }
+    else
+        static_assert(cc::always_false<T>, "member type is not supported for csv deserialization");
+}
+}
+
+template <class T>
+void read_to(cc::vector<T>& rows, cc::string_view csv_string, read_config const& config, error_handler on_error)
+{
+    static_assert(rf::is_introspectable<T>, "csv::read_to requires rf::introspect-able row types");
+
+    auto const partition = detail::partition_rows(csv_string, config, detail::row_block_size, on_error);
+
+    // resolve the column of each member once
+    cc::vector<int> member_columns;
+    {
+        auto const header_lookup = header_index(partition.header);
+        T proto;
+        rf::do_introspect(
+            [&](auto&, cc::string_view name)
+            {
+                if (config.has_header)
+                    member_columns.push_back(header_lookup.find(partition.header, name));
+                else
+                    member_columns.push_back(int(member_columns.size()));
+            },
+            proto);
+    }
+
+    rows.clear();
+    rows.resize(partition.row_count);
+
+    auto const all_data = cc::as_byte_span(csv_string);
+    auto const header_size = partition.header.size();
+
+    auto parse_block = [&](detail::row_block const& block, error_handler block_on_error)
+    {
+        cc::vector<cc::string_view> tokens;
+        auto p = block.text.begin();
+        auto const end = block.text.end();
+        for (size_t r = 0; r < block.row_count; ++r)
+        {
+            auto const line_start = p;
+            tokens.clear();
+            p = detail::split_row(p, end, config.separator, tokens);
+
+            if (config.has_header && tokens.size() > header_size)
+                block_on_error(all_data, cc::as_byte_span(cc::string_view(line_start, p)), "line and header have mismatching number of tokens",
+                               severity::error);
+
+            size_t member_idx = 0;
+            rf::do_introspect(
+                [&](auto& member, cc::string_view)
+                {
+                    auto const col = member_columns[member_idx++];
+                    if (col < 0 || size_t(col) >= tokens.size() || tokens[col].empty())
+                        return; // missing data
+
+                    if (!detail::parse_cell(tokens[col], member))
+                        block_on_error(all_data, cc::as_byte_span(tokens[col]), "token cannot be converted to member type", severity::error);
+                },
+                rows[block.first_row + r]);
+        }
+    };
+    babel::detail::parallel_for(partition.blocks.size(), config.thread_count, on_error,
+                                [&](size_t i, error_handler block_on_error) { parse_block(partition.blocks[i], block_on_error); });
+}
+
+template <class T>
+cc::vector<T> read_column(cc::string_view csv_string, cc::string_view name, read_config const& config, error_handler on_error)
+{
+    auto cfg = config;
+    cfg.columns = {cc::string(name)};
+    cfg.column_indices.clear();
+
+    cc::vector<T> values;
+    detail::read_projected(csv_string, cfg, on_error,
+                           [&](cc::string_view token)
+                           {
+                               auto& v = values.emplace_back();
+                               if (!token.empty() && !detail::parse_cell(token, v))
+                                   on_error(cc::as_byte_span(csv_string), cc::as_byte_span(token), "token cannot be converted to column type", severity::error);
+                           });
+    return values;
+}
+
+template <class T>
+cc::vector<T> read_column(cc::string_view csv_string, int index, read_config const& config, error_handler on_error)
+{
+    auto cfg = config;
+    cfg.columns.clear();
+    cfg.column_indices = {index};
+
+    cc::vector<T> values;
+    detail::read_projected(csv_string, cfg, on_error,
+                           [&](cc::string_view token)
+                           {
+                               auto& v = values.emplace_back();
+                               if (!token.empty() && !detail::parse_cell(token, v))
+                                   on_error(cc::as_byte_span(csv_string), cc::as_byte_span(token), "token cannot be converted to column type", severity::error);
+                           });
+    return values;
+}
 } // namespace babel::csv
@@ -0,0 +1,73 @@
+#include "parallel.hh"
+
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+#include <clean-core/utility.hh>
+#include <clean-core/vector.hh>
+
+int babel::detail::resolve_thread_count(int thread_count, size_t task_count)
+{
+    if (thread_count <= 0)
+        thread_count = int(std::thread::hardware_concurrency());
+    thread_count = cc::max(thread_count, 1);
+
+    // 0 tasks means "unknown", e.g. to size a batch of work for all threads
+    if (task_count > 0)
+        thread_count = int(cc::min(size_t(thread_count), task_count));
+    return thread_count;
+}
+
+void babel::detail::parallel_for(size_t count, int thread_count, error_handler on_error, cc::function_ref<void(size_t, error_handler)> f)
+{
+    if (count == 0)
+        return;
+
+    thread_count = resolve_thread_count(thread_count, count);
+
+    if (thread_count <= 1)
+    {
+        for (size_t i = 0; i < count; ++i)
+            f(i, on_error);
+        return;
+    }
+
+    std::mutex mutex;
+    std::atomic<size_t> next_task = 0;
+    std::atomic<bool> failed = false;
+    std::exception_ptr exception;
+
+    auto locked_on_error = [&](cc::span<std::byte const> data, cc::span<std::byte const> pos, cc::string_view message, severity s)
+    {
+        auto lock = std::lock_guard<std::mutex>(mutex);
+        on_error(data, pos, message, s);
+    };
+
+    auto worker = [&]
+    {
+        try
+        {
+            for (auto i = next_task++; i < count && !failed; i = next_task++)
+                f(i, locked_on_error);
+        }
+        catch (...)
+        {
+            auto lock = std::lock_guard<std::mutex>(mutex);
+            if (!exception)
+                exception = std::current_exception();
+            failed = true;
+        }
+    };
+
+    cc::vector<std::thread> threads;
+    for (auto i = 1; i < thread_count; ++i)
+        threads.emplace_back(worker);
+    worker();
+    for (auto& t : threads)
+        t.join();
+
+    if (exception)
+        std::rethrow_exception(exception);
+}
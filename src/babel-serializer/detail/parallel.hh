@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstddef>
+
+#include <clean-core/function_ref.hh>
+
+#include <babel-serializer/errors.hh>
+
+namespace babel::detail
+{
+/// number of threads to use for task_count tasks (thread_count 0 or less means "all hardware threads")
+/// NOTE: always at least 1 and never more than task_count (task_count 0 means "unknown" and does not cap)
+int resolve_thread_count(int thread_count, size_t task_count);
+
+/// calls f(i) for i in [0, count), distributed over thread_count threads (0 means "all hardware threads")
+/// NOTE: the error handler passed to f is safe to call from any thread
+///       exceptions thrown in f are rethrown on the calling thread (remaining tasks are skipped)
+void parallel_for(size_t count, int thread_count, error_handler on_error, cc::function_ref<void(size_t, error_handler)> f);
+}
@@ -9,11 +9,14 @@
 #include <rich-log/log.hh>
 
 #include <babel-serializer/detail/log.hh>
+#include <babel-serializer/hash.hh>
 #include <babel-serializer/source_map.hh>
 
-void babel::default_error_handler(cc::span<const std::byte> data, cc::span<const std::byte> pos, cc::string_view message, babel::severity s)
+namespace
+{
+void log_error(babel::source_map const& map, cc::span<const std::byte> data, cc::span<const std::byte> pos, cc::string_view message, babel::severity s)
 {
-    auto map = source_map(data);
+    using namespace babel;
 
     // binary mode
     if (map.is_binary())
@@ -286,3 +289,94 @@ void babel::default_error_handler(cc::span<const std::byte> data, cc::span<const
         }
     }
 }
+}
+
+void babel::default_error_handler(cc::span<const std::byte> data, cc::span<const std::byte> pos, cc::string_view message, babel::severity s)
+{
+    log_error(source_map(data), data, pos, message, s);
+}
+
+void babel::cached_error_handler::operator()(cc::span<const std::byte> data, cc::span<const std::byte> pos, cc::string_view message, babel::severity s)
+{
+    if (!_has_map || data.data() != _data.data() || data.size() != _data.size())
+    {
+        _map = source_map(data);
+        _data = data;
+        _has_map = true;
+    }
+
+    log_error(_map, data, pos, message, s);
+}
+
+void babel::cached_error_handler::reset()
+{
+    _map = {};
+    _data = {};
+    _has_map = false;
+}
+
+void babel::error_collector::operator()(cc::span<const std::byte> data, cc::span<const std::byte> pos, cc::string_view message, babel::severity s)
+{
+    if (s == severity::error)
+        ++_error_count;
+    else
+        ++_warning_count;
+
+    if (_records.size() >= _max_records)
+        return;
+
+    error_record r;
+    r.level = s;
+
+    // positions outside of data (e.g. in a decoded copy) cannot be located later
+    if (!pos.empty() && pos.data() >= data.data() && pos.data() + pos.size() <= data.data() + data.size())
+    {
+        r.offset = int64_t(pos.data() - data.data());
+        r.size = uint32_t(cc::min(pos.size(), size_t(UINT32_MAX)));
+    }
+
+    // the number of distinct messages is usually small, so a linear search over the hashes is fast
+    auto const hash = hash::xxh64(cc::as_byte_span(message));
+    auto id = _messages.size();
+    for (size_t i = 0; i < _messages.size(); ++i)
+        if (_message_hashes[i] == hash && _messages[i] == message)
+        {
+            id = i;
+            break;
+        }
+    if (id == _messages.size())
+    {
+        _messages.push_back(cc::string(message));
+        _message_hashes.push_back(hash);
+    }
+    r.message_id = uint32_t(id);
+
+    _records.push_back(r);
+}
+
+void babel::error_collector::log(cc::span<const std::byte> data) const
+{
+    if (_records.empty())
+        return;
+
+    auto const map = source_map(data);
+    for (auto const& r : _records)
+    {
+        auto pos = cc::span<std::byte const>();
+        if (r.offset >= 0 && size_t(r.offset) + r.size <= data.size())
+            pos = data.subspan(size_t(r.offset), r.size);
+        log_error(map, data, pos, _messages[r.message_id], r.level);
+    }
+
+    if (dropped_count() > 0)
+        RICH_LOG_WARN("%s", cc::format("{} more messages were not recorded", dropped_count()));
+}
+
+void babel::error_collector::clear()
+{
+    _records.clear();
+    _messages.clear();
+    _message_hashes.clear();
+    _error_count = 0;
+    _warning_count = 0;
+}
@@ -1,8 +1,14 @@
 #pragma once
 
+#include <cstdint>
+
 #include <clean-core/function_ref.hh>
 #include <clean-core/span.hh>
+#include <clean-core/string.hh>
 #include <clean-core/string_view.hh>
+#include <clean-core/vector.hh>
+
+#include <babel-serializer/source_map.hh>
 
 namespace babel
 {
@@ -19,7 +25,95 @@ using error_handler = cc::function_ref<void(cc::span<std::byte const> data, cc::
 
 /// The defaul error handler outputs all warnings and errors on the console (using rich-log)
 /// and asserts on error
-///
-/// TODO: make an object that caches source_map if called multiple times
+/// NOTE: builds a source_map of the whole data for every message, see cached_error_handler if many messages are expected
 void default_error_handler(cc::span<std::byte const> data, cc::span<std::byte const> pos, cc::string_view message, severity s);
+
+/// an error handler that outputs messages like default_error_handler,
+/// but builds the source_map lazily and only once per input (instead of once per message)
+/// i.e. reporting n messages for an input of size m costs O(m + n log m) instead of O(n m)
+///
+/// usage:
+///
+///   auto on_error = babel::cached_error_handler();
+///   auto value = babel::json::read<T>(data, {}, on_error);
+///
+/// NOTE: the map is keyed by the data span, call reset() if the data is modified in-place between messages
+struct cached_error_handler
+{
+    void operator()(cc::span<std::byte const> data, cc::span<std::byte const> pos, cc::string_view message, severity s);
+
+    /// drops the cached source_map
+    void reset();
+
+private:
+    cc::span<std::byte const> _data;
+    source_map _map;
+    bool _has_map = false;
+};
+
+/// a compact record of a reported message (see error_collector)
+struct error_record
+{
+    /// byte offset of the reported position in the data (-1 if there is no position)
+    int64_t offset = -1;
+
+    /// size of the reported position in bytes
+    uint32_t size = 0;
+
+    /// index of the message text (see error_collector::message)
+    /// NOTE: messages are interned, i.e. the same message text always has the same id (useful as error code)
+    uint32_t message_id = 0;
+
+    severity level = severity::error;
+};
+
+/// an error handler that only records messages instead of outputting them
+/// recording is cheap (no source_map, no rendering, message texts are stored once),
+/// which makes it suited for dirty data with a lot of warnings (e.g. for batch ingestion)
+/// collected messages can be inspected via records() or rendered on demand via log()
+///
+/// usage:
+///
+///   auto errors = babel::error_collector();
+///   auto value = babel::json::read<T>(data, {}, errors);
+///   if (errors.has_errors())
+///       errors.log(data); // same output as default_error_handler
+///
+/// NOTE: offsets are relative to the data of each call, i.e. one collector should only be used for one input at a time (see clear())
+struct error_collector
+{
+    /// at most max_records messages are recorded, later ones are only counted
+    explicit error_collector(size_t max_records = 1000) : _max_records(max_records) {}
+
+    void operator()(cc::span<std::byte const> data, cc::span<std::byte const> pos, cc::string_view message, severity s);
+
+    /// all recorded messages (in the order they were reported)
+    cc::span<error_record const> records() const { return _records; }
+
+    /// the message text of a record
+    cc::string_view message(error_record const& r) const { return _messages[r.message_id]; }
+
+    /// number of reported messages (including the ones that were not recorded)
+    size_t error_count() const { return _error_count; }
+    size_t warning_count() const { return _warning_count; }
+    bool has_errors() const { return _error_count > 0; }
+
+    /// number of messages that were not recorded because of max_records
+    size_t dropped_count() const { return _error_count + _warning_count - _records.size(); }
+
+    /// outputs all recorded messages like default_error_handler (but builds the source_map only once)
+    /// NOTE: data must be the same data that was passed to the handler
+    void log(cc::span<std::byte const> data) const;
+
+    /// removes all records and messages
+    void clear();
+
+private:
+    size_t _max_records;
+    cc::vector<error_record> _records;
+    cc::vector<cc::string> _messages;
+    cc::vector<uint64_t> _message_hashes; // parallel to _messages (for interning)
+    size_t _error_count = 0;
+    size_t _warning_count = 0;
+};
 }
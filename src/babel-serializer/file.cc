@@ -1,7 +1,14 @@
 #include "file.hh"
 
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <exception>
 #include <filesystem>
 #include <fstream>
+#include <mutex>
+#include <thread>
 
 #if defined(CC_OS_WINDOWS)
 // clang-format off
@@ -11,6 +18,7 @@
 
 #include <WinBase.h>
 #include <fileapi.h>
+#include <io.h>
 
 #include <clean-core/native/detail/win32_sanitize_after.inl>
 // clang-format on
@@ -18,31 +26,390 @@
 #include <fcntl.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #endif
 
 #include <clean-core/array.hh>
-#include <clean-core/assertf.hh>
 #include <clean-core/format.hh>
 #include <clean-core/macros.hh>
 #include <clean-core/string.hh>
 #include <clean-core/temp_cstr.hh>
+#include <clean-core/utility.hh>
+#include <clean-core/vector.hh>
+
+#include <babel-serializer/hash.hh>
+
+namespace
+{
+/// a minimal unbuffered input file (a raw file descriptor on posix)
+struct input_file
+{
+    explicit input_file(cc::string_view filename)
+    {
+#ifdef CC_OS_WINDOWS
+        if (::fopen_s(&_file, cc::temp_cstr(filename), "rb") != 0)
+            _file = nullptr;
+        else
+            std::setvbuf(_file, nullptr, _IONBF, 0);
+#else
+        _fd = ::open(cc::temp_cstr(filename), O_RDONLY | O_CLOEXEC);
+#endif
+    }
+
+    ~input_file()
+    {
+#ifdef CC_OS_WINDOWS
+        if (_file)
+            std::fclose(_file);
+#else
+        if (_fd != -1)
+            ::close(_fd);
+#endif
+    }
+
+    input_file(input_file const&) = delete;
+    input_file& operator=(input_file const&) = delete;
+
+#ifdef CC_OS_WINDOWS
+    bool valid() const { return _file != nullptr; }
+#else
+    bool valid() const { return _fd != -1; }
+#endif
+
+    /// returns the file size or -1 on error
+    int64_t size() const
+    {
+#ifdef CC_OS_WINDOWS
+        struct _stat64 st;
+        return _fstat64(_fileno(_file), &st) == 0 ? int64_t(st.st_size) : -1;
+#else
+        struct stat st;
+        return fstat(_fd, &st) == 0 ? int64_t(st.st_size) : -1;
+#endif
+    }
+
+    void advise_sequential()
+    {
+#if defined(CC_OS_LINUX)
+        ::posix_fadvise(_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    }
+
+    /// fills the buffer (unless the end of the file is reached)
+    /// returns the number of bytes read or -1 on error
+    int64_t read(cc::span<std::byte> buffer)
+    {
+#ifdef CC_OS_WINDOWS
+        auto const n = std::fread(buffer.data(), 1, buffer.size(), _file);
+        if (n < buffer.size() && std::ferror(_file))
+            return -1;
+        return int64_t(n);
+#else
+        size_t total = 0;
+        while (total < buffer.size())
+        {
+            auto const n = ::read(_fd, buffer.data() + total, buffer.size() - total);
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                return -1;
+            }
+            if (n == 0)
+                break;
+            total += size_t(n);
+        }
+        return int64_t(total);
+#endif
+    }
+
+private:
+#ifdef CC_OS_WINDOWS
+    std::FILE* _file = nullptr;
+#else
+    int _fd = -1;
+#endif
+};
+
+/// reads the next buffer on a separate thread while the calling thread writes the current one to out
+/// returns false on read errors
+bool read_double_buffered(input_file& file, cc::stream_ref<std::byte> out, size_t buffer_size)
+{
+    cc::vector<std::byte> buffers[2] = {cc::vector<std::byte>::uninitialized(buffer_size), cc::vector<std::byte>::uninitialized(buffer_size)};
+    int64_t sizes[2] = {};
+    bool filled[2] = {};
+    bool stop = false;
+    std::mutex mutex;
+    std::condition_variable cv;
+
+    auto reader = std::thread(
+        [&]
+        {
+            for (auto i = 0;; i = 1 - i)
+            {
+                {
+                    auto lock = std::unique_lock<std::mutex>(mutex);
+                    cv.wait(lock, [&] { return !filled[i] || stop; });
+                    if (stop)
+                        return;
+                }
+
+                auto const n = file.read(buffers[i]);
+
+                {
+                    auto lock = std::lock_guard<std::mutex>(mutex);
+                    sizes[i] = n;
+                    filled[i] = true;
+                }
+                cv.notify_all();
+
+                // eof or error
+                if (n <= 0)
+                    return;
+            }
+        });
+
+    auto stop_reader = [&]
+    {
+        {
+            auto lock = std::lock_guard<std::mutex>(mutex);
+            stop = true;
+        }
+        cv.notify_all();
+        reader.join();
+    };
+
+    try
+    {
+        for (auto i = 0;; i = 1 - i)
+        {
+            int64_t n;
+            {
+                auto lock = std::unique_lock<std::mutex>(mutex);
+                cv.wait(lock, [&] { return filled[i]; });
+                n = sizes[i];
+            }
+
+            if (n <= 0)
+            {
+                stop_reader();
+                return n == 0;
+            }
+
+            out << cc::span<std::byte const>(buffers[i].data(), size_t(n));
+
+            {
+                auto lock = std::lock_guard<std::mutex>(mutex);
+                filled[i] = false;
+            }
+            cv.notify_all();
+        }
+    }
+    catch (...)
+    {
+        // exceptions of the output stream are propagated after the reader is stopped
+        stop_reader();
+        throw;
+    }
+}
+}
+
+void babel::file::read_all_bytes_batch(cc::span<cc::string_view const> filenames,
+                                       cc::function_ref<void(size_t index, cc::alloc_array<std::byte> data)> on_read,
+                                       batch_read_config const& cfg,
+                                       error_handler on_error)
+{
+    if (filenames.empty())
+        return;
+
+    auto thread_count = cfg.thread_count > 0 ? cfg.thread_count : int(std::thread::hardware_concurrency());
+    thread_count = int(cc::clamp(size_t(thread_count), size_t(1), filenames.size()));
+    auto const max_pending = size_t(cfg.max_pending > 0 ? cfg.max_pending : 2 * thread_count);
+
+    struct read_file
+    {
+        size_t index = 0;
+        cc::alloc_array<std::byte> data;
+        cc::string error; // empty on success
+    };
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    // ring buffer of read files (FIFO, i.e. on_read is called in completion order)
+    // at most max_pending files are in flight (being read or waiting for on_read), so it never overflows
+    auto pending = cc::vector<read_file>::defaulted(max_pending);
+    size_t pending_begin = 0;
+    size_t pending_count = 0;
+    size_t in_flight = 0;
+    size_t next_file = 0;
+    bool stop = false;
+    std::exception_ptr exception;
+
+    auto read_one = [&](size_t i) -> read_file
+    {
+        read_file f;
+        f.index = i;
+
+        input_file file(filenames[i]);
+        auto const size = file.valid() ? file.size() : -1;
+        if (size < 0)
+        {
+            f.error = cc::format("file '{}' could not be read", filenames[i]);
+            return f;
+        }
+
+        f.data = cc::alloc_array<std::byte>::uninitialized(size_t(size), cfg.alloc);
+        if (file.read(f.data) != size)
+            f.error = cc::format("error reading from file '{}'", filenames[i]);
+        return f;
+    };
+
+    auto worker = [&]
+    {
+        try
+        {
+            while (true)
+            {
+                // a slot is acquired before reading, so that the memory stays bounded
+                size_t i;
+                {
+                    auto lock = std::unique_lock<std::mutex>(mutex);
+                    cv.wait(lock, [&] { return in_flight < max_pending || stop; });
+                    if (stop || next_file == filenames.size())
+                        return;
+                    i = next_file++;
+                    ++in_flight;
+                }
+
+                auto f = read_one(i);
+
+                {
+                    auto lock = std::lock_guard<std::mutex>(mutex);
+                    pending[(pending_begin + pending_count) % max_pending] = cc::move(f);
+                    ++pending_count;
+                }
+                cv.notify_all();
+            }
+        }
+        catch (...)
+        {
+            // e.g. allocation failures, rethrown on the calling thread
+            {
+                auto lock = std::lock_guard<std::mutex>(mutex);
+                if (!exception)
+                    exception = std::current_exception();
+                stop = true;
+            }
+            cv.notify_all();
+        }
+    };
+
+    cc::vector<std::thread> threads;
+    for (auto t = 0; t < thread_count; ++t)
+        threads.emplace_back(worker);
+
+    auto stop_workers = [&]
+    {
+        {
+            auto lock = std::lock_guard<std::mutex>(mutex);
+            stop = true;
+        }
+        cv.notify_all();
+        for (auto& t : threads)
+            t.join();
+    };
+
+    try
+    {
+        for (size_t received = 0; received < filenames.size(); ++received)
+        {
+            read_file f;
+            {
+                auto lock = std::unique_lock<std::mutex>(mutex);
+                cv.wait(lock, [&] { return pending_count > 0 || exception; });
+                if (exception)
+                    break;
+                f = cc::move(pending[pending_begin]);
+                pending_begin = (pending_begin + 1) % max_pending;
+                --pending_count;
+                --in_flight;
+            }
+            cv.notify_all();
+
+            if (f.error.empty())
+                on_read(f.index, cc::move(f.data));
+            else
+                on_error({}, {}, f.error, severity::error);
+        }
+    }
+    catch (...)
+    {
+        stop_workers();
+        throw;
+    }
+
+    stop_workers();
+
+    if (exception)
+        std::rethrow_exception(exception);
+}
 
 void babel::file::read(cc::stream_ref<std::byte> out, cc::string_view filename, error_handler on_error)
 {
-    std::ifstream file(cc::temp_cstr(filename), std::ios_base::binary);
-    if (!file)
+    read(out, filename, read_config{}, on_error);
+}
+
+void babel::file::read(cc::stream_ref<std::byte> out, cc::string_view filename, read_config const& cfg, error_handler on_error)
+{
+    CC_ASSERT(cfg.buffer_size > 0 && "buffer size must be positive");
+
+    input_file file(filename);
+    if (!file.valid())
     {
         on_error({}, {}, cc::format("file '{}' could not be read", filename), severity::error);
         return;
     }
 
-    std::byte buffer[1024 * 4];
-    while (file)
+    if (cfg.sequential_hint)
+        file.advise_sequential();
+
+    // the content is hashed on the fly (if requested), so that the file is read only once
+    auto hasher = hash::xxh64_stream();
+    auto const verify = cfg.expected_xxh64.has_value();
+    auto sink = [&](cc::span<std::byte const> data)
+    {
+        if (verify)
+            hasher(data);
+        out << data;
+    };
+
+    auto success = true;
+    if (cfg.read_ahead)
+        success = read_double_buffered(file, sink, cfg.buffer_size);
+    else
     {
-        auto n = file.readsome(reinterpret_cast<char*>(buffer), sizeof(buffer));
-        out << cc::span(buffer, n);
+        auto buffer = cc::vector<std::byte>::uninitialized(cfg.buffer_size);
+        while (true)
+        {
+            auto const n = file.read(buffer);
+            if (n < 0)
+                success = false;
+            if (n <= 0)
+                break;
+
+            sink(cc::span<std::byte const>(buffer.data(), size_t(n)));
+
+            // short read means eof
+            if (size_t(n) < buffer.size())
+                break;
+        }
     }
+
+    if (!success)
+        on_error({}, {}, cc::format("error reading from file '{}'", filename), severity::error);
+    else if (verify && hasher.digest() != cfg.expected_xxh64.value())
+        on_error({}, {}, cc::format("content of file '{}' does not match the expected hash", filename), severity::error);
 }
 
 cc::string babel::file::read_all_text(cc::string_view filename, babel::error_handler on_error)
@@ -184,22 +551,335 @@ bool babel::file::exists(cc::string_view filename)
     return std::ifstream(cc::temp_cstr(filename)).good();
 }
 
-babel::file::file_output_stream::file_output_stream(cc::string_view filename)
+namespace
 {
-#ifdef CC_OS_WINDOWS
-    errno_t err = ::fopen_s(&_file, cc::temp_cstr(filename), "wb");
+// O_DIRECT requires aligned buffers, offsets, and sizes
+constexpr size_t direct_io_alignment = 4096;
+
+#if !defined(CC_OS_WINDOWS)
+/// writes all parts (handling partial writes and interrupts)
+bool write_all(int fd, cc::span<std::byte const> a, cc::span<std::byte const> b)
+{
+    iovec parts[2] = {{const_cast<std::byte*>(a.data()), a.size()}, {const_cast<std::byte*>(b.data()), b.size()}};
+    auto part = parts[0].iov_len > 0 ? 0 : 1;
+    while (part < 2)
+    {
+        auto const n = ::writev(fd, parts + part, 2 - part);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+
+        auto remaining = size_t(n);
+        while (part < 2 && remaining >= parts[part].iov_len)
+            remaining -= parts[part++].iov_len;
+        if (part < 2)
+        {
+            parts[part].iov_base = static_cast<std::byte*>(parts[part].iov_base) + remaining;
+            parts[part].iov_len -= remaining;
+        }
+    }
+    return true;
+}
+#endif
+
+cc::string make_temp_filename(cc::string_view filename)
+{
+    static std::atomic<int> counter = 0;
+#if defined(CC_OS_WINDOWS)
+    auto const pid = int(GetCurrentProcessId());
+#else
+    auto const pid = int(getpid());
+#endif
+    return cc::format("{}.{}-{}.tmp", filename, pid, counter++);
+}
+}
+
+babel::file::file_output_stream::file_output_stream(cc::string_view filename, error_handler on_error)
+  : file_output_stream(filename, file_output_config{}, on_error)
+{
+}
+
+babel::file::file_output_stream::file_output_stream(cc::string_view filename, file_output_config const& cfg, error_handler on_error)
+  : _config(cfg), _on_error(on_error), _filename(filename)
+{
+    CC_ASSERT(cfg.buffer_size > 0 && "buffer size must be positive");
+
+    if (cfg.atomic)
+        _temp_filename = make_temp_filename(filename);
+    auto const& path = cfg.atomic ? _temp_filename : _filename;
+
+#if defined(CC_OS_WINDOWS)
+    errno_t err = ::fopen_s(&_file, path.c_str(), "wb");
     if (err != 0)
         _file = nullptr;
+    if (_file)
+        std::setvbuf(_file, nullptr, _IONBF, 0); // buffered by us
+#else
+    auto flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+#ifdef O_DIRECT
+    if (cfg.direct_io)
+    {
+        _file_descriptor = ::open(path.c_str(), flags | O_DIRECT, 0666);
+        _is_direct = _file_descriptor != -1;
+    }
+#endif
+    if (_file_descriptor == -1)
+        _file_descriptor = ::open(path.c_str(), flags, 0666);
+#endif
+
+    if (!valid())
+    {
+        _has_error = true;
+        on_error({}, {}, cc::format("cannot write to file '{}'", filename), severity::error);
+        return;
+    }
+
+#if defined(CC_OS_LINUX)
+    if (cfg.expected_size > 0)
+        ::posix_fallocate(_file_descriptor, 0, off_t(cfg.expected_size));
+#endif
+
+    // direct io needs an aligned buffer of aligned size
+    _buffer_size = _is_direct ? (cfg.buffer_size + direct_io_alignment - 1) / direct_io_alignment * direct_io_alignment : cfg.buffer_size;
+    _buffer_storage = cc::vector<std::byte>::uninitialized(_buffer_size + (_is_direct ? direct_io_alignment : 0));
+    _buffer = _buffer_storage.data();
+    if (_is_direct)
+        _buffer += (direct_io_alignment - reinterpret_cast<uintptr_t>(_buffer) % direct_io_alignment) % direct_io_alignment;
+}
+
+babel::file::file_output_stream::~file_output_stream()
+{
+    if (!valid())
+        return;
+
+    // close() always releases the file before reporting, so a throwing error handler can be ignored here
+    // (errors are only observable via commit())
+    try
+    {
+        close(_config.atomic);
+    }
+    catch (...)
+    {
+    }
+}
+
+// (this is not valid, so the assignment never closes and thus cannot throw)
+babel::file::file_output_stream::file_output_stream(file_output_stream&& rhs) noexcept { *this = cc::move(rhs); }
+
+babel::file::file_output_stream& babel::file::file_output_stream::operator=(file_output_stream&& rhs)
+{
+    if (this == &rhs)
+        return *this;
+
+    if (valid())
+        close(_config.atomic);
+
+#if defined(CC_OS_WINDOWS)
+    _file = rhs._file;
+    rhs._file = nullptr;
+#else
+    _file_descriptor = rhs._file_descriptor;
+    rhs._file_descriptor = -1;
+#endif
+    _config = rhs._config;
+    _on_error = rhs._on_error;
+    _filename = cc::move(rhs._filename);
+    _temp_filename = cc::move(rhs._temp_filename);
+    _buffer_storage = cc::move(rhs._buffer_storage); // the heap buffer (and thus _buffer) stays the same
+    _buffer = rhs._buffer;
+    _buffer_size = rhs._buffer_size;
+    _buffer_pos = rhs._buffer_pos;
+    _file_pos = rhs._file_pos;
+    _is_direct = rhs._is_direct;
+    _has_error = rhs._has_error;
+    rhs._buffer = nullptr;
+    rhs._buffer_size = 0;
+    rhs._buffer_pos = 0;
+    return *this;
+}
+
+bool babel::file::file_output_stream::valid() const
+{
+#if defined(CC_OS_WINDOWS)
+    return _file != nullptr;
+#else
+    return _file_descriptor != -1;
+#endif
+}
+
+void babel::file::file_output_stream::report(cc::string_view message)
+{
+    // only the first error is reported (subsequent writes are skipped anyway)
+    if (!_has_error)
+    {
+        _has_error = true;
+        _on_error({}, {}, cc::format("{} '{}'", message, _filename), severity::error);
+    }
+}
+
+void babel::file::file_output_stream::write_to_file(cc::span<std::byte const> a, cc::span<std::byte const> b)
+{
+    if (_has_error || !valid())
+    {
+        report("cannot write to file");
+        return;
+    }
+
+#if defined(CC_OS_WINDOWS)
+    auto const success = std::fwrite(a.data(), 1, a.size(), _file) == a.size() && std::fwrite(b.data(), 1, b.size(), _file) == b.size();
+#else
+    // unaligned writes are not possible with direct io, so the remaining writes go through the page cache
+    if (_is_direct && (a.size() + b.size()) % direct_io_alignment != 0)
+    {
+        ::fcntl(_file_descriptor, F_SETFL, ::fcntl(_file_descriptor, F_GETFL) & ~O_DIRECT);
+        _is_direct = false;
+    }
+    auto const success = write_all(_file_descriptor, a, b);
+#endif
+
+    if (!success)
+        report("error writing to file");
+    _file_pos += a.size() + b.size();
+}
+
+void babel::file::file_output_stream::write_slow(cc::span<std::byte const> data)
+{
+    // invalid or closed streams have no buffer
+    if (_buffer_size == 0)
+    {
+        report("cannot write to file");
+        return;
+    }
+
+    // large writes are passed directly to the OS, together with the buffered data (one writev)
+    if (!_is_direct && data.size() >= _buffer_size)
+    {
+        write_to_file(cc::span<std::byte const>(_buffer, _buffer_pos), data);
+        _buffer_pos = 0;
+        return;
+    }
+
+    while (!data.empty())
+    {
+        auto const n = cc::min(data.size(), _buffer_size - _buffer_pos);
+        std::memcpy(_buffer + _buffer_pos, data.data(), n);
+        _buffer_pos += n;
+        data = data.subspan(n);
+
+        if (_buffer_pos == _buffer_size)
+        {
+            write_to_file(cc::span<std::byte const>(_buffer, _buffer_pos));
+            _buffer_pos = 0;
+        }
+    }
+}
+
+void babel::file::file_output_stream::flush()
+{
+    if (_buffer_pos > 0)
+    {
+        write_to_file(cc::span<std::byte const>(_buffer, _buffer_pos));
+        _buffer_pos = 0;
+    }
+}
+
+bool babel::file::file_output_stream::commit()
+{
+    if (!valid())
+        return false;
+
+    close(false);
+    return !_has_error;
+}
+
+void babel::file::file_output_stream::close(bool discard)
+{
+    // errors are reported once the file is released, so that a throwing error handler cannot leak it
+    cc::string error;
+    auto const on_error = _on_error;
+    auto record_error = [&](cc::span<std::byte const>, cc::span<std::byte const>, cc::string_view message, severity) { error = message; };
+    _on_error = record_error;
+    close_file(discard);
+    _on_error = on_error;
+
+    if (!error.empty())
+        _on_error({}, {}, error, severity::error);
+}
+
+void babel::file::file_output_stream::close_file(bool discard)
+{
+    if (!discard)
+        flush();
+    _buffer_pos = 0;
+    _buffer_size = 0;
+
+#if defined(CC_OS_WINDOWS)
+    if (!discard && _config.sync && (std::fflush(_file) != 0 || _commit(_fileno(_file)) != 0))
+        report("could not sync file");
+    if (std::fclose(_file) != 0)
+        report("error closing file");
+    _file = nullptr;
 #else
-    _file = std::fopen(cc::temp_cstr(filename), "wb");
+    // remove the preallocated space that was not written
+    if (!discard && _config.expected_size > _file_pos && ::ftruncate(_file_descriptor, off_t(_file_pos)) != 0)
+        report("could not truncate file");
+
+#if defined(CC_OS_LINUX)
+    auto const sync = [](int fd) { return ::fdatasync(fd); };
+#else
+    auto const sync = [](int fd) { return ::fsync(fd); };
+#endif
+    if (!discard && _config.sync && sync(_file_descriptor) != 0)
+        report("could not sync file");
+    if (::close(_file_descriptor) != 0)
+        report("error closing file");
+    _file_descriptor = -1;
+#endif
+
+    if (!_config.atomic)
+        return;
+
+    if (discard || _has_error)
+    {
+        std::remove(_temp_filename.c_str());
+        return;
+    }
+
+#if defined(CC_OS_WINDOWS)
+    auto const renamed = MoveFileExA(_temp_filename.c_str(), _filename.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    auto const renamed = ::rename(_temp_filename.c_str(), _filename.c_str()) == 0;
+#endif
+    if (!renamed)
+    {
+        report("could not replace file");
+        std::remove(_temp_filename.c_str());
+        return;
+    }
+
+#if !defined(CC_OS_WINDOWS)
+    // the rename itself is only durable once the directory is synced
+    if (_config.sync)
+    {
+        auto const dir = std::filesystem::path(_filename.c_str()).parent_path();
+        auto const dir_fd = ::open(dir.empty() ? "." : dir.c_str(), O_RDONLY | O_CLOEXEC);
+        if (dir_fd != -1)
+        {
+            ::fsync(dir_fd);
+            ::close(dir_fd);
+        }
+    }
 #endif
 }
 
-babel::file::detail::mmap_info babel::file::detail::impl_map_file_to_memory(cc::string_view filepath, bool is_readonly)
+babel::file::detail::mmap_info babel::file::detail::impl_map_file_to_memory(cc::string_view filepath, bool is_readonly, mmap_config const& cfg, error_handler on_error)
 {
+    // NOTE: everything acquired so far is released before reporting because on_error might throw
 #if defined(CC_OS_WINDOWS)
 
-    // todo: error reporting
     // todo: arbitrarily long paths, see: https://docs.microsoft.com/en-us/windows/win32/api/fileapi/nf-fileapi-createfilea
 
     auto file_handle_access_flags = GENERIC_READ;
@@ -207,7 +887,11 @@ babel::file::detail::mmap_info babel::file::detail::impl_map_file_to_memory(cc::
         file_handle_access_flags |= GENERIC_WRITE;
 
     auto const file_handle = CreateFileA(cc::temp_cstr(filepath), file_handle_access_flags, 0, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
-    CC_ASSERT(file_handle != INVALID_HANDLE_VALUE && "failed to open file");
+    if (file_handle == INVALID_HANDLE_VALUE)
+    {
+        on_error({}, {}, cc::format("file '{}' could not be opened", filepath), severity::error);
+        return {};
+    }
 
     DWORD high = 0;
     DWORD low = GetFileSize(file_handle, &high);
@@ -215,11 +899,26 @@ babel::file::detail::mmap_info babel::file::detail::impl_map_file_to_memory(cc::
 
     auto const file_mapping_protection_flags = is_readonly ? PAGE_READONLY : PAGE_READWRITE;
     auto const file_mapping_handle = CreateFileMappingA(file_handle, nullptr, file_mapping_protection_flags, 0, 0, nullptr);
-    CC_ASSERT(file_mapping_handle != INVALID_HANDLE_VALUE && "failed to create file mapping");
+    if (!file_mapping_handle)
+    {
+        CloseHandle(file_handle);
+        on_error({}, {}, cc::format("failed to create a file mapping of '{}'", filepath), severity::error);
+        return {};
+    }
 
     auto const file_view_access_flags = is_readonly ? FILE_MAP_READ : FILE_MAP_WRITE; // FILE_MAP_WRITE gives read/write access
     auto const file_view = MapViewOfFile(file_mapping_handle, file_view_access_flags, 0, 0, 0);
-    CC_ASSERT(file_view != INVALID_HANDLE_VALUE && "failed to create file view");
+    if (!file_view)
+    {
+        CloseHandle(file_mapping_handle);
+        CloseHandle(file_handle);
+        on_error({}, {}, cc::format("failed to map file '{}' to memory", filepath), severity::error);
+        return {};
+    }
+
+    // there is no equivalent to MAP_POPULATE, but prefetching the whole view is close
+    if (cfg.populate)
+        impl_advise(file_view, byte_size, 0, byte_size, mmap_advice::willneed);
 
     return {file_handle, file_mapping_handle, byte_size, file_view};
 #else
@@ -231,23 +930,49 @@ babel::file::detail::mmap_info babel::file::detail::impl_map_file_to_memory(cc::
 
     auto const file_access_flags = is_readonly ? O_RDONLY : O_RDWR;
 
-    int const file_descriptor = open(cc::temp_cstr(filepath), file_access_flags);
-
-    CC_ASSERT(file_descriptor != -1 && "failed to open file");
+    int const file_descriptor = open(cc::temp_cstr(filepath), file_access_flags | O_CLOEXEC);
+    if (file_descriptor == -1)
+    {
+        on_error({}, {}, cc::format("file '{}' could not be opened", filepath), severity::error);
+        return {};
+    }
 
     struct stat st;
-    auto const stat_error = fstat(file_descriptor, &st);
-    CC_ASSERT(stat_error == 0 && "failed to read file size");
+    if (fstat(file_descriptor, &st) != 0)
+    {
+        close(file_descriptor);
+        on_error({}, {}, cc::format("could not read the size of file '{}'", filepath), severity::error);
+        return {};
+    }
     size_t const byte_size = st.st_size;
 
     auto mmap_protection_flags = PROT_READ;
     if (!is_readonly)
         mmap_protection_flags |= PROT_WRITE;
 
-    auto const mmap_flags = is_readonly ? MAP_PRIVATE : MAP_SHARED;
+    auto mmap_flags = is_readonly ? MAP_PRIVATE : MAP_SHARED;
+#ifdef MAP_POPULATE
+    if (cfg.populate)
+        mmap_flags |= MAP_POPULATE;
+#endif
 
     void* const mmap_result = mmap(nullptr, byte_size, mmap_protection_flags, mmap_flags, file_descriptor, 0);
-    CC_ASSERTF(mmap_result != MAP_FAILED, "Failed to map file to memory {}", filepath);
+    if (mmap_result == MAP_FAILED)
+    {
+        close(file_descriptor);
+        on_error({}, {}, cc::format("failed to map file '{}' to memory", filepath), severity::error);
+        return {};
+    }
+
+    if (cfg.access == access_pattern::sequential)
+        impl_advise(mmap_result, byte_size, 0, byte_size, mmap_advice::sequential);
+    else if (cfg.access == access_pattern::random)
+        impl_advise(mmap_result, byte_size, 0, byte_size, mmap_advice::random);
+
+#ifdef MADV_HUGEPAGE
+    if (cfg.huge_pages)
+        madvise(mmap_result, byte_size, MADV_HUGEPAGE);
+#endif
 
     return {file_descriptor, byte_size, mmap_result};
 #endif
@@ -282,14 +1007,604 @@ void babel::file::detail::impl_unmap(void* data, size_t size, int file_descripto
 }
 #endif
 
-babel::file::memory_mapped_file<std::byte> babel::file::make_memory_mapped_file_readwrite(cc::string_view path)
+void babel::file::detail::impl_advise(void* data, size_t byte_size, size_t offset, size_t size, mmap_advice advice)
 {
-    return memory_mapped_file<std::byte>(path);
+    if (!data || offset >= byte_size)
+        return;
+    size = cc::min(size, byte_size - offset);
+    if (size == 0)
+        return;
+
+#if defined(CC_OS_WINDOWS)
+    // only prefetching has an equivalent (Windows 8+)
+    if (advice == mmap_advice::willneed)
+    {
+        WIN32_MEMORY_RANGE_ENTRY range;
+        range.VirtualAddress = static_cast<char*>(data) + offset;
+        range.NumberOfBytes = size;
+        PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+    }
+#else
+    // madvise requires a page-aligned address
+    static auto const page_size = size_t(sysconf(_SC_PAGESIZE));
+    auto const begin = reinterpret_cast<uintptr_t>(data) + offset;
+    auto const aligned_begin = begin / page_size * page_size;
+
+    int native_advice = MADV_NORMAL;
+    switch (advice)
+    {
+    case mmap_advice::normal:
+        native_advice = MADV_NORMAL;
+        break;
+    case mmap_advice::sequential:
+        native_advice = MADV_SEQUENTIAL;
+        break;
+    case mmap_advice::random:
+        native_advice = MADV_RANDOM;
+        break;
+    case mmap_advice::willneed:
+        native_advice = MADV_WILLNEED;
+        break;
+    case mmap_advice::dontneed:
+        native_advice = MADV_DONTNEED;
+        break;
+    }
+
+    madvise(reinterpret_cast<void*>(aligned_begin), size + (begin - aligned_begin), native_advice);
+#endif
 }
 
-babel::file::memory_mapped_file<std::byte const> babel::file::make_memory_mapped_file_readonly(cc::string_view path)
+bool babel::file::detail::impl_lock(void* data, size_t byte_size)
 {
-    return memory_mapped_file<std::byte const>(path);
+    if (!data)
+        return false;
+#if defined(CC_OS_WINDOWS)
+    return VirtualLock(data, byte_size);
+#else
+    return mlock(data, byte_size) == 0;
+#endif
+}
+
+void babel::file::detail::impl_unlock(void* data, size_t byte_size)
+{
+    if (!data)
+        return;
+#if defined(CC_OS_WINDOWS)
+    VirtualUnlock(data, byte_size);
+#else
+    munlock(data, byte_size);
+#endif
+}
+
+babel::file::memory_mapped_file<std::byte> babel::file::make_memory_mapped_file_readwrite(cc::string_view path, mmap_config const& cfg)
+{
+    return memory_mapped_file<std::byte>(path, cfg);
+}
+
+babel::file::memory_mapped_file<std::byte const> babel::file::make_memory_mapped_file_readonly(cc::string_view path, mmap_config const& cfg)
+{
+    return memory_mapped_file<std::byte const>(path, cfg);
+}
+
+babel::file::file_bytes babel::file::read_all_bytes(cc::string_view filename, read_bytes_config const& cfg, error_handler on_error)
+{
+    file_bytes res;
+
+    int64_t size = -1;
+    {
+        input_file file(filename);
+        if (file.valid())
+            size = file.size();
+        if (size < 0)
+        {
+            on_error({}, {}, cc::format("file '{}' could not be read", filename), severity::error);
+            return res;
+        }
+
+        // small files are read (empty files cannot be mapped)
+        if (size == 0 || uint64_t(size) < cfg.mmap_threshold)
+        {
+            res._buffer = cc::alloc_array<std::byte>::uninitialized(size_t(size), cfg.alloc);
+            if (file.read(res._buffer) != size)
+            {
+                on_error({}, {}, cc::format("error reading from file '{}'", filename), severity::error);
+                return {};
+            }
+            res._data = res._buffer;
+        }
+        else
+        {
+            res._mapped = memory_mapped_file<std::byte const>(filename, cfg.mapping, on_error);
+            if (!res.is_mapped())
+                return {};
+            res._data = cc::span<std::byte const>(res._mapped.data(), res._mapped.size());
+        }
+    }
+
+    if (cfg.expected_xxh64.has_value() && hash::xxh64(res._data) != cfg.expected_xxh64.value())
+    {
+        on_error({}, {}, cc::format("content of file '{}' does not match the expected hash", filename), severity::error);
+        return {};
+    }
+    return res;
 }
 
 size_t babel::file::size_of(cc::string_view filename) { return std::filesystem::file_size(cc::string(filename).c_str()); }
+
+babel::file::windowed_file::windowed_file(cc::string_view filepath, mmap_config const& cfg, error_handler on_error)
+  : _config(cfg), _on_error(on_error), _filename(filepath), _has_error(true) // reset once the file is open
+{
+#if defined(CC_OS_WINDOWS)
+    auto const file_handle = CreateFileA(cc::temp_cstr(filepath), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file_handle == INVALID_HANDLE_VALUE)
+    {
+        on_error({}, {}, cc::format("file '{}' could not be opened", filepath), severity::error);
+        return;
+    }
+
+    DWORD high = 0;
+    DWORD low = GetFileSize(file_handle, &high);
+    _file_size = (uint64_t(high) << 32) + uint64_t(low);
+
+    // a file mapping object does not reserve address space, only views do
+    _file_handle = file_handle;
+    if (_file_size > 0)
+    {
+        _file_mapping_handle = CreateFileMappingA(file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!_file_mapping_handle)
+        {
+            on_error({}, {}, cc::format("file '{}' could not be mapped", filepath), severity::error);
+            CloseHandle(_file_handle);
+            _file_handle = nullptr;
+            return;
+        }
+    }
+#else
+    _file_descriptor = open(cc::temp_cstr(filepath), O_RDONLY | O_CLOEXEC);
+    if (_file_descriptor == -1)
+    {
+        on_error({}, {}, cc::format("file '{}' could not be opened", filepath), severity::error);
+        return;
+    }
+
+    struct stat st;
+    if (fstat(_file_descriptor, &st) != 0)
+    {
+        on_error({}, {}, cc::format("could not read the size of file '{}'", filepath), severity::error);
+        close(_file_descriptor);
+        _file_descriptor = -1;
+        return;
+    }
+    _file_size = uint64_t(st.st_size);
+#endif
+
+    _has_error = false;
+}
+
+babel::file::windowed_file::~windowed_file() { release(); }
+
+void babel::file::windowed_file::release()
+{
+    unmap();
+#if defined(CC_OS_WINDOWS)
+    if (_file_mapping_handle)
+        CloseHandle(_file_mapping_handle);
+    if (_file_handle)
+        CloseHandle(_file_handle);
+    _file_handle = nullptr;
+    _file_mapping_handle = nullptr;
+#else
+    if (_file_descriptor != -1)
+        close(_file_descriptor);
+    _file_descriptor = -1;
+#endif
+}
+
+babel::file::windowed_file::windowed_file(windowed_file&& rhs) noexcept
+{
+    *this = cc::move(rhs);
+}
+
+babel::file::windowed_file& babel::file::windowed_file::operator=(windowed_file&& rhs) noexcept
+{
+    if (this == &rhs)
+        return *this;
+
+    release();
+
+#if defined(CC_OS_WINDOWS)
+    _file_handle = rhs._file_handle;
+    _file_mapping_handle = rhs._file_mapping_handle;
+    rhs._file_handle = nullptr;
+    rhs._file_mapping_handle = nullptr;
+#else
+    _file_descriptor = rhs._file_descriptor;
+    rhs._file_descriptor = -1;
+#endif
+    _config = rhs._config;
+    _on_error = rhs._on_error;
+    _filename = cc::move(rhs._filename);
+    _file_size = rhs._file_size;
+    _view = rhs._view;
+    _view_size = rhs._view_size;
+    _window = rhs._window;
+    _has_error = rhs._has_error;
+    rhs._file_size = 0;
+    rhs._view = nullptr;
+    rhs._view_size = 0;
+    rhs._window = {};
+    return *this;
+}
+
+bool babel::file::windowed_file::valid() const
+{
+#if defined(CC_OS_WINDOWS)
+    return _file_handle != nullptr;
+#else
+    return _file_descriptor != -1;
+#endif
+}
+
+void babel::file::windowed_file::unmap()
+{
+    if (_view)
+    {
+#if defined(CC_OS_WINDOWS)
+        UnmapViewOfFile(_view);
+#else
+        munmap(_view, _view_size);
+#endif
+    }
+    _view = nullptr;
+    _view_size = 0;
+    _window = {};
+}
+
+void babel::file::windowed_file::report_map_error(uint64_t offset, size_t size)
+{
+    _has_error = true;
+    _on_error({}, {}, cc::format("could not map {} bytes at offset {} of file '{}'", size, offset, _filename), severity::error);
+}
+
+cc::span<std::byte const> babel::file::windowed_file::map(uint64_t offset, size_t size)
+{
+    unmap();
+
+    if (!valid() || offset >= _file_size)
+        return {};
+    size = size_t(cc::min(uint64_t(size), _file_size - offset));
+    if (size == 0)
+        return {};
+
+    // mappings must start at a multiple of the allocation granularity
+#if defined(CC_OS_WINDOWS)
+    static auto const granularity = []
+    {
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        return uint64_t(info.dwAllocationGranularity);
+    }();
+#else
+    static auto const granularity = uint64_t(sysconf(_SC_PAGESIZE));
+#endif
+    auto const aligned_offset = offset / granularity * granularity;
+    auto const view_size = size_t(offset - aligned_offset) + size;
+
+#if defined(CC_OS_WINDOWS)
+    auto const view = MapViewOfFile(_file_mapping_handle, FILE_MAP_READ, DWORD(aligned_offset >> 32), DWORD(aligned_offset), view_size);
+    if (!view)
+    {
+        report_map_error(offset, size);
+        return {};
+    }
+    if (_config.populate)
+        detail::impl_advise(view, view_size, 0, view_size, detail::mmap_advice::willneed);
+#else
+    auto mmap_flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+    if (_config.populate)
+        mmap_flags |= MAP_POPULATE;
+#endif
+    auto const view = mmap(nullptr, view_size, PROT_READ, mmap_flags, _file_descriptor, off_t(aligned_offset));
+    if (view == MAP_FAILED)
+    {
+        report_map_error(offset, size);
+        return {};
+    }
+
+    if (_config.access == access_pattern::sequential)
+        detail::impl_advise(view, view_size, 0, view_size, detail::mmap_advice::sequential);
+    else if (_config.access == access_pattern::random)
+        detail::impl_advise(view, view_size, 0, view_size, detail::mmap_advice::random);
+#ifdef MADV_HUGEPAGE
+    if (_config.huge_pages)
+        madvise(view, view_size, MADV_HUGEPAGE);
+#endif
+#endif
+
+    _view = view;
+    _view_size = view_size;
+    _window.offset = offset;
+    _window.data = {static_cast<std::byte const*>(view) + (offset - aligned_offset), size};
+    return _window.data;
+}
+
+babel::file::windowed_file::window_iterator::window_iterator(windowed_file* file, size_t window_size, size_t overlap)
+  : _file(file), _window_size(window_size), _overlap(overlap)
+{
+    _window.data = _file->map(0, _window_size);
+    _is_end = _window.data.empty();
+}
+
+babel::file::windowed_file::window_iterator& babel::file::windowed_file::window_iterator::operator++()
+{
+    CC_ASSERT(!_is_end && "cannot increment past the end");
+
+    // the last window reached the end of the file
+    auto const end = _window.offset + _window.data.size();
+    if (end >= _file->size())
+    {
+        _file->unmap();
+        _is_end = true;
+        return *this;
+    }
+
+    _window.offset = end - _overlap;
+    _window.data = _file->map(_window.offset, _window_size);
+    _is_end = _window.data.empty();
+    return *this;
+}
+
+babel::file::mapped_output_file::mapped_output_file(cc::string_view filename, error_handler on_error)
+  : mapped_output_file(filename, mapped_output_config{}, on_error)
+{
+}
+
+babel::file::mapped_output_file::mapped_output_file(cc::string_view filename, mapped_output_config const& cfg, error_handler on_error)
+  : _config(cfg), _on_error(on_error), _filename(filename)
+{
+#if defined(CC_OS_WINDOWS)
+    _file_handle = CreateFileA(_filename.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (_file_handle == INVALID_HANDLE_VALUE)
+        _file_handle = nullptr;
+#else
+    _file_descriptor = ::open(_filename.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+#endif
+
+    if (!valid())
+    {
+        _has_error = true;
+        on_error({}, {}, cc::format("cannot write to file '{}'", filename), severity::error);
+        return;
+    }
+
+    // the dtor does not run if the error handler throws here, so the file is closed manually
+    try
+    {
+        reserve(size_t(cfg.initial_capacity));
+    }
+    catch (...)
+    {
+        close();
+        throw;
+    }
+}
+
+babel::file::mapped_output_file::~mapped_output_file()
+{
+    if (!valid())
+        return;
+
+    // close() always releases the file before reporting, so a throwing error handler can be ignored here
+    // (errors are only observable via commit())
+    try
+    {
+        close();
+    }
+    catch (...)
+    {
+    }
+}
+
+// (this is not valid, so the assignment never closes and thus cannot throw)
+babel::file::mapped_output_file::mapped_output_file(mapped_output_file&& rhs) noexcept { *this = cc::move(rhs); }
+
+babel::file::mapped_output_file& babel::file::mapped_output_file::operator=(mapped_output_file&& rhs)
+{
+    if (this == &rhs)
+        return *this;
+
+    if (valid())
+        close();
+
+#if defined(CC_OS_WINDOWS)
+    _file_handle = rhs._file_handle;
+    _file_mapping_handle = rhs._file_mapping_handle;
+    rhs._file_handle = nullptr;
+    rhs._file_mapping_handle = nullptr;
+#else
+    _file_descriptor = rhs._file_descriptor;
+    rhs._file_descriptor = -1;
+#endif
+    _config = rhs._config;
+    _on_error = rhs._on_error;
+    _filename = cc::move(rhs._filename);
+    _data = rhs._data;
+    _size = rhs._size;
+    _capacity = rhs._capacity;
+    _has_error = rhs._has_error;
+    rhs._data = nullptr;
+    rhs._size = 0;
+    rhs._capacity = 0;
+    return *this;
+}
+
+bool babel::file::mapped_output_file::valid() const
+{
+#if defined(CC_OS_WINDOWS)
+    return _file_handle != nullptr;
+#else
+    return _file_descriptor != -1;
+#endif
+}
+
+void babel::file::mapped_output_file::report(cc::string_view message)
+{
+    // only the first error is reported
+    if (!_has_error)
+    {
+        _has_error = true;
+        _on_error({}, {}, cc::format("{} '{}'", message, _filename), severity::error);
+    }
+}
+
+void babel::file::mapped_output_file::unmap()
+{
+#if defined(CC_OS_WINDOWS)
+    if (_data)
+        UnmapViewOfFile(_data);
+    if (_file_mapping_handle)
+        CloseHandle(_file_mapping_handle);
+    _file_mapping_handle = nullptr;
+#else
+    if (_data)
+        munmap(_data, _capacity);
+#endif
+    _data = nullptr;
+    _capacity = 0;
+}
+
+bool babel::file::mapped_output_file::reserve(size_t capacity)
+{
+    if (!valid())
+        return false;
+    if (capacity <= _capacity)
+        return true;
+
+#if defined(CC_OS_WINDOWS)
+    // a mapping cannot be resized, but creating a larger one also grows the file
+    // (the old mapping is only released on success, so that a failed reserve keeps the written data accessible)
+    auto const mapping_handle = CreateFileMappingA(_file_handle, nullptr, PAGE_READWRITE, DWORD(uint64_t(capacity) >> 32), DWORD(capacity), nullptr);
+    if (!mapping_handle)
+    {
+        report("could not grow file");
+        return false;
+    }
+    auto const view = MapViewOfFile(mapping_handle, FILE_MAP_WRITE, 0, 0, capacity);
+    if (!view)
+    {
+        CloseHandle(mapping_handle);
+        report("could not map file");
+        return false;
+    }
+    unmap();
+    _file_mapping_handle = mapping_handle;
+#else
+    // the file must be at least as large as the mapping, otherwise writes crash with SIGBUS
+    // (posix_fallocate also reserves the disk space, i.e. a full disk is reported here instead)
+#if defined(CC_OS_LINUX)
+    auto const grown = _config.preallocate ? ::posix_fallocate(_file_descriptor, 0, off_t(capacity)) == 0 //
+                                           : ::ftruncate(_file_descriptor, off_t(capacity)) == 0;
+#else
+    auto const grown = ::ftruncate(_file_descriptor, off_t(capacity)) == 0;
+#endif
+    if (!grown)
+    {
+        report("could not grow file");
+        return false;
+    }
+
+#if defined(CC_OS_LINUX)
+    // mremap can grow the mapping in-place or move it without copying the pages
+    auto const view = _data ? mremap(_data, _capacity, capacity, MREMAP_MAYMOVE)
+                            : mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, _file_descriptor, 0);
+#else
+    auto const view = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, _file_descriptor, 0);
+#endif
+    if (view == MAP_FAILED)
+    {
+        // (the previous mapping is still valid, i.e. _data, _size, and _capacity stay consistent)
+        report("could not map file");
+        return false;
+    }
+#if !defined(CC_OS_LINUX)
+    // both mappings share the page cache of the file, so the written data is visible in the new one
+    unmap();
+#endif
+#endif
+
+    _data = static_cast<std::byte*>(view);
+    _capacity = capacity;
+    return true;
+}
+
+bool babel::file::mapped_output_file::resize(size_t size)
+{
+    if (size > _capacity && !reserve(size))
+        return false;
+    _size = size;
+    return true;
+}
+
+bool babel::file::mapped_output_file::commit()
+{
+    if (!valid())
+        return false;
+
+    close();
+    return !_has_error;
+}
+
+void babel::file::mapped_output_file::close()
+{
+    // errors are reported once the file is released, so that a throwing error handler cannot leak it
+    cc::string error;
+    auto const on_error = _on_error;
+    auto record_error = [&](cc::span<std::byte const>, cc::span<std::byte const>, cc::string_view message, severity) { error = message; };
+    _on_error = record_error;
+    close_file();
+    _on_error = on_error;
+
+    if (!error.empty())
+        _on_error({}, {}, error, severity::error);
+}
+
+void babel::file::mapped_output_file::close_file()
+{
+#if defined(CC_OS_WINDOWS)
+    if (_config.sync && _data && !FlushViewOfFile(_data, _size))
+        report("could not sync file");
+    unmap();
+
+    // remove the capacity that was not written
+    LARGE_INTEGER end;
+    end.QuadPart = LONGLONG(_size);
+    if (!SetFilePointerEx(_file_handle, end, nullptr, FILE_BEGIN) || !SetEndOfFile(_file_handle))
+        report("could not truncate file");
+    if (_config.sync && !FlushFileBuffers(_file_handle))
+        report("could not sync file");
+    if (!CloseHandle(_file_handle))
+        report("error closing file");
+    _file_handle = nullptr;
+#else
+    unmap();
+
+    // remove the capacity that was not written
+    if (::ftruncate(_file_descriptor, off_t(_size)) != 0)
+        report("could not truncate file");
+
+    // the written pages are dirty pages of the file in the page cache, so syncing the file suffices
+#if defined(CC_OS_LINUX)
+    if (_config.sync && ::fdatasync(_file_descriptor) != 0)
+        report("could not sync file");
+#else
+    if (_config.sync && ::fsync(_file_descriptor) != 0)
+        report("could not sync file");
+#endif
+    if (::close(_file_descriptor) != 0)
+        report("error closing file");
+    _file_descriptor = -1;
+#endif
+
+    _size = 0;
+}
@@ -1,14 +1,24 @@
 #pragma once
 
+#include <cstdint>
 #include <cstdio>
+#include <cstring>
 
 #include <clean-core/alloc_array.hh>
+#include <clean-core/allocator.hh>
 #include <clean-core/array.hh>
+#include <clean-core/assert.hh>
+#include <clean-core/function_ref.hh>
 #include <clean-core/macros.hh>
 #include <clean-core/native/win32_fwd.hh>
+#include <clean-core/optional.hh>
 #include <clean-core/range_ref.hh>
+#include <clean-core/span.hh>
 #include <clean-core/stream_ref.hh>
+#include <clean-core/string.hh>
 #include <clean-core/string_view.hh>
+#include <clean-core/utility.hh>
+#include <clean-core/vector.hh>
 
 #include <babel-serializer/errors.hh>
 
@@ -20,8 +30,27 @@ bool exists(cc::string_view filename);
 /// returns size of an existing file
 size_t size_of(cc::string_view filename);
 
+struct read_config
+{
+    /// size of each read (and the maximum size of each chunk written to the output stream)
+    size_t buffer_size = 1 << 20;
+
+    /// reads the next chunk on a separate thread while the output stream processes the current one
+    /// NOTE: doubles the buffer memory, mostly worth it if the output stream does significant work (e.g. decompression or parsing)
+    bool read_ahead = false;
+
+    /// tells the OS that the file is read sequentially (e.g. for more aggressive readahead)
+    bool sequential_hint = true;
+
+    /// if set, the xxh64 (seed 0, see babel::hash) of the content is computed while reading
+    /// and a mismatch is reported via on_error once the file is read
+    /// NOTE: the data is already written to the output stream at that point
+    cc::optional<uint64_t> expected_xxh64;
+};
+
 /// reads a file and writes all bytes in the provided stream (buffered)
 void read(cc::stream_ref<std::byte> out, cc::string_view filename, error_handler on_error = default_error_handler);
+void read(cc::stream_ref<std::byte> out, cc::string_view filename, read_config const& cfg, error_handler on_error = default_error_handler);
 
 /// reads a file and returns the content as a string (null terminated)
 cc::string read_all_text(cc::string_view filename, error_handler on_error = default_error_handler);
@@ -32,6 +61,39 @@ cc::array<std::byte> read_all_bytes(cc::string_view filename, error_handler on_e
 /// reads a file and returns the content as an allocator-backed array of chars
 cc::alloc_array<std::byte> read_all_bytes(cc::string_view filename, cc::allocator* alloc, error_handler on_error = default_error_handler);
 
+struct batch_read_config
+{
+    /// number of files that are read concurrently (0 means "use all hardware threads")
+    /// NOTE: more concurrent reads than cores can help if reads are latency-bound (e.g. on network file systems)
+    int thread_count = 0;
+
+    /// maximum number of files in flight, i.e. being read or waiting for on_read
+    /// (bounds the memory if on_read is slower than reading: at most max_pending + 1 buffers are alive)
+    /// 0 means "2 * thread_count"
+    /// NOTE: values below thread_count also limit the number of concurrent reads
+    int max_pending = 0;
+
+    /// allocator of the returned buffers
+    /// NOTE: must be thread-safe, because buffers are allocated by the reading threads
+    cc::allocator* alloc = cc::system_allocator;
+};
+
+/// reads many files concurrently and calls on_read(index, data) for each file as soon as it is read
+/// on_read is called on the calling thread (in completion order, not necessarily the order of filenames),
+/// so processing a file (e.g. decoding an image) overlaps with reading the remaining files
+/// files that cannot be read are reported via on_error (also on the calling thread) and are not passed to on_read
+/// NOTE: exceptions thrown by on_read, on_error, or while reading (e.g. by the allocator) stop the reading and are propagated
+///
+/// usage:
+///
+///   cc::string_view const paths[] = {"a.png", "b.ply", "c.json"};
+///   babel::file::read_all_bytes_batch(paths, [&](size_t i, cc::alloc_array<std::byte> data) { assets[i] = decode(data); });
+///
+void read_all_bytes_batch(cc::span<cc::string_view const> filenames,
+                          cc::function_ref<void(size_t index, cc::alloc_array<std::byte> data)> on_read,
+                          batch_read_config const& cfg = {},
+                          error_handler on_error = default_error_handler);
+
 /// writes the given binary data to a file
 void write(cc::string_view filename, cc::span<std::byte const> data, error_handler on_error = default_error_handler);
 
@@ -41,58 +103,159 @@ void write(cc::string_view filename, cc::string_view data, error_handler on_erro
 /// writes the given lines to a file
 void write_lines(cc::string_view filename, cc::range_ref<cc::string_view> lines, cc::string_view line_ending = "\n", error_handler on_error = default_error_handler);
 
+struct file_output_config
+{
+    /// size of the user-space buffer, smaller writes are batched into a single system call
+    size_t buffer_size = 1 << 20;
+
+    /// expected final size of the file in bytes (0 means "unknown")
+    /// the file is preallocated (fallocate on Linux), which reduces fragmentation and fails early if the disk is full
+    /// NOTE: the file is truncated to the actually written size when closed
+    uint64_t expected_size = 0;
+
+    /// writes to a temporary file next to the target that replaces it only in commit()
+    /// i.e. the target is never seen in a partially written state (e.g. after a crash)
+    /// NOTE: if the stream is destroyed without commit(), the temporary file is removed and the target is untouched
+    bool atomic = false;
+
+    /// flushes the file data to the disk (fdatasync) in commit(), i.e. it survives a power loss once commit() returns
+    bool sync = false;
+
+    /// bypasses the page cache (O_DIRECT on Linux), e.g. for huge files that are not read back soon
+    /// NOTE: falls back to normal writes if the file system does not support it
+    bool direct_io = false;
+};
+
 /// an output file stream that can be used as cc::stream_ref<char>, cc::stream_ref<std::byte>, cc::string_stream_ref
+/// writes are buffered (see file_output_config) and errors are reported via the error handler
 /// NOTE: overwrites existing files
+/// NOTE: a file that cannot be opened is reported via the error handler as well (default_error_handler asserts in debug builds)
+///       to handle this gracefully, pass an error handler that does not assert and check valid()
+/// NOTE: the error handler must outlive this object
+/// NOTE: the dtor calls commit() if it was not called before (except for atomic streams, which are discarded)
+///       errors in the dtor are passed to the error handler but exceptions thrown by it are swallowed,
+///       i.e. commit() must be called to reliably observe errors
 /// NOTE: there is no operator<< because it is really only meant for stream_refs
 ///       if you need convenient stream writing into files, wrap this stream with a babel::experimental::byte_writer
+///
+/// typical usage:
+///
+///   auto cfg = babel::file::file_output_config();
+///   cfg.atomic = true;
+///   auto file = babel::file::file_output_stream("/path/to/export.json", cfg);
+///   babel::json::write(file, value);
+///   if (!file.commit())
+///       ...
+///
 struct file_output_stream
 {
-    explicit file_output_stream(cc::string_view filename);
+    explicit file_output_stream(cc::string_view filename, error_handler on_error = default_error_handler);
+    explicit file_output_stream(cc::string_view filename, file_output_config const& cfg, error_handler on_error = default_error_handler);
     file_output_stream() = default;
+    ~file_output_stream();
 
     // no copying
     file_output_stream(file_output_stream const&) = delete;
     file_output_stream& operator=(file_output_stream const&) = delete;
 
     // moving OK
-    file_output_stream(file_output_stream&& rhs) noexcept
-    {
-        _file = rhs._file;
-        rhs._file = nullptr;
-    }
-    file_output_stream& operator=(file_output_stream&& rhs)
-    {
-        if (_file)
-            std::fclose(_file);
+    // NOTE: move assignment closes this stream first, i.e. the error handler might be called (and throw)
+    file_output_stream(file_output_stream&& rhs) noexcept;
+    file_output_stream& operator=(file_output_stream&& rhs);
 
-        _file = rhs._file;
-        rhs._file = nullptr;
+    void operator()(cc::string_view content) { write(cc::as_byte_span(content)); }
+    void operator()(cc::span<char const> content) { write(cc::as_byte_span(content)); }
+    void operator()(cc::span<std::byte const> content) { write(content); }
 
-        return *this;
-    }
-
-    ~file_output_stream()
+    /// appends data to the file
+    void write(cc::span<std::byte const> data)
     {
-        if (_file)
+        // fast path: small writes are only copied into the buffer
+        if (data.size() <= _buffer_size - _buffer_pos)
         {
-            std::fclose(_file);
-            _file = nullptr;
+            if (!data.empty())
+                std::memcpy(_buffer + _buffer_pos, data.data(), data.size());
+            _buffer_pos += data.size();
         }
+        else
+            write_slow(data);
     }
 
-    void operator()(cc::string_view content) { fwrite(content.data(), 1, content.size(), _file); }
-    void operator()(cc::span<char const> content) { fwrite(content.data(), 1, content.size(), _file); }
-    void operator()(cc::span<std::byte const> content) { fwrite(content.data(), 1, content.size(), _file); }
+    /// writes all buffered data to the file (but does not wait for the disk, see file_output_config::sync)
+    void flush();
 
-    bool valid() const { return _file != nullptr; }
+    /// writes all buffered data, closes the file, and (for atomic streams) replaces the target file
+    /// returns false if any error occurred (the error handler was called in that case)
+    /// NOTE: no data can be written afterwards
+    bool commit();
+
+    /// true if the file is open for writing
+    bool valid() const;
     explicit operator bool() const { return valid(); }
 
+    /// true if any write failed so far
+    bool has_error() const { return _has_error; }
+
 private:
-    FILE* _file = nullptr;
+    void write_slow(cc::span<std::byte const> data);
+    void write_to_file(cc::span<std::byte const> a, cc::span<std::byte const> b = {});
+    void report(cc::string_view message);
+    void close(bool discard);
+    void close_file(bool discard);
+
+#if defined(CC_OS_WINDOWS)
+    std::FILE* _file = nullptr;
+#else
+    int _file_descriptor = -1;
+#endif
+    file_output_config _config;
+    error_handler _on_error = default_error_handler;
+    cc::string _filename;
+    cc::string _temp_filename; // only for atomic streams
+    cc::vector<std::byte> _buffer_storage;
+    std::byte* _buffer = nullptr; // aligned into _buffer_storage (for direct io)
+    size_t _buffer_size = 0;
+    size_t _buffer_pos = 0;
+    uint64_t _file_pos = 0;
+    bool _is_direct = false;
+    bool _has_error = false;
+};
+
+/// expected access pattern of a memory mapped file (used for OS readahead heuristics)
+enum class access_pattern
+{
+    normal,
+    /// pages are accessed in order (aggressive readahead, pages can be freed soon after access)
+    sequential,
+    /// pages are accessed in no particular order (no readahead)
+    random,
+};
+
+struct mmap_config
+{
+    /// hint for the expected access pattern (madvise)
+    access_pattern access = access_pattern::normal;
+
+    /// prefaults all pages while mapping (MAP_POPULATE on Linux)
+    /// makes opening slower but avoids page faults (and their overhead) during later accesses
+    bool populate = false;
+
+    /// requests transparent huge pages for the mapping (MADV_HUGEPAGE on Linux)
+    /// NOTE: only effective if the kernel and file system support huge pages for file mappings
+    bool huge_pages = false;
 };
 
 namespace detail
 {
+enum class mmap_advice
+{
+    normal,
+    sequential,
+    random,
+    willneed,
+    dontneed,
+};
+
 struct mmap_info
 {
 #if defined(CC_OS_WINDOWS)
@@ -104,7 +267,13 @@ struct mmap_info
     size_t byte_size = 0;
     void* data = nullptr;
 };
-mmap_info impl_map_file_to_memory(cc::string_view filepath, bool is_readonly);
+/// returns an empty mmap_info (data == nullptr) if the file could not be mapped (after reporting the error)
+mmap_info impl_map_file_to_memory(cc::string_view filepath, bool is_readonly, mmap_config const& cfg, error_handler on_error);
+
+/// applies the advice to the pages overlapping [offset, offset + size) of the mapping [data, data + byte_size)
+void impl_advise(void* data, size_t byte_size, size_t offset, size_t size, mmap_advice advice);
+bool impl_lock(void* data, size_t byte_size);
+void impl_unlock(void* data, size_t byte_size);
 
 #if defined(CC_OS_WINDOWS)
 void impl_unmap(HANDLE file_handle, HANDLE file_mapping_handle, void* file_view);
@@ -126,6 +295,16 @@ void impl_unmap(void* data, size_t size, int file_descriptor);
 ///                  or: babel::file::make_memory_mapped_file_readonly("/path/to/file");
 ///   auto data = cc::span(mapped_file);
 ///
+/// access hints can reduce the page fault overhead of large files:
+///
+///   auto cfg = babel::file::mmap_config();
+///   cfg.access = babel::file::access_pattern::sequential;
+///   auto mapped_file = babel::file::make_memory_mapped_file_readonly("/path/to/huge.ply", cfg);
+///   mapped_file.prefetch(0, 64 << 20); // start reading the first 64 MB in the background
+///
+/// NOTE: all hints are best-effort and silently ignored where not supported
+/// NOTE: failing to map the file is reported via the error handler (default_error_handler asserts in debug builds)
+///       and leaves the mapping empty (data() == nullptr)
 template <class T>
 struct memory_mapped_file
 {
@@ -179,9 +358,9 @@ public:
         return *this;
     }
 
-    explicit memory_mapped_file(cc::string_view filepath)
+    explicit memory_mapped_file(cc::string_view filepath, mmap_config const& cfg = {}, error_handler on_error = default_error_handler)
     {
-        auto const info = detail::impl_map_file_to_memory(filepath, std::is_const_v<T>);
+        auto const info = detail::impl_map_file_to_memory(filepath, std::is_const_v<T>, cfg, on_error);
 #if defined(CC_OS_WINDOWS)
         _file_handle = info.file_handle;
         _file_mapping_handle = info.file_mapping_handle;
@@ -192,6 +371,30 @@ public:
         _data = cc::span<T>{static_cast<T*>(info.data), info.byte_size / sizeof(T)};
     }
 
+    /// changes the expected access pattern of the whole mapping
+    void advise(access_pattern access)
+    {
+        auto const advice = access == access_pattern::sequential ? detail::mmap_advice::sequential
+                            : access == access_pattern::random   ? detail::mmap_advice::random
+                                                                 : detail::mmap_advice::normal;
+        detail::impl_advise(raw_data(), size_bytes(), 0, size_bytes(), advice);
+    }
+
+    /// asynchronously reads the pages overlapping the byte range [byte_offset, byte_offset + byte_size) (e.g. before they are accessed)
+    void prefetch(size_t byte_offset, size_t byte_size) { detail::impl_advise(raw_data(), size_bytes(), byte_offset, byte_size, detail::mmap_advice::willneed); }
+    void prefetch() { prefetch(0, size_bytes()); }
+
+    /// releases the pages overlapping the byte range [byte_offset, byte_offset + byte_size) (e.g. after they were processed)
+    /// the data stays valid, evicted pages are read from the file again on the next access
+    /// NOTE: modifications of read-write mappings are kept (they are written to the file)
+    void evict(size_t byte_offset, size_t byte_size) { detail::impl_advise(raw_data(), size_bytes(), byte_offset, byte_size, detail::mmap_advice::dontneed); }
+    void evict() { evict(0, size_bytes()); }
+
+    /// locks all pages in physical memory (mlock), i.e. accesses never cause page faults
+    /// returns false if locking failed (e.g. because of the RLIMIT_MEMLOCK limit)
+    bool lock() { return detail::impl_lock(raw_data(), size_bytes()); }
+    void unlock() { detail::impl_unlock(raw_data(), size_bytes()); }
+
     ~memory_mapped_file()
     {
         // the const cast is ok here because mmap() / MapViewOfFile() returned a void* in the first place
@@ -203,6 +406,9 @@ public:
     }
 
 private:
+    // the const cast is ok here because mmap() / MapViewOfFile() returned a void* in the first place
+    void* raw_data() const { return const_cast<void*>(static_cast<void const*>(_data.data())); }
+
 #if defined(CC_OS_WINDOWS)
     HANDLE _file_handle = nullptr;
     HANDLE _file_mapping_handle = nullptr;
@@ -214,8 +420,318 @@ private:
 };
 
 /// creates a memory-mapped file with read and write access
-memory_mapped_file<std::byte> make_memory_mapped_file_readwrite(cc::string_view path);
+memory_mapped_file<std::byte> make_memory_mapped_file_readwrite(cc::string_view path, mmap_config const& cfg = {});
 
 /// creates a memory-mapped file with read access
-memory_mapped_file<std::byte const> make_memory_mapped_file_readonly(cc::string_view path);
+memory_mapped_file<std::byte const> make_memory_mapped_file_readonly(cc::string_view path, mmap_config const& cfg = {});
+
+struct read_bytes_config
+{
+    /// files of at least this size are memory mapped, smaller files are read into a heap buffer
+    /// (mapping has a fixed cost for the system calls and page faults, which dominates for small files)
+    size_t mmap_threshold = 1 << 20;
+
+    /// configuration of the mapping (e.g. the access pattern of the reader)
+    mmap_config mapping = {access_pattern::sequential};
+
+    /// allocator of the heap buffer
+    cc::allocator* alloc = cc::system_allocator;
+
+    /// if set, the xxh64 (seed 0, see babel::hash) of the content is verified after reading
+    /// a mismatch is reported via on_error and an empty result is returned
+    /// NOTE: this touches the whole file, i.e. mapped files are paged in completely
+    cc::optional<uint64_t> expected_xxh64;
+};
+
+/// the read-only content of a file, which is memory mapped (large files) or stored in a heap buffer (small files)
+/// this type is owning and convertible to cc::span<std::byte const> (which all babel readers take)
+/// NOTE: mapped content reflects later modifications of the file (and accessing it after the file was truncated crashes)
+struct file_bytes
+{
+    std::byte const* data() const { return _data.data(); }
+    size_t size() const { return _data.size(); }
+    bool empty() const { return _data.empty(); }
+
+    std::byte const* begin() const { return _data.data(); }
+    std::byte const* end() const { return _data.data() + _data.size(); }
+
+    /// true if the content is memory mapped (i.e. not copied into memory)
+    bool is_mapped() const { return _mapped.data() != nullptr; }
+
+    file_bytes() = default;
+    file_bytes(file_bytes const&) = delete;
+    file_bytes& operator=(file_bytes const&) = delete;
+    file_bytes(file_bytes&& rhs) noexcept { *this = cc::move(rhs); }
+    file_bytes& operator=(file_bytes&& rhs) noexcept
+    {
+        _buffer = cc::move(rhs._buffer);
+        _mapped = cc::move(rhs._mapped);
+        _data = rhs._data;
+        rhs._data = {};
+        return *this;
+    }
+
+private:
+    cc::alloc_array<std::byte> _buffer;
+    memory_mapped_file<std::byte const> _mapped;
+    cc::span<std::byte const> _data;
+
+    friend file_bytes read_all_bytes(cc::string_view filename, read_bytes_config const& cfg, error_handler on_error);
+};
+
+/// reads a file without copying it into memory if it is large (see read_bytes_config)
+/// i.e. the peak memory of loading a huge file is not doubled by holding both the file content and the parsed result
+/// typical usage:
+///
+///   auto data = babel::file::read_all_bytes("/path/to/huge.ply", babel::file::read_bytes_config{});
+///   auto mesh = babel::ply::read(data);
+///
+file_bytes read_all_bytes(cc::string_view filename, read_bytes_config const& cfg, error_handler on_error = default_error_handler);
+
+/// a part of a file mapped by windowed_file
+struct file_window
+{
+    /// offset of data in the file
+    uint64_t offset = 0;
+    cc::span<std::byte const> data;
+};
+
+/// a read-only memory mapping of a (possibly huge) file that only maps a window (sub-range) at a time
+/// in contrast to memory_mapped_file, the reserved address space and the mapped pages are bounded by the window size
+/// typical usage:
+///
+///   auto file = babel::file::windowed_file("/path/to/huge.pcap");
+///   for (auto const& w : file.windows(256 << 20, 1 << 20)) // 256 MB windows, overlapping by 1 MB
+///       process(w.offset, w.data);
+///
+///   auto header = file.map(0, 1024); // random access
+///
+/// NOTE: mapping a window unmaps the previous one, i.e. only the last returned data is valid
+/// NOTE: windows are internally aligned to the OS mapping granularity (but returned spans are exact)
+/// NOTE: failed mappings are reported via the error handler (i.e. a window iteration that ends early is not silent)
+///       thus the error handler must outlive this object
+struct windowed_file
+{
+    struct window_sentinel
+    {
+    };
+
+    struct window_iterator
+    {
+        file_window const& operator*() const { return _window; }
+        file_window const* operator->() const { return &_window; }
+        window_iterator& operator++();
+        bool operator!=(window_sentinel) const { return !_is_end; }
+        bool operator==(window_sentinel) const { return _is_end; }
+
+    private:
+        window_iterator(windowed_file* file, size_t window_size, size_t overlap);
+
+        windowed_file* _file = nullptr;
+        size_t _window_size = 0;
+        size_t _overlap = 0;
+        file_window _window;
+        bool _is_end = false;
+
+        friend struct windowed_file;
+    };
+
+    struct window_range
+    {
+        window_iterator begin() const { return window_iterator(_file, _window_size, _overlap); }
+        window_sentinel end() const { return {}; }
+
+    private:
+        windowed_file* _file;
+        size_t _window_size;
+        size_t _overlap;
+
+        friend struct windowed_file;
+    };
+
+    windowed_file() = default;
+    explicit windowed_file(cc::string_view filepath, mmap_config const& cfg = {}, error_handler on_error = default_error_handler);
+    ~windowed_file();
+
+    windowed_file(windowed_file const&) = delete;
+    windowed_file& operator=(windowed_file const&) = delete;
+    windowed_file(windowed_file&& rhs) noexcept;
+    windowed_file& operator=(windowed_file&& rhs) noexcept;
+
+    bool valid() const;
+    explicit operator bool() const { return valid(); }
+
+    /// size of the whole file in bytes
+    uint64_t size() const { return _file_size; }
+
+    /// maps the range [offset, offset + size) (clamped to the file) and returns its data
+    /// returns an empty span if mapping failed (which is reported via the error handler)
+    cc::span<std::byte const> map(uint64_t offset, size_t size);
+
+    /// true if opening the file or mapping any window failed so far
+    bool has_error() const { return _has_error; }
+
+    /// the currently mapped window
+    file_window current() const { return _window; }
+
+    /// unmaps the current window (e.g. to release address space between accesses)
+    void unmap();
+
+    /// iterates over the whole file in windows of window_size bytes (the last one might be smaller),
+    /// where each window starts overlap bytes before the end of the previous one
+    /// (e.g. so that records crossing a window boundary are fully contained in the next window)
+    window_range windows(size_t window_size, size_t overlap = 0)
+    {
+        CC_ASSERT(overlap < window_size && "overlap must be smaller than the window size");
+        window_range r;
+        r._file = this;
+        r._window_size = window_size;
+        r._overlap = overlap;
+        return r;
+    }
+
+private:
+    void release();
+    void report_map_error(uint64_t offset, size_t size);
+
+#if defined(CC_OS_WINDOWS)
+    HANDLE _file_handle = nullptr;
+    HANDLE _file_mapping_handle = nullptr;
+#else
+    int _file_descriptor = -1;
+#endif
+    mmap_config _config;
+    error_handler _on_error = default_error_handler;
+    cc::string _filename;
+    uint64_t _file_size = 0;
+    void* _view = nullptr; // aligned start of the mapping
+    size_t _view_size = 0;
+    file_window _window;
+    bool _has_error = false;
+};
+
+struct mapped_output_config
+{
+    /// initial size of the file (and the mapping) in bytes, e.g. an upper bound of the output size if known
+    /// writes beyond the capacity at least double it
+    uint64_t initial_capacity = 1 << 20;
+
+    /// reserves the disk space for the capacity (posix_fallocate on Linux)
+    /// without this, writing to the mapping of a full disk crashes with SIGBUS instead of reporting an error
+    bool preallocate = true;
+
+    /// flushes the file data to the disk in commit(), i.e. it survives a power loss once commit() returns
+    bool sync = false;
+};
+
+/// a writable memory mapping of a new file that grows on demand
+/// data is written directly into the page cache, i.e. without an intermediate buffer and without write() copies
+/// can be used as cc::stream_ref<char>, cc::stream_ref<std::byte>, cc::string_stream_ref (like file_output_stream)
+/// or filled directly via allocate() / reserve() + data() (e.g. with compress_to or a fixed-size binary layout)
+/// NOTE: overwrites existing files
+/// NOTE: the file is truncated to size() when closed
+/// NOTE: growing may move the mapping, i.e. spans returned by data() and allocate() are invalidated by reserve(), allocate(), and writes
+/// NOTE: the dtor calls commit() if it was not called before
+///       errors in the dtor are passed to the error handler but exceptions thrown by it are swallowed,
+///       i.e. commit() must be called to reliably observe errors
+///
+/// typical usage:
+///
+///   auto file = babel::file::mapped_output_file("/path/to/export.json");
+///   babel::json::write(file, value);
+///   if (!file.commit())
+///       ...
+///
+///   auto file = babel::file::mapped_output_file("/path/to/data.zst");
+///   file.reserve(babel::zstd::compress_bound(data.size()));
+///   file.resize(babel::zstd::compress_to(file.data(), data));
+///
+struct mapped_output_file
+{
+    explicit mapped_output_file(cc::string_view filename, error_handler on_error = default_error_handler);
+    explicit mapped_output_file(cc::string_view filename, mapped_output_config const& cfg, error_handler on_error = default_error_handler);
+    mapped_output_file() = default;
+    ~mapped_output_file();
+
+    // no copying
+    mapped_output_file(mapped_output_file const&) = delete;
+    mapped_output_file& operator=(mapped_output_file const&) = delete;
+
+    // moving OK
+    // NOTE: move assignment closes this file first, i.e. the error handler might be called (and throw)
+    mapped_output_file(mapped_output_file&& rhs) noexcept;
+    mapped_output_file& operator=(mapped_output_file&& rhs);
+
+    void operator()(cc::string_view content) { write(cc::as_byte_span(content)); }
+    void operator()(cc::span<char const> content) { write(cc::as_byte_span(content)); }
+    void operator()(cc::span<std::byte const> content) { write(content); }
+
+    /// appends data to the file
+    void write(cc::span<std::byte const> data)
+    {
+        auto const target = allocate(data.size());
+        if (!target.empty())
+            std::memcpy(target.data(), data.data(), data.size());
+    }
+
+    /// appends n bytes (uninitialized) to the file and returns them for writing
+    /// returns an empty span on error
+    cc::span<std::byte> allocate(size_t n)
+    {
+        // grows geometrically, so that many small writes remap only O(log n) times
+        if (n > _capacity - _size && !reserve(cc::max(_size + n, 2 * _capacity)))
+            return {};
+        auto const res = cc::span<std::byte>(_data + _size, n);
+        _size += n;
+        return res;
+    }
+
+    /// ensures that the file can hold at least the given number of bytes without remapping
+    /// (the file grows to exactly this size, which is truncated to size() when closed)
+    /// returns false on error
+    bool reserve(size_t capacity);
+
+    /// sets the size of the file (growing the mapping if required, new bytes are uninitialized)
+    /// returns false on error
+    bool resize(size_t size);
+
+    /// the whole mapped capacity (the first size() bytes are the written content)
+    cc::span<std::byte> data() const { return {_data, _capacity}; }
+
+    /// the current size of the file content in bytes
+    size_t size() const { return _size; }
+    size_t capacity() const { return _capacity; }
+
+    /// unmaps the data, truncates the file to size(), and closes it
+    /// returns false if any error occurred (the error handler was called in that case)
+    /// NOTE: no data can be written afterwards
+    bool commit();
+
+    /// true if the file is open for writing
+    bool valid() const;
+    explicit operator bool() const { return valid(); }
+
+    /// true if any operation failed so far
+    bool has_error() const { return _has_error; }
+
+private:
+    void report(cc::string_view message);
+    void close();
+    void close_file();
+    void unmap();
+
+#if defined(CC_OS_WINDOWS)
+    HANDLE _file_handle = nullptr;
+    HANDLE _file_mapping_handle = nullptr;
+#else
+    int _file_descriptor = -1;
+#endif
+    mapped_output_config _config;
+    error_handler _on_error = default_error_handler;
+    cc::string _filename;
+    std::byte* _data = nullptr;
+    size_t _size = 0;
+    size_t _capacity = 0;
+    bool _has_error = false;
+};
 }
@@ -0,0 +1,110 @@
+#include "hash.hh"
+
+#include <clean-core/assert.hh>
+
+#include <babel-serializer/file.hh>
+
+#include <zstd/common/xxhash.h>
+
+uint64_t babel::hash::xxh64(cc::span<std::byte const> data, uint64_t seed) { return ZSTD_XXH64(data.data(), data.size(), seed); }
+
+uint32_t babel::hash::xxh32(cc::span<std::byte const> data, uint32_t seed) { return ZSTD_XXH32(data.data(), data.size(), seed); }
+
+uint64_t babel::hash::xxh64_file(cc::string_view filename, uint64_t seed, error_handler on_error)
+{
+    auto hasher = xxh64_stream(seed);
+    file::read(hasher, filename, on_error);
+    return hasher.digest();
+}
+
+babel::hash::xxh64_stream::xxh64_stream(uint64_t seed)
+{
+    _state = ZSTD_XXH64_createState();
+    CC_ASSERT(_state && "unable to create xxhash state");
+    ZSTD_XXH64_reset(_state, seed);
+}
+
+babel::hash::xxh64_stream::~xxh64_stream()
+{
+    if (_state)
+        ZSTD_XXH64_freeState(_state);
+}
+
+babel::hash::xxh64_stream::xxh64_stream(xxh64_stream&& rhs) noexcept
+{
+    _state = rhs._state;
+    rhs._state = nullptr;
+}
+
+babel::hash::xxh64_stream& babel::hash::xxh64_stream::operator=(xxh64_stream&& rhs) noexcept
+{
+    if (_state)
+        ZSTD_XXH64_freeState(_state);
+    _state = rhs._state;
+    rhs._state = nullptr;
+    return *this;
+}
+
+void babel::hash::xxh64_stream::operator()(cc::span<std::byte const> data)
+{
+    CC_ASSERT(_state && "stream was moved from");
+    ZSTD_XXH64_update(_state, data.data(), data.size());
+}
+
+uint64_t babel::hash::xxh64_stream::digest() const
+{
+    CC_ASSERT(_state && "stream was moved from");
+    return ZSTD_XXH64_digest(_state);
+}
+
+void babel::hash::xxh64_stream::reset(uint64_t seed)
+{
+    CC_ASSERT(_state && "stream was moved from");
+    ZSTD_XXH64_reset(_state, seed);
+}
+
+babel::hash::xxh32_stream::xxh32_stream(uint32_t seed)
+{
+    _state = ZSTD_XXH32_createState();
+    CC_ASSERT(_state && "unable to create xxhash state");
+    ZSTD_XXH32_reset(_state, seed);
+}
+
+babel::hash::xxh32_stream::~xxh32_stream()
+{
+    if (_state)
+        ZSTD_XXH32_freeState(_state);
+}
+
+babel::hash::xxh32_stream::xxh32_stream(xxh32_stream&& rhs) noexcept
+{
+    _state = rhs._state;
+    rhs._state = nullptr;
+}
+
+babel::hash::xxh32_stream& babel::hash::xxh32_stream::operator=(xxh32_stream&& rhs) noexcept
+{
+    if (_state)
+        ZSTD_XXH32_freeState(_state);
+    _state = rhs._state;
+    rhs._state = nullptr;
+    return *this;
+}
+
+void babel::hash::xxh32_stream::operator()(cc::span<std::byte const> data)
+{
+    CC_ASSERT(_state && "stream was moved from");
+    ZSTD_XXH32_update(_state, data.data(), data.size());
+}
+
+uint32_t babel::hash::xxh32_stream::digest() const
+{
+    CC_ASSERT(_state && "stream was moved from");
+    return ZSTD_XXH32_digest(_state);
+}
+
+void babel::hash::xxh32_stream::reset(uint32_t seed)
+{
+    CC_ASSERT(_state && "stream was moved from");
+    ZSTD_XXH32_reset(_state, seed);
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <clean-core/span.hh>
+#include <clean-core/string_view.hh>
+
+#include <babel-serializer/errors.hh>
+
+// fwd (xxhash states, vendored with zstd)
+struct ZSTD_XXH32_state_s;
+struct ZSTD_XXH64_state_s;
+
+// fast non-cryptographic hashing (xxhash)
+// suited for checksums and content hashing, NOT for security-relevant purposes
+//
+// usage:
+//
+//   auto h = babel::hash::xxh64(data);
+//
+//   auto hasher = babel::hash::xxh64_stream();
+//   babel::file::read(hasher, "data.bin"); // or hasher(some_data);
+//   auto h = hasher.digest();
+
+namespace babel::hash
+{
+/// computes the 64 bit xxhash of the given data
+uint64_t xxh64(cc::span<std::byte const> data, uint64_t seed = 0);
+
+/// computes the 32 bit xxhash of the given data
+/// NOTE: xxh64 is faster on 64 bit platforms
+uint32_t xxh32(cc::span<std::byte const> data, uint32_t seed = 0);
+
+/// computes the 64 bit xxhash of a file (without reading it into memory)
+uint64_t xxh64_file(cc::string_view filename, uint64_t seed = 0, error_handler on_error = default_error_handler);
+
+/// a streaming 64 bit xxhash
+/// data is pushed via operator() (thus it can be used as a cc::stream_ref<std::byte>)
+/// the result is the same as for xxh64 over the concatenated data
+struct xxh64_stream
+{
+    explicit xxh64_stream(uint64_t seed = 0);
+    ~xxh64_stream();
+
+    xxh64_stream(xxh64_stream const&) = delete;
+    xxh64_stream& operator=(xxh64_stream const&) = delete;
+    xxh64_stream(xxh64_stream&& rhs) noexcept;
+    xxh64_stream& operator=(xxh64_stream&& rhs) noexcept;
+
+    void operator()(cc::span<std::byte const> data);
+
+    /// returns the hash of all data pushed so far (more data can be pushed afterwards)
+    uint64_t digest() const;
+
+    /// restarts hashing with the given seed
+    void reset(uint64_t seed = 0);
+
+private:
+    ZSTD_XXH64_state_s* _state = nullptr;
+};
+
+/// a streaming 32 bit xxhash (see xxh64_stream)
+struct xxh32_stream
+{
+    explicit xxh32_stream(uint32_t seed = 0);
+    ~xxh32_stream();
+
+    xxh32_stream(xxh32_stream const&) = delete;
+    xxh32_stream& operator=(xxh32_stream const&) = delete;
+    xxh32_stream(xxh32_stream&& rhs) noexcept;
+    xxh32_stream& operator=(xxh32_stream&& rhs) noexcept;
+
+    void operator()(cc::span<std::byte const> data);
+
+    /// returns the hash of all data pushed so far (more data can be pushed afterwards)
+    uint32_t digest() const;
+
+    /// restarts hashing with the given seed
+    void reset(uint32_t seed = 0);
+
+private:
+    ZSTD_XXH32_state_s* _state = nullptr;
+};
+}
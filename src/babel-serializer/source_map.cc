@@ -1,8 +1,14 @@
 #include "source_map.hh"
 
+#include <clean-core/bits.hh>
 #include <clean-core/char_predicates.hh>
 #include <clean-core/utility.hh>
 
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define BABEL_SOURCE_MAP_SSE2
+#endif
+
 babel::source_map::source_map(cc::string_view source) { parse(source); }
 
 babel::source_map::source_map(cc::span<const std::byte> source)
@@ -13,15 +19,30 @@ babel::source_map::source_map(cc::span<const std::byte> source)
 int babel::source_map::line_of(const char* c) const
 {
     CC_ASSERT(c >= &_source.front() && c <= &_source.back() && "char not in source");
-    auto idx = -1;
-    for (auto l : _lines)
-    {
-        if (c < l.data())
-            return idx;
+    if (_line_starts.empty())
+        return -1;
 
-        ++idx;
+    // binary search for the last line starting at or before c
+    auto const offset = size_t(c - _source.data());
+    size_t lo = 0;
+    size_t hi = _line_starts.size();
+    while (hi - lo > 1)
+    {
+        auto const mid = lo + (hi - lo) / 2;
+        if (_line_starts[mid] <= offset)
+            lo = mid;
+        else
+            hi = mid;
     }
-    return int(_lines.size() - 1);
+    return int(lo);
+}
+
+int babel::source_map::column_of(const char* c) const
+{
+    auto const line = line_of(c);
+    if (line < 0)
+        return int(c - _source.data());
+    return int(size_t(c - _source.data()) - _line_starts[line]);
 }
 
 void babel::source_map::parse(cc::string_view source)
@@ -32,27 +53,69 @@ void babel::source_map::parse(cc::string_view source)
     if (source.empty())
         return;
 
-    char const* line_start = source.begin();
-    for (auto const& c : source)
+    auto const begin = source.begin();
+    auto const end = source.end();
+    char const* line_start = begin;
+
+    auto add_line = [&](char const* line_end)
     {
-        if (c < 0x20 && c != '\n' && c != '\t' && c != '\r')
+        _line_starts.push_back(size_t(line_start - begin));
+        _lines.push_back(cc::string_view(line_start, line_end).trim('\r'));
+    };
+
+    // returns false if the source is binary
+    // NOTE: only control chars (including '\n') need to be inspected
+    auto handle_control_char = [&](char const* p) -> bool
+    {
+        auto const c = *p;
+        if (c == '\n')
         {
-            _is_binary = true;
-            _lines.clear();
-            return;
+            add_line(p);
+            line_start = p + 1;
+            return true;
         }
+        return c == '\t' || c == '\r';
+    };
 
-        if (c == '\n')
+    auto mark_binary = [&]
+    {
+        _is_binary = true;
+        _lines.clear();
+        _line_starts.clear();
+    };
+
+    auto p = begin;
+
+#ifdef BABEL_SOURCE_MAP_SSE2
+    // 16 chars at a time, most blocks have no control chars at all
+    // NOTE: the signed comparison matches "c < 0x20" for (signed) char, i.e. also flags bytes >= 0x80
+    auto const threshold = _mm_set1_epi8(0x20);
+    for (; end - p >= 16; p += 16)
+    {
+        auto const block = _mm_loadu_si128(reinterpret_cast<__m128i const*>(p));
+        auto mask = unsigned(_mm_movemask_epi8(_mm_cmplt_epi8(block, threshold)));
+        while (mask != 0)
         {
-            auto sv = cc::string_view(line_start, &c);
-            _lines.push_back(sv.trim('\r'));
-            line_start = &c + 1;
+            auto const i = cc::count_trailing_zeros(mask);
+            if (!handle_control_char(p + i))
+            {
+                mark_binary();
+                return;
+            }
+            mask &= mask - 1;
         }
     }
+#endif
 
-    if (line_start != source.end())
+    for (; p != end; ++p)
     {
-        auto sv = cc::string_view(line_start, source.end());
-        _lines.push_back(sv.trim('\r'));
+        if (*p < 0x20 && !handle_control_char(p))
+        {
+            mark_binary();
+            return;
+        }
     }
+
+    if (line_start != end)
+        add_line(end);
 }
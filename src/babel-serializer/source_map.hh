@@ -9,6 +9,7 @@ namespace babel
 /// creates a line/column source map from string or byte span
 /// NOTE: - lines and columns are 0-based
 ///       - this is a "borrow" type and does NOT own the source
+///       - building the map is a single (vectorized) pass over the source, lookups are O(log(line count))
 struct source_map
 {
     source_map() = default;
@@ -20,12 +21,20 @@ struct source_map
     /// returns 0-based line index of given char
     int line_of(char const* c) const;
 
+    /// returns 0-based column (byte offset in its line) of given char
+    int column_of(char const* c) const;
+
     bool is_binary() const { return _is_binary; }
 
+    /// the source this map was created from
+    cc::string_view source() const { return _source; }
+
 private:
     cc::string_view _source;
     // string views on all lines in the source
     cc::vector<cc::string_view> _lines;
+    // offset of the first char of each line in the source (sorted, not affected by trimming)
+    cc::vector<size_t> _line_starts;
 
     bool _is_binary = false;
 
@@ -0,0 +1,75 @@
+#include <nexus/fuzz_test.hh>
+
+#include <babel-serializer/compression/adaptive.hh>
+#include <babel-serializer/errors.hh>
+
+FUZZ_TEST("adaptive fuzzer")(tg::rng& rng)
+{
+    // mixed data: compressible, moderately compressible and random sections
+    cc::vector<std::byte> orig_data;
+    auto section_count = uniform(rng, 0, 5);
+    for (auto s = 0; s < section_count; ++s)
+    {
+        auto const max_value = uniform(rng) ? 255 : uniform(rng, 0, 30);
+        auto const size = uniform(rng, 0, 50000);
+        for (auto i = 0; i < size; ++i)
+            orig_data.push_back(std::byte(uniform(rng, 0, max_value)));
+    }
+
+    auto cfg = babel::compression::adaptive_config();
+    cfg.chunk_size = uniform(rng, 1000, 60000);
+
+    auto comp_data = babel::compression::compress_adaptive(orig_data, cfg);
+    CHECK(babel::compression::is_adaptive(comp_data));
+    CHECK(babel::compression::uncompress_adaptive(comp_data) == orig_data);
+}
+
+TEST("adaptive method choice")
+{
+    tg::rng rng;
+
+    auto random_data = cc::vector<std::byte>(100000);
+    for (auto& d : random_data)
+        d = std::byte(uniform(rng, 0, 255));
+
+    auto constant_data = cc::vector<std::byte>::filled(100000, std::byte(7));
+
+    CHECK(babel::compression::estimate_entropy(constant_data) == 0);
+    CHECK(babel::compression::estimate_entropy(random_data) > 7.9);
+
+    CHECK(babel::compression::choose_method(random_data) == babel::compression::adaptive_method::store);
+    CHECK(babel::compression::choose_method(constant_data) == babel::compression::adaptive_method::zstd);
+
+    // random data is stored, i.e. only grows by the headers
+    auto comp_data = babel::compression::compress_adaptive(random_data);
+    CHECK(comp_data.size() == random_data.size() + 4 + 9);
+}
+
+TEST("adaptive errors")
+{
+    auto make_chunks = [](babel::compression::adaptive_method method, uint32_t uncompressed_size, size_t count)
+    {
+        cc::vector<std::byte> data = {std::byte('B'), std::byte('A'), std::byte('B'), std::byte(0x01)};
+        for (size_t i = 0; i < count; ++i)
+        {
+            data.push_back(std::byte(method));
+            for (auto b = 0; b < 4; ++b)
+                data.push_back(std::byte(uncompressed_size >> (8 * b)));
+            for (auto b = 0; b < 4; ++b)
+                data.push_back(std::byte(0)); // stored size
+        }
+        return data;
+    };
+
+    // chunk headers claiming sizes that cannot be produced by their payload are rejected before allocating
+    for (auto method : {babel::compression::adaptive_method::store, babel::compression::adaptive_method::lz4, babel::compression::adaptive_method::zstd})
+    {
+        auto errors = babel::error_collector();
+        CHECK(babel::compression::uncompress_adaptive(make_chunks(method, 0xFFFFFFFF, 300), errors).empty());
+        CHECK(errors.error_count() == 1);
+    }
+
+    auto errors = babel::error_collector();
+    CHECK(babel::compression::uncompress_adaptive(make_chunks(babel::compression::adaptive_method::store, 0, 3), errors).empty());
+    CHECK(errors.error_count() == 0);
+}
@@ -0,0 +1,64 @@
+#include <nexus/fuzz_test.hh>
+
+#include <clean-core/string_view.hh>
+#include <clean-core/utility.hh>
+
+#include <babel-serializer/compression/codec.hh>
+#include <babel-serializer/file.hh>
+
+FUZZ_TEST("compression codec fuzzer")(tg::rng& rng)
+{
+    auto orig_data = cc::vector<std::byte>(uniform(rng, 0, 100000));
+    for (auto& d : orig_data)
+        d = std::byte(uniform(rng, 0, 3));
+
+    babel::compression::codec const codecs[] = {babel::compression::codec::zstd, babel::compression::codec::lz4, babel::compression::codec::snappy};
+    auto c = codecs[uniform(rng, 0, 2)];
+
+    auto comp_data = babel::compression::compress(orig_data, c);
+    CHECK(babel::compression::detect(comp_data) == c);
+    CHECK(babel::compression::uncompress(comp_data) == orig_data);
+
+    // auto-detecting stream in random chunks
+    cc::vector<std::byte> uncomp_data;
+    auto append = [&](cc::span<std::byte const> d)
+    {
+        for (auto b : d)
+            uncomp_data.push_back(b);
+    };
+    auto decompressor = babel::compression::decompress_stream(append);
+    size_t pos = 0;
+    while (pos < comp_data.size())
+    {
+        auto n = cc::min(size_t(uniform(rng, 0, 20)), comp_data.size() - pos);
+        decompressor(cc::span<std::byte const>(comp_data).subspan(pos, n));
+        pos += n;
+    }
+    CHECK(decompressor.finish());
+    CHECK(decompressor.detected_codec() == c);
+    CHECK(orig_data == uncomp_data);
+}
+
+TEST("compression codec uncompressed")
+{
+    auto text = cc::string_view("abc");
+    CHECK(babel::compression::detect(cc::as_byte_span(text)) == babel::compression::codec::none);
+    CHECK(babel::compression::uncompress(cc::as_byte_span(text)).size() == 3);
+
+    CHECK(babel::compression::from_extension("mesh.ply.zst") == babel::compression::codec::zstd);
+    CHECK(babel::compression::from_extension("data.lz4") == babel::compression::codec::lz4);
+    CHECK(babel::compression::from_extension("data.json") == babel::compression::codec::none);
+}
+
+TEST("compression codec read file")
+{
+    auto tmp_file = "_tmp_babel_compression";
+    auto text = cc::string_view("{ \"hello\": \"world\" }");
+
+    for (auto c : {babel::compression::codec::none, babel::compression::codec::zstd, babel::compression::codec::lz4, babel::compression::codec::snappy})
+    {
+        babel::file::write(tmp_file, babel::compression::compress(cc::as_byte_span(text), c));
+        CHECK(babel::compression::read_all_text(tmp_file) == text);
+        CHECK(babel::compression::read_all_bytes(tmp_file).size() == text.size());
+    }
+}
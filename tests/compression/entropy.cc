@@ -0,0 +1,73 @@
+#include <nexus/fuzz_test.hh>
+
+#include <babel-serializer/compression/entropy.hh>
+#include <babel-serializer/errors.hh>
+
+FUZZ_TEST("entropy fuzzer")(tg::rng& rng)
+{
+    // mixes skewed, constant, and random regions (i.e. compressed, rle, and raw blocks)
+    auto orig_data = cc::vector<std::byte>(uniform(rng, 0, 400000));
+    auto const mode = uniform(rng, 0, 2);
+    for (size_t i = 0; i < orig_data.size(); ++i)
+    {
+        auto const region = (i / 50000 + mode) % 3;
+        if (region == 0)
+            orig_data[i] = std::byte(uniform(rng, 0, 1) * uniform(rng, 0, 1) * uniform(rng, 0, 15));
+        else if (region == 1)
+            orig_data[i] = std::byte(7);
+        else
+            orig_data[i] = std::byte(uniform(rng, 0, 255));
+    }
+
+    auto const c = uniform(rng) ? babel::entropy::coder::fse : babel::entropy::coder::huffman;
+    auto comp_data = babel::entropy::compress(orig_data, c);
+    CHECK(comp_data.size() <= babel::entropy::compress_bound(orig_data.size()));
+    CHECK(babel::entropy::uncompressed_size(comp_data) == orig_data.size());
+    CHECK(babel::entropy::uncompress(comp_data) == orig_data);
+
+    auto uncomp_data = cc::vector<std::byte>::uninitialized(orig_data.size());
+    CHECK(babel::entropy::uncompress_to(uncomp_data, comp_data));
+    CHECK(uncomp_data == orig_data);
+}
+
+TEST("entropy compression ratio")
+{
+    auto orig_data = cc::vector<std::byte>(100000);
+    for (size_t i = 0; i < orig_data.size(); ++i)
+        orig_data[i] = std::byte((i * 7919) % 13 == 0 ? i % 5 : 0);
+
+    CHECK(babel::entropy::compress(orig_data, babel::entropy::coder::huffman).size() < orig_data.size() / 4);
+    CHECK(babel::entropy::compress(orig_data, babel::entropy::coder::fse).size() < orig_data.size() / 4);
+}
+
+TEST("entropy errors")
+{
+    auto errors = babel::error_collector();
+
+    auto orig_data = cc::vector<std::byte>(10000);
+    for (size_t i = 0; i < orig_data.size(); ++i)
+        orig_data[i] = std::byte(i % 3);
+
+    auto comp_data = babel::entropy::compress(orig_data);
+
+    auto truncated = babel::entropy::compress(orig_data);
+    truncated.pop_back();
+    CHECK(babel::entropy::uncompress(truncated, errors).empty());
+    CHECK(errors.error_count() == 1);
+
+    auto wrong_size = cc::vector<std::byte>::uninitialized(orig_data.size() - 1);
+    CHECK(!babel::entropy::uncompress_to(wrong_size, comp_data, errors));
+    CHECK(errors.error_count() == 2);
+
+    comp_data[0] = std::byte(17);
+    CHECK(babel::entropy::uncompress(comp_data, errors).empty());
+    CHECK(errors.error_count() == 3);
+
+    // a header claiming a huge size is rejected before allocating
+    auto huge = cc::vector<std::byte>::filled(9, std::byte(0));
+    huge[5] = std::byte(0x10); // ~68 GB
+    CHECK(babel::entropy::uncompress(huge, errors).empty());
+    CHECK(errors.error_count() == 4);
+    CHECK(babel::entropy::uncompressed_size(huge, errors) == 0);
+    CHECK(errors.error_count() == 5);
+}
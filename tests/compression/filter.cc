@@ -0,0 +1,129 @@
+#include <cmath>
+#include <cstring>
+
+#include <nexus/fuzz_test.hh>
+
+#include <babel-serializer/compression/filter.hh>
+#include <babel-serializer/errors.hh>
+
+FUZZ_TEST("filter fuzzer")(tg::rng& rng)
+{
+    using babel::filter::filter_type;
+
+    auto orig_data = cc::vector<std::byte>(uniform(rng, 0, 5000));
+    for (auto& d : orig_data)
+        d = std::byte(uniform(rng, 0, 255));
+
+    size_t const sizes[] = {1, 2, 4, 8};
+    auto f = babel::filter::filter();
+    f.type = filter_type(uniform(rng, 1, 5));
+    f.element_size = uint8_t(f.type == filter_type::delta || f.type == filter_type::xor_delta ? sizes[uniform(rng, 0, 3)] : uniform(rng, 1, 12));
+    f.stride = uint32_t(f.element_size * uniform(rng, 1, 5));
+
+    auto filtered = cc::vector<std::byte>::uninitialized(orig_data.size());
+    auto reverted = cc::vector<std::byte>::uninitialized(orig_data.size());
+    babel::filter::apply(filtered, orig_data, f);
+    babel::filter::revert(reverted, filtered, f);
+    CHECK(reverted == orig_data);
+
+    // delta filters work in-place
+    if (f.type == filter_type::delta || f.type == filter_type::xor_delta)
+    {
+        auto in_place = orig_data;
+        babel::filter::apply(in_place, in_place, f);
+        CHECK(in_place == filtered);
+        babel::filter::revert(in_place, in_place, f);
+        CHECK(in_place == orig_data);
+    }
+}
+
+FUZZ_TEST("filter compress fuzzer")(tg::rng& rng)
+{
+    using babel::filter::filter_type;
+
+    auto orig_data = cc::vector<std::byte>(uniform(rng, 0, 20000));
+    for (size_t i = 0; i < orig_data.size(); ++i)
+        orig_data[i] = std::byte(i % 12 < 4 ? i / 12 : uniform(rng, 0, 3));
+
+    cc::vector<babel::filter::filter> filters;
+    for (auto i = uniform(rng, 0, 3); i > 0; --i)
+        filters.push_back({filter_type(uniform(rng, 1, 5)), 4, 12});
+
+    babel::compression::codec const codecs[] = {babel::compression::codec::none, babel::compression::codec::zstd,
+                                                 babel::compression::codec::lz4, babel::compression::codec::snappy};
+    auto comp_data = babel::filter::compress(orig_data, filters, codecs[uniform(rng, 0, 3)]);
+    CHECK(babel::filter::is_filtered(comp_data));
+    CHECK(babel::filter::uncompress(comp_data) == orig_data);
+}
+
+TEST("filter layout")
+{
+    // elements 0x0201, 0x0403, 0x0605
+    std::byte const data[] = {std::byte(1), std::byte(2), std::byte(3), std::byte(4), std::byte(5), std::byte(6), std::byte(7)};
+    std::byte out[7];
+
+    babel::filter::shuffle(out, data, 2);
+    std::byte const shuffled[] = {std::byte(1), std::byte(3), std::byte(5), std::byte(2), std::byte(4), std::byte(6), std::byte(7)};
+    CHECK(std::memcmp(out, shuffled, 7) == 0);
+
+    babel::filter::delta_encode(out, data, 1);
+    std::byte const delta[] = {std::byte(1), std::byte(1), std::byte(1), std::byte(1), std::byte(1), std::byte(1), std::byte(1)};
+    CHECK(std::memcmp(out, delta, 7) == 0);
+
+    // 8 one-byte elements with only the lowest bit set in element 0 and 7
+    std::byte const bits[] = {std::byte(1), std::byte(0), std::byte(0), std::byte(0), std::byte(0), std::byte(0), std::byte(0), std::byte(1)};
+    std::byte bit_planes[8];
+    babel::filter::bitshuffle(bit_planes, bits, 1);
+    CHECK(bit_planes[0] == std::byte(0x81));
+    for (auto i = 1; i < 8; ++i)
+        CHECK(bit_planes[i] == std::byte(0));
+}
+
+TEST("filter improves compression")
+{
+    using babel::filter::filter_type;
+
+    // smooth xyz float positions
+    auto data = cc::vector<std::byte>::uninitialized(3 * 4 * 20000);
+    for (auto i = 0; i < 20000; ++i)
+    {
+        float const p[] = {std::sin(i * 0.01f), std::cos(i * 0.01f), i * 0.001f};
+        std::memcpy(data.data() + i * 12, p, 12);
+    }
+
+    babel::filter::filter const filters[] = {{filter_type::transpose, 4, 12}, {filter_type::shuffle, 4}};
+    auto const plain = babel::compression::compress(data, babel::compression::codec::zstd);
+    auto const filtered = babel::filter::compress(data, filters);
+    CHECK(filtered.size() < plain.size());
+    CHECK(babel::filter::uncompress(filtered) == data);
+}
+
+TEST("filter errors")
+{
+    auto errors = babel::error_collector();
+
+    auto data = cc::vector<std::byte>::filled(100, std::byte(1));
+    CHECK(babel::filter::uncompress(data, errors).empty());
+    CHECK(errors.error_count() == 1);
+
+    babel::filter::filter const filters[] = {{babel::filter::filter_type::delta, 4}};
+    auto comp_data = babel::filter::compress(data, filters);
+    comp_data[7] = std::byte(3); // delta with 3-byte elements
+    CHECK(babel::filter::uncompress(comp_data, errors).empty());
+    CHECK(errors.error_count() == 2);
+
+    comp_data = babel::filter::compress(data, filters);
+    comp_data[4] = std::byte(77); // codec
+    CHECK(babel::filter::uncompress(comp_data, errors).empty());
+    CHECK(errors.error_count() == 3);
+}
+
+TEST("filter uncompressed payload with magic number")
+{
+    // an unfiltered, uncompressed payload that looks like a zstd frame
+    auto data = babel::compression::compress(cc::vector<std::byte>::filled(1000, std::byte(5)), babel::compression::codec::zstd);
+    CHECK(babel::compression::detect(data) == babel::compression::codec::zstd);
+
+    auto comp_data = babel::filter::compress(data, {}, babel::compression::codec::none);
+    CHECK(babel::filter::uncompress(comp_data) == data);
+}
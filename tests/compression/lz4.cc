@@ -0,0 +1,224 @@
+#include <cstring>
+
+#include <nexus/fuzz_test.hh>
+
+#include <clean-core/utility.hh>
+
+#include <babel-serializer/compression/lz4.hh>
+#include <babel-serializer/errors.hh>
+#include <babel-serializer/hash.hh>
+
+FUZZ_TEST("lz4 fuzzer")(tg::rng& rng)
+{
+    auto cnt = uniform(rng, 0, 10);
+    if (uniform(rng))
+        cnt = uniform(rng, 100, 1000);
+
+    auto orig_data = cc::vector<std::byte>(cnt);
+    for (auto& d : orig_data)
+        d = uniform(rng);
+
+    auto comp_data = babel::lz4::compress(orig_data);
+
+    auto uncomp_data = babel::lz4::uncompress(comp_data, orig_data.size());
+
+    CHECK(orig_data == uncomp_data);
+}
+
+FUZZ_TEST("lz4 compressor fuzzer")(tg::rng& rng)
+{
+    auto compressor = babel::lz4::compressor();
+
+    for (auto i = 0; i < 5; ++i)
+    {
+        auto orig_data = cc::vector<std::byte>(uniform(rng, 0, 2000));
+        for (auto& d : orig_data)
+            d = std::byte(uniform(rng, 0, 3));
+
+        auto comp_data = compressor.compress(orig_data, uniform(rng, 1, 10));
+
+        auto uncomp_data = babel::lz4::uncompress(comp_data, orig_data.size());
+
+        CHECK(orig_data == uncomp_data);
+    }
+}
+
+FUZZ_TEST("lz4 compress_to fuzzer")(tg::rng& rng)
+{
+    auto orig_data = cc::vector<std::byte>(uniform(rng, 0, 2000));
+    for (auto& d : orig_data)
+        d = std::byte(uniform(rng, 0, 3));
+
+    auto comp_buffer = cc::vector<std::byte>::uninitialized(babel::lz4::compress_bound(orig_data.size()));
+    auto comp_size = babel::lz4::compress_to(comp_buffer, orig_data);
+    CHECK(comp_size > 0);
+    auto comp_data = cc::span<std::byte const>(comp_buffer).subspan(0, comp_size);
+
+    auto uncomp_data = cc::vector<std::byte>::uninitialized(orig_data.size());
+    CHECK(babel::lz4::uncompress_to(uncomp_data, comp_data));
+    CHECK(orig_data == uncomp_data);
+
+    auto alloc_data = babel::lz4::uncompress(comp_data, orig_data.size(), cc::system_allocator);
+    CHECK(alloc_data.size() == orig_data.size());
+    CHECK(std::memcmp(alloc_data.data(), orig_data.data(), orig_data.size()) == 0);
+}
+
+FUZZ_TEST("lz4 frame fuzzer")(tg::rng& rng)
+{
+    auto cnt = uniform(rng, 0, 10);
+    if (uniform(rng))
+        cnt = uniform(rng, 100, 300000);
+
+    auto orig_data = cc::vector<std::byte>(cnt);
+    for (auto& d : orig_data)
+        d = std::byte(uniform(rng, 0, 3)); // compressible
+
+    auto cfg = babel::lz4::frame_config();
+    cfg.max_block_size = uniform(rng) ? babel::lz4::block_size::max_64KB : babel::lz4::block_size::max_256KB;
+    cfg.linked_blocks = uniform(rng);
+    cfg.content_checksum = uniform(rng);
+    cfg.block_checksum = uniform(rng);
+    cfg.high_compression = uniform(rng);
+
+    auto comp_data = babel::lz4::compress_frame(orig_data, cfg);
+
+    CHECK(babel::lz4::uncompress_frame(comp_data) == orig_data);
+}
+
+FUZZ_TEST("lz4 frame stream fuzzer")(tg::rng& rng)
+{
+    auto orig_data = cc::vector<std::byte>(uniform(rng, 0, 300000));
+    for (auto& d : orig_data)
+        d = uniform(rng, 0, 10) == 0 ? std::byte(uniform(rng, 0, 255)) : std::byte(uniform(rng, 0, 3));
+
+    auto cfg = babel::lz4::frame_config();
+    cfg.linked_blocks = uniform(rng);
+    cfg.block_checksum = uniform(rng);
+    cfg.high_compression = uniform(rng);
+    cfg.search_depth = uniform(rng, 1, 100);
+
+    // compress in random chunks (with occasional flushes)
+    cc::vector<std::byte> comp_data;
+    auto append_comp = [&](cc::span<std::byte const> d)
+    {
+        for (auto b : d)
+            comp_data.push_back(b);
+    };
+    {
+        auto compressor = babel::lz4::compress_stream(append_comp, cfg);
+        size_t pos = 0;
+        while (pos < orig_data.size())
+        {
+            auto n = cc::min(size_t(uniform(rng, 0, 50000)), orig_data.size() - pos);
+            compressor(cc::span<std::byte const>(orig_data).subspan(pos, n));
+            pos += n;
+            if (uniform(rng, 0, 5) == 0)
+                compressor.flush();
+        }
+        compressor.finish();
+    }
+
+    CHECK(babel::lz4::uncompress_frame(comp_data) == orig_data);
+
+    // decompress in random chunks
+    cc::vector<std::byte> uncomp_data;
+    auto append_uncomp = [&](cc::span<std::byte const> d)
+    {
+        for (auto b : d)
+            uncomp_data.push_back(b);
+    };
+    auto decompressor = babel::lz4::decompress_stream(append_uncomp);
+    size_t pos = 0;
+    while (pos < comp_data.size())
+    {
+        auto n = cc::min(size_t(uniform(rng, 0, 100)), comp_data.size() - pos);
+        decompressor(cc::span<std::byte const>(comp_data).subspan(pos, n));
+        pos += n;
+    }
+    CHECK(decompressor.finish());
+    CHECK(orig_data == uncomp_data);
+}
+
+TEST("lz4 frame high compression")
+{
+    // repetitive text with some noise
+    tg::rng rng;
+    auto const words = cc::array<char const*, 6>{"alpha ", "beta ", "gamma ", "delta ", "epsilon ", "zeta "};
+    cc::vector<std::byte> orig_data;
+    while (orig_data.size() < 500000)
+    {
+        for (auto c = words[uniform(rng, 0, 5)]; *c; ++c)
+            orig_data.push_back(std::byte(*c));
+        if (uniform(rng, 0, 20) == 0)
+            orig_data.push_back(std::byte(uniform(rng, 0, 255)));
+    }
+
+    for (auto linked : {false, true})
+    {
+        auto cfg = babel::lz4::frame_config();
+        cfg.linked_blocks = linked;
+        auto const fast = babel::lz4::compress_frame(orig_data, cfg);
+
+        cfg.high_compression = true;
+        auto const high = babel::lz4::compress_frame(orig_data, cfg);
+
+        CHECK(high.size() < fast.size());
+        CHECK(babel::lz4::uncompress_frame(high) == orig_data);
+    }
+
+    // tiny inputs are stored as literals only
+    for (auto size : {0, 1, 5, 12, 13, 20})
+    {
+        auto cfg = babel::lz4::frame_config();
+        cfg.high_compression = true;
+        auto const data = cc::vector<std::byte>::filled(size, std::byte(7));
+        CHECK(babel::lz4::uncompress_frame(babel::lz4::compress_frame(data, cfg)) == data);
+    }
+}
+
+TEST("lz4 frame concatenated and skippable")
+{
+    auto a = cc::vector<std::byte>::filled(100000, std::byte(1));
+    auto b = cc::vector<std::byte>::filled(500, std::byte(2));
+
+    auto comp_data = babel::lz4::compress_frame(a);
+    // skippable frame with 3 bytes of user data
+    for (auto v : {0x5A, 0x2A, 0x4D, 0x18, 3, 0, 0, 0, 7, 7, 7})
+        comp_data.push_back(std::byte(v));
+    for (auto d : babel::lz4::compress_frame(b))
+        comp_data.push_back(d);
+
+    auto uncomp_data = babel::lz4::uncompress_frame(comp_data);
+    CHECK(uncomp_data.size() == 100500);
+    CHECK(uncomp_data[99999] == std::byte(1));
+    CHECK(uncomp_data[100000] == std::byte(2));
+}
+
+TEST("lz4 frame corruption")
+{
+    auto orig_data = cc::vector<std::byte>::filled(10000, std::byte(3));
+    auto comp_data = babel::lz4::compress_frame(orig_data);
+
+    auto errors = babel::error_collector();
+
+    // truncated
+    babel::lz4::uncompress_frame(cc::span<std::byte const>(comp_data).subspan(0, comp_data.size() - 2), errors);
+    CHECK(errors.error_count() == 1);
+
+    // content checksum
+    comp_data.back() ^= std::byte(1);
+    CHECK(babel::lz4::uncompress_frame(comp_data, errors).empty());
+    CHECK(errors.error_count() == 2);
+
+    // header claiming a huge content size (the reservation must not abort)
+    std::byte header[15] = {std::byte(0x04), std::byte(0x22), std::byte(0x4D), std::byte(0x18), std::byte(0x48), std::byte(0x40)};
+    for (auto i = 0; i < 8; ++i)
+        header[6 + i] = std::byte(i == 7 ? 0x10 : 0);
+    header[14] = std::byte(0); // wrong descriptor checksum
+    CHECK(babel::lz4::uncompress_frame(header, errors).empty());
+    CHECK(errors.error_count() == 3);
+
+    header[14] = std::byte(babel::hash::xxh32(cc::span<std::byte const>(header + 4, 10)) >> 8); // valid but truncated frame
+    CHECK(babel::lz4::uncompress_frame(header, errors).empty());
+    CHECK(errors.error_count() == 4);
+}
@@ -0,0 +1,116 @@
+#include <cstring>
+
+#include <nexus/fuzz_test.hh>
+
+#include <clean-core/utility.hh>
+
+#include <babel-serializer/compression/seekable.hh>
+#include <babel-serializer/errors.hh>
+
+FUZZ_TEST("seekable fuzzer")(tg::rng& rng)
+{
+    auto orig_data = cc::vector<std::byte>(uniform(rng, 0, 200000));
+    for (size_t i = 0; i < orig_data.size(); ++i)
+        orig_data[i] = std::byte(i / 1000 + uniform(rng, 0, 3));
+
+    auto cfg = babel::compression::seekable_config();
+    cfg.chunk_codec = uniform(rng) ? babel::compression::codec::zstd : babel::compression::codec::lz4;
+    cfg.chunk_size = uniform(rng, 1000, 50000);
+    cfg.thread_count = uniform(rng, 1, 4);
+    cfg.checksum = uniform(rng);
+
+    auto comp_data = babel::compression::compress_seekable(orig_data, cfg);
+
+    // the container is valid zstd/lz4 data
+    CHECK(babel::compression::uncompress(comp_data) == orig_data);
+
+    auto reader = babel::compression::seekable_reader(comp_data);
+    CHECK(reader.size() == orig_data.size());
+    CHECK(reader.chunk_count() == (orig_data.size() + cfg.chunk_size - 1) / cfg.chunk_size);
+
+    for (auto i = 0; i < 5; ++i)
+    {
+        auto const offset = size_t(uniform(rng, 0, int(orig_data.size())));
+        auto const size = size_t(uniform(rng, 0, int(orig_data.size() - offset)));
+        auto const expected = cc::span<std::byte const>(orig_data).subspan(offset, size);
+        auto const matches = [&](cc::vector<std::byte> const& v) { return v.size() == size && (size == 0 || std::memcmp(v.data(), expected.data(), size) == 0); };
+
+        auto part = reader.read(offset, size, uniform(rng, 1, 4));
+        CHECK(matches(part));
+
+        cc::vector<std::byte> streamed;
+        auto append = [&](cc::span<std::byte const> d)
+        {
+            for (auto b : d)
+                streamed.push_back(b);
+        };
+        CHECK(reader.stream_to(append, offset, size));
+        CHECK(matches(streamed));
+    }
+}
+
+TEST("seekable errors")
+{
+    auto errors = babel::error_collector();
+
+    auto data = cc::vector<std::byte>::filled(100, std::byte(1));
+    auto reader = babel::compression::seekable_reader(data, errors);
+    CHECK(errors.error_count() == 1);
+    CHECK(reader.size() == 0);
+
+    auto comp_data = babel::compression::compress_seekable(data);
+    auto valid_reader = babel::compression::seekable_reader(comp_data, errors);
+    CHECK(errors.error_count() == 1);
+    CHECK(valid_reader.read(50, 51, 1, errors).empty());
+    CHECK(errors.error_count() == 2);
+}
+
+TEST("seekable checksums")
+{
+    auto data = cc::vector<std::byte>(10000);
+    for (size_t i = 0; i < data.size(); ++i)
+        data[i] = std::byte(i % 7);
+
+    auto cfg = babel::compression::seekable_config();
+    cfg.chunk_codec = babel::compression::codec::lz4;
+    cfg.chunk_size = 1000;
+    cfg.checksum = true;
+    auto comp_data = babel::compression::compress_seekable(data, cfg);
+
+    // corrupt the stored checksum of the first chunk (first seek table entry)
+    auto const entry_count = (data.size() + cfg.chunk_size - 1) / cfg.chunk_size;
+    auto const table_size = 8 + entry_count * 12 + 9;
+    comp_data[comp_data.size() - table_size + 8 + 8] ^= std::byte(1);
+
+    auto errors = babel::error_collector();
+
+    auto reader = babel::compression::seekable_reader(comp_data, errors);
+    CHECK(errors.error_count() == 0);
+    CHECK(reader.read(2000, 1000, 1, errors).size() == 1000);
+    CHECK(errors.error_count() == 0);
+    CHECK(reader.read(500, 1000, 1, errors).empty());
+    CHECK(errors.error_count() == 1);
+}
+
+TEST("seekable compression batches chunks for all threads")
+{
+    auto cfg = babel::compression::seekable_config();
+    cfg.chunk_codec = babel::compression::codec::lz4;
+    cfg.chunk_size = 1000;
+    cfg.thread_count = 4;
+
+    size_t output_size = 0;
+    auto count_output = [&](cc::span<std::byte const> d) { output_size += d.size(); };
+    auto stream = babel::compression::seekable_compress_stream(count_output, cfg);
+
+    // chunks are only compressed once there is one per thread (so that they are compressed in parallel)
+    auto const chunk = cc::vector<std::byte>::filled(cfg.chunk_size, std::byte(1));
+    for (auto i = 0; i < 3; ++i)
+    {
+        stream(chunk);
+        CHECK(output_size == 0);
+    }
+    stream(chunk);
+    CHECK(output_size > 0);
+    stream.finish();
+}
@@ -1,6 +1,12 @@
+#include <cstring>
+
 #include <nexus/fuzz_test.hh>
 
+#include <clean-core/string_view.hh>
+#include <clean-core/utility.hh>
+
 #include <babel-serializer/compression/snappy.hh>
+#include <babel-serializer/errors.hh>
 
 FUZZ_TEST("snappy fuzzer")(tg::rng& rng)
 {
@@ -18,3 +24,121 @@ FUZZ_TEST("snappy fuzzer")(tg::rng& rng)
 
     CHECK(orig_data == uncomp_data);
 }
+
+FUZZ_TEST("snappy compress_to fuzzer")(tg::rng& rng)
+{
+    auto orig_data = cc::vector<std::byte>(uniform(rng, 0, 2000));
+    for (auto& d : orig_data)
+        d = std::byte(uniform(rng, 0, 3));
+
+    auto comp_buffer = cc::vector<std::byte>::uninitialized(babel::snappy::compress_bound(orig_data.size()));
+    auto comp_size = babel::snappy::compress_to(comp_buffer, orig_data);
+    CHECK(comp_size > 0);
+    auto comp_data = cc::span<std::byte const>(comp_buffer).subspan(0, comp_size);
+
+    CHECK(babel::snappy::uncompressed_size(comp_data) == orig_data.size());
+
+    auto uncomp_data = cc::vector<std::byte>::uninitialized(orig_data.size());
+    CHECK(babel::snappy::uncompress_to(uncomp_data, comp_data));
+    CHECK(orig_data == uncomp_data);
+
+    auto alloc_data = babel::snappy::uncompress(comp_data, cc::system_allocator);
+    CHECK(alloc_data.size() == orig_data.size());
+    CHECK(std::memcmp(alloc_data.data(), orig_data.data(), orig_data.size()) == 0);
+}
+
+TEST("snappy crc32c")
+{
+    auto const data = cc::string_view("123456789");
+    CHECK(babel::snappy::crc32c(cc::as_byte_span(data)) == 0xE3069283);
+
+    // incremental
+    auto const bytes = cc::as_byte_span(data);
+    CHECK(babel::snappy::crc32c(bytes.subspan(4), babel::snappy::crc32c(bytes.subspan(0, 4))) == 0xE3069283);
+}
+
+TEST("snappy is_valid_compressed")
+{
+    auto orig_data = cc::vector<std::byte>::filled(1000, std::byte(7));
+    auto comp_data = babel::snappy::compress(orig_data);
+    CHECK(babel::snappy::is_valid_compressed(comp_data));
+
+    comp_data.pop_back();
+    CHECK(!babel::snappy::is_valid_compressed(comp_data));
+}
+
+FUZZ_TEST("snappy framed fuzzer")(tg::rng& rng)
+{
+    auto orig_data = cc::vector<std::byte>(uniform(rng, 0, 300000));
+    for (auto& d : orig_data)
+        d = uniform(rng, 0, 10) == 0 ? std::byte(uniform(rng, 0, 255)) : std::byte(uniform(rng, 0, 3));
+
+    // compress in random chunks (with occasional flushes)
+    cc::vector<std::byte> comp_data;
+    auto append_comp = [&](cc::span<std::byte const> d)
+    {
+        for (auto b : d)
+            comp_data.push_back(b);
+    };
+    {
+        auto compressor = babel::snappy::compress_stream(append_comp);
+        size_t pos = 0;
+        while (pos < orig_data.size())
+        {
+            auto n = cc::min(size_t(uniform(rng, 0, 50000)), orig_data.size() - pos);
+            compressor(cc::span<std::byte const>(orig_data).subspan(pos, n));
+            pos += n;
+            if (uniform(rng, 0, 5) == 0)
+                compressor.flush();
+        }
+        compressor.finish();
+    }
+
+    CHECK(babel::snappy::uncompress_framed(comp_data) == orig_data);
+    CHECK(babel::snappy::uncompress_framed(babel::snappy::compress_framed(orig_data)) == orig_data);
+
+    // decompress in random chunks
+    cc::vector<std::byte> uncomp_data;
+    auto append_uncomp = [&](cc::span<std::byte const> d)
+    {
+        for (auto b : d)
+            uncomp_data.push_back(b);
+    };
+    auto decompressor = babel::snappy::decompress_stream(append_uncomp);
+    size_t pos = 0;
+    while (pos < comp_data.size())
+    {
+        auto n = cc::min(size_t(uniform(rng, 0, 100)), comp_data.size() - pos);
+        decompressor(cc::span<std::byte const>(comp_data).subspan(pos, n));
+        pos += n;
+    }
+    CHECK(decompressor.finish());
+    CHECK(orig_data == uncomp_data);
+}
+
+TEST("snappy framed corruption")
+{
+    auto orig_data = cc::vector<std::byte>::filled(100000, std::byte(3));
+    auto comp_data = babel::snappy::compress_framed(orig_data);
+
+    auto errors = babel::error_collector();
+
+    // truncated
+    babel::snappy::uncompress_framed(cc::span<std::byte const>(comp_data).subspan(0, comp_data.size() - 2), errors);
+    CHECK(errors.error_count() == 1);
+
+    // checksum of the first chunk (after the 10 byte stream identifier and 4 byte chunk header)
+    comp_data[14] ^= std::byte(1);
+    CHECK(babel::snappy::uncompress_framed(comp_data, errors).empty());
+    CHECK(errors.error_count() == 2);
+}
+
+TEST("snappy uncompress invalid data with allocator")
+{
+    std::byte const garbage[] = {std::byte(0xff), std::byte(0xff), std::byte(0xff), std::byte(0xff), std::byte(0xff), std::byte(0xff)};
+
+    auto errors = babel::error_collector();
+    auto res = babel::snappy::uncompress(garbage, cc::system_allocator, errors);
+    CHECK(res.empty());
+    CHECK(errors.error_count() == 1); // only the size lookup fails, no follow-up errors
+}
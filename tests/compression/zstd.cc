@@ -1,6 +1,11 @@
+#include <cstring>
+
 #include <nexus/fuzz_test.hh>
 
+#include <clean-core/utility.hh>
+
 #include <babel-serializer/compression/zstd.hh>
+#include <babel-serializer/errors.hh>
 
 FUZZ_TEST("zstd fuzzer")(tg::rng& rng)
 {
@@ -18,3 +23,166 @@ FUZZ_TEST("zstd fuzzer")(tg::rng& rng)
 
     CHECK(orig_data == uncomp_data);
 }
+
+FUZZ_TEST("zstd stream fuzzer")(tg::rng& rng)
+{
+    auto cnt = uniform(rng, 0, 10);
+    if (uniform(rng))
+        cnt = uniform(rng, 100, 300000);
+
+    auto orig_data = cc::vector<std::byte>(cnt);
+    for (auto& d : orig_data)
+        d = std::byte(uniform(rng, 0, 3)); // compressible
+
+    // compress in random chunks
+    cc::vector<std::byte> comp_data;
+    auto append_comp = [&](cc::span<std::byte const> d)
+    {
+        for (auto b : d)
+            comp_data.push_back(b);
+    };
+    {
+        auto compressor = babel::zstd::compress_stream(append_comp);
+        size_t pos = 0;
+        while (pos < orig_data.size())
+        {
+            auto n = cc::min(size_t(uniform(rng, 0, 5000)), orig_data.size() - pos);
+            compressor(cc::span<std::byte const>(orig_data).subspan(pos, n));
+            pos += n;
+        }
+        compressor.finish();
+    }
+
+    // frames written by the stream do not know their size
+    CHECK(babel::zstd::uncompress(comp_data) == orig_data);
+
+    // decompress in random chunks
+    cc::vector<std::byte> uncomp_data;
+    auto append_uncomp = [&](cc::span<std::byte const> d)
+    {
+        for (auto b : d)
+            uncomp_data.push_back(b);
+    };
+    auto decompressor = babel::zstd::decompress_stream(append_uncomp);
+    size_t pos = 0;
+    while (pos < comp_data.size())
+    {
+        auto n = cc::min(size_t(uniform(rng, 0, 100)), comp_data.size() - pos);
+        decompressor(cc::span<std::byte const>(comp_data).subspan(pos, n));
+        pos += n;
+    }
+    CHECK(decompressor.finish());
+    CHECK(orig_data == uncomp_data);
+}
+
+TEST("zstd concatenated frames")
+{
+    auto a = cc::vector<std::byte>::filled(1000, std::byte(1));
+    auto b = cc::vector<std::byte>::filled(500, std::byte(2));
+
+    auto comp_data = babel::zstd::compress(a);
+    for (auto d : babel::zstd::compress(b))
+        comp_data.push_back(d);
+
+    auto uncomp_data = babel::zstd::uncompress(comp_data);
+    CHECK(uncomp_data.size() == 1500);
+    CHECK(uncomp_data[999] == std::byte(1));
+    CHECK(uncomp_data[1000] == std::byte(2));
+}
+
+TEST("zstd multithreaded")
+{
+    auto orig_data = cc::vector<std::byte>(3 << 20);
+    for (size_t i = 0; i < orig_data.size(); ++i)
+        orig_data[i] = std::byte((i * 7) % 251 + (i >> 16));
+
+    auto cfg = babel::zstd::compress_config();
+    cfg.level = 3;
+    cfg.worker_count = 4;
+    cfg.job_size = 1 << 20;
+    cfg.long_distance_matching = true;
+
+    auto comp_data = babel::zstd::compress(orig_data, cfg);
+    CHECK(babel::zstd::uncompress(comp_data) == orig_data);
+
+    cc::vector<std::byte> stream_data;
+    auto append = [&](cc::span<std::byte const> d)
+    {
+        for (auto b : d)
+            stream_data.push_back(b);
+    };
+    {
+        auto compressor = babel::zstd::compress_stream(append, cfg);
+        compressor(orig_data);
+    }
+    CHECK(babel::zstd::uncompress(stream_data) == orig_data);
+}
+
+TEST("zstd checksum")
+{
+    auto orig_data = cc::vector<std::byte>(10000);
+    for (size_t i = 0; i < orig_data.size(); ++i)
+        orig_data[i] = std::byte(i % 13);
+
+    auto cfg = babel::zstd::compress_config();
+    cfg.checksum = true;
+    auto comp_data = babel::zstd::compress(orig_data, cfg);
+    CHECK(babel::zstd::uncompress(comp_data) == orig_data);
+
+    // the checksum is stored in the last 4 bytes of the frame
+    comp_data.back() ^= std::byte(1);
+
+    auto errors = babel::error_collector();
+    babel::zstd::uncompress(comp_data, errors);
+    CHECK(errors.has_errors());
+}
+
+FUZZ_TEST("zstd compressor fuzzer")(tg::rng& rng)
+{
+    auto compressor = babel::zstd::compressor(uniform(rng, 1, 5));
+    auto decompressor = babel::zstd::decompressor();
+
+    for (auto i = 0; i < 5; ++i)
+    {
+        auto orig_data = cc::vector<std::byte>(uniform(rng, 0, 2000));
+        for (auto& d : orig_data)
+            d = std::byte(uniform(rng, 0, 3));
+
+        auto comp_data = compressor.compress(orig_data);
+
+        CHECK(decompressor.uncompress(comp_data) == orig_data);
+        CHECK(babel::zstd::uncompress(comp_data) == orig_data);
+    }
+}
+
+FUZZ_TEST("zstd compress_to fuzzer")(tg::rng& rng)
+{
+    auto orig_data = cc::vector<std::byte>(uniform(rng, 0, 2000));
+    for (auto& d : orig_data)
+        d = std::byte(uniform(rng, 0, 3));
+
+    auto comp_buffer = cc::vector<std::byte>::uninitialized(babel::zstd::compress_bound(orig_data.size()));
+    auto comp_size = babel::zstd::compress_to(comp_buffer, orig_data);
+    CHECK(comp_size > 0);
+    auto comp_data = cc::span<std::byte const>(comp_buffer).subspan(0, comp_size);
+
+    CHECK(babel::zstd::uncompressed_size(comp_data) == orig_data.size());
+
+    auto uncomp_data = cc::vector<std::byte>::uninitialized(orig_data.size());
+    CHECK(babel::zstd::uncompress_to(uncomp_data, comp_data));
+    CHECK(orig_data == uncomp_data);
+
+    auto alloc_data = babel::zstd::uncompress(comp_data, cc::system_allocator);
+    CHECK(alloc_data.size() == orig_data.size());
+    CHECK(std::memcmp(alloc_data.data(), orig_data.data(), orig_data.size()) == 0);
+}
+
+TEST("zstd uncompress invalid data with allocator")
+{
+    std::byte const garbage[] = {std::byte(0xff), std::byte(0xff), std::byte(0xff), std::byte(0xff), std::byte(0xff), std::byte(0xff)};
+
+    auto errors = babel::error_collector();
+    auto res = babel::zstd::uncompress(garbage, cc::system_allocator, errors);
+    CHECK(res.empty());
+    CHECK(errors.error_count() == 1); // only the size lookup fails, no follow-up errors
+}
@@ -1,6 +1,28 @@
 #include <nexus/test.hh>
 
+#include <clean-core/string.hh>
+#include <clean-core/to_string.hh>
+#include <clean-core/vector.hh>
+
 #include <babel-serializer/data/csv.hh>
+#include <babel-serializer/errors.hh>
+
+namespace
+{
+struct person
+{
+    cc::string name;
+    int age = -1;
+    float height = 0;
+};
+template <class I>
+constexpr void introspect(I&& i, person& v)
+{
+    i(v.name, "name");
+    i(v.age, "age");
+    i(v.height, "height");
+}
+}
 
 TEST("babel csv header-only")
 {
@@ -74,3 +96,150 @@ TEST("babel csv trailing empty start")
     CHECK(csv[1][2].get_int() == 5);
     CHECK(csv[1][3].get_int() == 6);
 }
+
+TEST("babel csv read_to")
+{
+    auto data = "height, name, unused\n1.5, \"Doe, John\", x\n2,Jane\n,\"Max \"\"M\"\"\"";
+
+    cc::vector<person> persons;
+    babel::csv::read_to(persons, data);
+    CHECK(persons.size() == 3);
+    CHECK(persons[0].name == "Doe, John");
+    CHECK(persons[0].height == 1.5f);
+    CHECK(persons[0].age == -1);
+    CHECK(persons[1].name == "Jane");
+    CHECK(persons[1].height == 2.f);
+    CHECK(persons[2].name == "Max \"M\"");
+    CHECK(persons[2].height == 0.f);
+}
+
+TEST("babel csv read_to parallel")
+{
+    auto config = babel::csv::read_config();
+    config.has_header = false;
+    config.thread_count = 4;
+
+    cc::string data;
+    for (auto i = 0; i < 100000; ++i)
+    {
+        data += cc::to_string(i);
+        data += ",";
+        data += cc::to_string(i * 2);
+        data += ",0.5\n";
+    }
+
+    cc::vector<person> persons;
+    babel::csv::read_to(persons, data, config);
+    CHECK(persons.size() == 100000);
+
+    auto ok = true;
+    for (auto i = 0; i < 100000; ++i)
+        ok &= persons[i].name == cc::to_string(i) && persons[i].age == i * 2 && persons[i].height == 0.5f;
+    CHECK(ok);
+}
+
+TEST("babel csv compact")
+{
+    auto data = "foo, bla, \"ah ha\"\n1,2,foobar\n3,,\"x, \"\"y\"\"\"\n4";
+
+    auto csv = babel::csv::read(data);
+    auto compact = babel::csv::read_compact(data);
+    CHECK(compact.header.size() == 3);
+    CHECK(compact.column_count == 3);
+    CHECK(compact.row_count() == 3);
+    CHECK(compact.row_count() == csv.row_count());
+
+    for (size_t r = 0; r < csv.row_count(); ++r)
+        for (size_t c = 0; c < csv.col_count(); ++c)
+            CHECK(compact(r, c).raw_token == csv(r, c).raw_token);
+
+    CHECK(compact(0, "foo").get_int() == 1);
+    CHECK(compact(1, "bla").empty());
+    CHECK(compact(1, "ah ha").get_string() == "x, \"y\"");
+    CHECK(compact(2, "foo").get_int() == 4);
+    CHECK(compact(2, "ah ha").empty());
+}
+
+TEST("babel csv column lookup")
+{
+    cc::string data;
+    for (auto i = 0; i < 200; ++i)
+    {
+        if (i > 0)
+            data += ",";
+        data += "col";
+        data += cc::to_string(i);
+    }
+    data += "\n";
+    for (auto i = 0; i < 200; ++i)
+    {
+        if (i > 0)
+            data += ",";
+        data += cc::to_string(i * 10);
+    }
+
+    auto csv = babel::csv::read(data);
+    CHECK(csv.col_count() == 200);
+    CHECK(csv.has_column("col0"));
+    CHECK(csv.has_column("col199"));
+    CHECK(!csv.has_column("col200"));
+    CHECK(!csv.has_column(""));
+    CHECK(csv.column_index("col42") == 42);
+    CHECK(csv.column("col123")[0].get_int() == 1230);
+}
+
+TEST("babel csv projection")
+{
+    auto data = "a,b,c,d\n1,2,3,4\n5,\"6,\"\"x\"\"\",7,8\n9\n10,11,12";
+
+    auto config = babel::csv::read_config();
+    config.columns = {"c", "a"};
+
+    auto csv = babel::csv::read(data, config);
+    CHECK(csv.col_count() == 2);
+    CHECK(csv.row_count() == 4);
+    CHECK(csv.header.size() == 2);
+    CHECK(csv.header[0] == "c");
+    CHECK(csv.header[1] == "a");
+    CHECK(csv.column("a")[0].get_int() == 1);
+    CHECK(csv.column("c")[0].get_int() == 3);
+    CHECK(csv.column("c")[1].get_int() == 7);
+    CHECK(csv.column("c")[2].empty());
+    CHECK(csv.column("a")[2].get_int() == 9);
+    CHECK(csv.column("c")[3].get_int() == 12);
+
+    auto compact = babel::csv::read_compact(data, config);
+    CHECK(compact.row_count() == 4);
+    CHECK(compact(1, "c").get_int() == 7);
+    CHECK(compact(1, "a").get_int() == 5);
+
+    config.columns.clear();
+    config.column_indices = {1};
+    csv = babel::csv::read(data, config);
+    CHECK(csv.col_count() == 1);
+    CHECK(csv[1][0].get_string() == "6,\"x\"");
+
+    auto values = babel::csv::read_column<int>(data, "d");
+    CHECK(values.size() == 4);
+    CHECK(values[0] == 4);
+    CHECK(values[1] == 8);
+    CHECK(values[2] == 0);
+    CHECK(values[3] == 0);
+
+    auto strings = babel::csv::read_column<cc::string>(data, 1);
+    CHECK(strings.size() == 4);
+    CHECK(strings[1] == "6,\"x\"");
+
+    // selecting by name without a header is an error (and yields an empty csv)
+    auto errors = babel::error_collector();
+    config = babel::csv::read_config();
+    config.columns = {"a"};
+    config.has_header = false;
+    csv = babel::csv::read(data, config, errors);
+    CHECK(errors.error_count() == 1);
+    CHECK(csv.col_count() == 0);
+    CHECK(csv.row_count() == 0);
+    compact = babel::csv::read_compact(data, config, errors);
+    CHECK(errors.error_count() == 2);
+    CHECK(compact.row_count() == 0);
+}
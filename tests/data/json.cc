@@ -318,3 +318,21 @@ TEST("json parsing")
     CHECK(babel::json::read<enumB>("0") == enumB::valA);
     CHECK(babel::json::read<enumB>("1") == enumB::valB);
 }
+
+TEST("json missing data")
+{
+    auto cfg = babel::json::read_config();
+    cfg.warn_on_missing_data = true;
+
+    auto warning_count = 0;
+    auto on_error = [&](cc::span<std::byte const>, cc::span<std::byte const>, cc::string_view message, babel::severity s)
+    {
+        ++warning_count;
+        CHECK(s == babel::severity::warning);
+        CHECK(message == "missing data for field 'b'");
+    };
+    auto const v = babel::json::read<foo>("{\"x\": 5}", cfg, on_error);
+    CHECK(v.x == 5);
+    CHECK(v.b == false);
+    CHECK(warning_count == 1);
+}
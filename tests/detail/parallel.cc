@@ -0,0 +1,57 @@
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+#include <nexus/test.hh>
+
+#include <clean-core/vector.hh>
+
+#include <babel-serializer/detail/parallel.hh>
+
+TEST("parallel_for")
+{
+    CHECK(babel::detail::resolve_thread_count(4, 0) == 4); // unknown task count does not cap
+    CHECK(babel::detail::resolve_thread_count(4, 2) == 2);
+    CHECK(babel::detail::resolve_thread_count(-1, 1) == 1);
+    CHECK(babel::detail::resolve_thread_count(0, 0) >= 1);
+
+    // tasks are distributed over multiple threads (each task sleeps, so one thread cannot take all of them)
+    std::mutex mutex;
+    cc::vector<std::thread::id> ids;
+    auto seen = cc::vector<int>::filled(16, 0);
+    babel::detail::parallel_for(seen.size(), 4, babel::default_error_handler,
+                                [&](size_t i, babel::error_handler)
+                                {
+                                    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                                    auto lock = std::lock_guard<std::mutex>(mutex);
+                                    ++seen[i];
+                                    auto const id = std::this_thread::get_id();
+                                    for (auto const& other : ids)
+                                        if (other == id)
+                                            return;
+                                    ids.push_back(id);
+                                });
+    CHECK(ids.size() > 1);
+    CHECK(ids.size() <= 4);
+    for (auto s : seen)
+        CHECK(s == 1);
+
+    // exceptions are rethrown on the calling thread
+    auto caught = false;
+    try
+    {
+        babel::detail::parallel_for(100, 4, babel::default_error_handler,
+                                    [&](size_t i, babel::error_handler)
+                                    {
+                                        if (i == 50)
+                                            throw 17;
+                                    });
+    }
+    catch (int)
+    {
+        caught = true;
+    }
+    CHECK(caught);
+
+    babel::detail::parallel_for(0, 4, babel::default_error_handler, [&](size_t, babel::error_handler) { CHECK(false); });
+}
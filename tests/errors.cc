@@ -0,0 +1,49 @@
+#include <nexus/test.hh>
+
+#include <clean-core/string.hh>
+
+#include <babel-serializer/compression/entropy.hh>
+#include <babel-serializer/errors.hh>
+
+TEST("error collector")
+{
+    cc::string_view const text = "line a\nline b\nline c";
+    auto const data = cc::as_byte_span(text);
+
+    auto errors = babel::error_collector(3);
+    babel::error_handler on_error = errors;
+    on_error(data, data.subspan(7, 4), "unexpected token", babel::severity::warning);
+    on_error(data, {}, cc::string("generic") + " problem", babel::severity::error);
+    on_error(data, data.subspan(14, 1), cc::string("unexpected") + " token", babel::severity::warning);
+    on_error(data, data.subspan(0, 1), "dropped", babel::severity::warning);
+
+    CHECK(errors.has_errors());
+    CHECK(errors.error_count() == 1);
+    CHECK(errors.warning_count() == 3);
+    CHECK(errors.dropped_count() == 1);
+
+    auto const records = errors.records();
+    CHECK(records.size() == 3);
+    CHECK(records[0].offset == 7);
+    CHECK(records[0].size == 4);
+    CHECK(records[0].level == babel::severity::warning);
+    CHECK(records[1].offset == -1);
+    CHECK(records[1].level == babel::severity::error);
+    CHECK(errors.message(records[1]) == "generic problem");
+
+    // same text, same id (even if the message was built separately)
+    CHECK(records[2].message_id == records[0].message_id);
+    CHECK(records[1].message_id != records[0].message_id);
+    CHECK(errors.message(records[2]) == "unexpected token");
+
+    errors.clear();
+    CHECK(!errors.has_errors());
+    CHECK(errors.records().empty());
+
+    // collecting the errors of a reader
+    std::byte const garbage[] = {std::byte(7), std::byte(1), std::byte(2)};
+    CHECK(babel::entropy::uncompress(garbage, errors).empty());
+    CHECK(errors.error_count() == 1);
+    CHECK(errors.records().size() == 1);
+    CHECK(!errors.message(errors.records()[0]).empty());
+}
@@ -1,11 +1,17 @@
 #include <cstdint>
+#include <cstdio>
+#include <cstring>
 
 #include <nexus/test.hh>
 
 #include <clean-core/array.hh>
+#include <clean-core/format.hh>
+#include <clean-core/utility.hh>
 #include <clean-core/vector.hh>
 
+#include <babel-serializer/errors.hh>
 #include <babel-serializer/file.hh>
+#include <babel-serializer/hash.hh>
 
 TEST("file")
 {
@@ -20,3 +26,501 @@ TEST("file")
     auto d = babel::file::read_all_bytes(tmp_file);
     CHECK(d == cc::array<std::byte>{std::byte(100), std::byte(200), std::byte(50)});
 }
+
+TEST("file read")
+{
+    auto data = cc::vector<std::byte>(300000);
+    for (size_t i = 0; i < data.size(); ++i)
+        data[i] = std::byte(i * 13 + i / 1000);
+
+    auto tmp_file = "_tmp_babel_file";
+    babel::file::write(tmp_file, data);
+
+    for (auto read_ahead : {false, true})
+        for (size_t buffer_size : {1000, 4096, 300000, 1 << 20})
+        {
+            auto cfg = babel::file::read_config();
+            cfg.buffer_size = buffer_size;
+            cfg.read_ahead = read_ahead;
+
+            cc::vector<std::byte> read_data;
+            auto chunk_count = 0;
+            auto append = [&](cc::span<std::byte const> d)
+            {
+                CHECK(d.size() <= buffer_size);
+                read_data.push_back_range(d);
+                ++chunk_count;
+            };
+            babel::file::read(append, tmp_file, cfg);
+            CHECK(read_data == data);
+            CHECK(chunk_count == int((data.size() + buffer_size - 1) / buffer_size));
+        }
+
+    auto errors = babel::error_collector();
+    auto ignore = [](cc::span<std::byte const>) {};
+    babel::file::read(ignore, "_tmp_babel_file_does_not_exist", errors);
+    CHECK(errors.error_count() == 1);
+
+    // integrity check
+    for (auto read_ahead : {false, true})
+    {
+        auto cfg = babel::file::read_config();
+        cfg.buffer_size = 4096;
+        cfg.read_ahead = read_ahead;
+        cfg.expected_xxh64 = babel::hash::xxh64(data);
+        errors.clear();
+        babel::file::read(ignore, tmp_file, cfg, errors);
+        CHECK(errors.error_count() == 0);
+
+        cfg.expected_xxh64 = babel::hash::xxh64(data) + 1;
+        babel::file::read(ignore, tmp_file, cfg, errors);
+        CHECK(errors.error_count() == 1);
+    }
+}
+
+TEST("file memory mapped hints")
+{
+    auto data = cc::vector<std::byte>(100000);
+    for (size_t i = 0; i < data.size(); ++i)
+        data[i] = std::byte(i * 7 + i / 500);
+
+    auto tmp_file = "_tmp_babel_file";
+    babel::file::write(tmp_file, data);
+
+    auto cfg = babel::file::mmap_config();
+    cfg.access = babel::file::access_pattern::sequential;
+    cfg.populate = true;
+    cfg.huge_pages = true;
+    auto mapped_file = babel::file::make_memory_mapped_file_readonly(tmp_file, cfg);
+    CHECK(mapped_file.size() == data.size());
+
+    auto matches = [&] { return std::memcmp(mapped_file.data(), data.data(), data.size()) == 0; };
+    CHECK(matches());
+
+    // hints never change the content (ranges are clamped and need not be page-aligned)
+    mapped_file.prefetch(1234, 50000);
+    mapped_file.evict(3, 70000);
+    mapped_file.evict(90000, 1 << 30);
+    CHECK(matches());
+
+    mapped_file.advise(babel::file::access_pattern::random);
+    mapped_file.prefetch();
+    if (mapped_file.lock())
+        mapped_file.unlock();
+    mapped_file.evict();
+    CHECK(matches());
+}
+
+TEST("file windowed mapping")
+{
+    auto data = cc::vector<std::byte>(300000);
+    for (size_t i = 0; i < data.size(); ++i)
+        data[i] = std::byte(i * 11 + i / 300);
+
+    auto tmp_file = "_tmp_babel_file";
+    babel::file::write(tmp_file, data);
+
+    auto file = babel::file::windowed_file(tmp_file);
+    CHECK(file.valid());
+    CHECK(file.size() == data.size());
+
+    auto matches = [&](uint64_t offset, cc::span<std::byte const> d) { return std::memcmp(data.data() + offset, d.data(), d.size()) == 0; };
+
+    // unaligned random access
+    auto part = file.map(12345, 1000);
+    CHECK(part.size() == 1000);
+    CHECK(matches(12345, part));
+    CHECK(file.map(299990, 1000).size() == 10);
+    CHECK(file.map(300000, 1000).empty());
+
+    for (size_t overlap : {0, 100, 5000})
+    {
+        uint64_t expected_offset = 0;
+        uint64_t end = 0;
+        for (auto const& w : file.windows(70000, overlap))
+        {
+            CHECK(w.offset == expected_offset);
+            CHECK(matches(w.offset, w.data));
+            end = w.offset + w.data.size();
+            expected_offset = end - overlap;
+        }
+        CHECK(end == data.size());
+    }
+
+    auto errors = babel::error_collector();
+    auto missing = babel::file::windowed_file("_tmp_babel_file_does_not_exist", {}, errors);
+    CHECK(!missing.valid());
+    CHECK(errors.error_count() == 1);
+    CHECK(missing.has_error());
+    CHECK(!file.has_error());
+
+#if defined(CC_OS_LINUX)
+    // directories can be opened but not mapped, so the iteration ends with a reported error
+    auto dir = babel::file::windowed_file(".", {}, errors);
+    if (dir.size() > 0)
+    {
+        for (auto const& w : dir.windows(1000))
+        {
+            (void)w;
+            CHECK(false);
+        }
+        CHECK(dir.has_error());
+        CHECK(errors.error_count() == 2);
+    }
+#endif
+
+    babel::file::write(tmp_file, cc::string_view(""));
+    auto empty_file = babel::file::windowed_file(tmp_file);
+    for (auto const& w : empty_file.windows(1000))
+    {
+        (void)w;
+        CHECK(false);
+    }
+}
+
+TEST("file output stream")
+{
+    auto data = cc::vector<std::byte>(3000000);
+    for (size_t i = 0; i < data.size(); ++i)
+        data[i] = std::byte(i * 5 + i / 777);
+
+    auto tmp_file = "_tmp_babel_file";
+
+    auto write_in_pieces = [&](babel::file::file_output_stream& file)
+    {
+        // mixes tiny writes with writes that exceed the buffer
+        size_t pos = 0;
+        for (auto i = 0; pos < data.size(); ++i)
+        {
+            auto const n = cc::min(size_t(i % 5 == 0 ? 100000 : i % 7), data.size() - pos);
+            file(cc::span<std::byte const>(data).subspan(pos, n));
+            pos += n;
+        }
+    };
+
+    for (auto direct_io : {false, true})
+        for (auto atomic : {false, true})
+        {
+            auto cfg = babel::file::file_output_config();
+            cfg.buffer_size = 10000;
+            cfg.expected_size = 5000000;
+            cfg.direct_io = direct_io;
+            cfg.atomic = atomic;
+            cfg.sync = true;
+
+            babel::file::write(tmp_file, cc::string_view("old content"));
+            {
+                auto file = babel::file::file_output_stream(tmp_file, cfg);
+                CHECK(file.valid());
+                write_in_pieces(file);
+
+                // atomic streams do not touch the target before commit
+                if (atomic)
+                    CHECK(babel::file::read_all_text(tmp_file) == "old content");
+
+                CHECK(file.commit());
+                CHECK(!file.has_error());
+            }
+
+            auto const content = babel::file::read_all_bytes(tmp_file);
+            CHECK(content.size() == data.size());
+            CHECK(std::memcmp(content.data(), data.data(), data.size()) == 0);
+        }
+
+    // atomic streams without commit are discarded
+    {
+        auto cfg = babel::file::file_output_config();
+        cfg.atomic = true;
+        auto file = babel::file::file_output_stream(tmp_file, cfg);
+        file(cc::string_view("new content"));
+    }
+    CHECK(babel::file::size_of(tmp_file) == data.size());
+
+    auto errors = babel::error_collector();
+    auto invalid = babel::file::file_output_stream("_tmp_babel_missing_dir/file", errors);
+    CHECK(!invalid.valid());
+    CHECK(errors.error_count() == 1);
+    invalid(cc::string_view("ignored"));
+    CHECK(!invalid.commit());
+
+#if defined(CC_OS_LINUX)
+    // writes to /dev/full fail once the buffer is flushed
+    auto throwing = [&](cc::span<std::byte const> input, cc::span<std::byte const> pos, cc::string_view message, babel::severity s)
+    {
+        errors(input, pos, message, s);
+        throw 17;
+    };
+    {
+        // exceptions of the error handler do not escape the dtor
+        auto file = babel::file::file_output_stream("/dev/full", throwing);
+        CHECK(file.valid());
+        file(cc::string_view("lost"));
+    }
+    CHECK(errors.error_count() == 2);
+    {
+        auto file = babel::file::file_output_stream("/dev/full", throwing);
+        file(cc::string_view("lost"));
+        auto threw = false;
+        try
+        {
+            file.commit();
+        }
+        catch (int)
+        {
+            threw = true;
+        }
+        CHECK(threw);
+        CHECK(!file.valid()); // closed before the error was reported
+        CHECK(file.has_error());
+    }
+    CHECK(errors.error_count() == 3);
+#endif
+}
+
+TEST("file batch read")
+{
+    cc::vector<cc::string> names;
+    for (auto i = 0; i < 12; ++i)
+    {
+        names.push_back(cc::format("_tmp_babel_batch_{}.bin", i));
+        auto content = cc::vector<std::byte>::filled(size_t(i) * 1000, std::byte(i));
+        babel::file::write(names.back(), content);
+    }
+    names.push_back("_tmp_babel_batch_missing.bin");
+
+    cc::vector<cc::string_view> paths;
+    for (auto const& n : names)
+        paths.push_back(n);
+
+    for (auto threads : {0, 1, 3})
+    {
+        auto cfg = babel::file::batch_read_config();
+        cfg.thread_count = threads;
+        cfg.max_pending = threads == 1 ? 1 : 0;
+
+        auto seen = cc::vector<int>::filled(names.size(), 0);
+        auto errors = babel::error_collector();
+        auto on_read = [&](size_t i, cc::alloc_array<std::byte> data)
+        {
+            ++seen[i];
+            CHECK(data.size() == i * 1000);
+            auto all_same = true;
+            for (auto b : data)
+                all_same = all_same && b == std::byte(i);
+            CHECK(all_same);
+        };
+        babel::file::read_all_bytes_batch(paths, on_read, cfg, errors);
+
+        CHECK(errors.error_count() == 1);
+        CHECK(seen.back() == 0);
+        for (size_t i = 0; i + 1 < seen.size(); ++i)
+            CHECK(seen[i] == 1);
+    }
+
+    // with a single reader, files are passed to on_read in order (pending files are processed first-in first-out)
+    {
+        auto cfg = babel::file::batch_read_config();
+        cfg.thread_count = 1;
+        cfg.max_pending = 4;
+        cc::vector<size_t> order;
+        auto on_error = [&](cc::span<std::byte const>, cc::span<std::byte const>, cc::string_view, babel::severity) {};
+        babel::file::read_all_bytes_batch(paths, [&](size_t i, cc::alloc_array<std::byte>) { order.push_back(i); }, cfg, on_error);
+        CHECK(order.size() == names.size() - 1);
+        for (size_t i = 0; i < order.size(); ++i)
+            CHECK(order[i] == i);
+    }
+
+    // exceptions in on_read stop the batch
+    auto read_count = 0;
+    auto throwing = [&](size_t, cc::alloc_array<std::byte>)
+    {
+        ++read_count;
+        throw 17;
+    };
+    auto caught = false;
+    try
+    {
+        babel::file::read_all_bytes_batch(paths, throwing);
+    }
+    catch (int)
+    {
+        caught = true;
+    }
+    CHECK(caught);
+    CHECK(read_count == 1);
+
+    for (auto const& n : names)
+        std::remove(n.c_str());
+}
+
+TEST("file mapped output")
+{
+    auto const tmp_file = "_tmp_babel_mapped_output.bin";
+
+    auto data = cc::vector<std::byte>::uninitialized(3'000'000);
+    for (size_t i = 0; i < data.size(); ++i)
+        data[i] = std::byte(i * 7 + (i >> 11));
+
+    for (auto initial_capacity : {0, 1000, 4 << 20})
+        for (auto preallocate : {false, true})
+        {
+            auto cfg = babel::file::mapped_output_config();
+            cfg.initial_capacity = initial_capacity;
+            cfg.preallocate = preallocate;
+            cfg.sync = true;
+
+            {
+                auto file = babel::file::mapped_output_file(tmp_file, cfg);
+                CHECK(file.valid());
+                CHECK(file.capacity() == size_t(initial_capacity));
+
+                // mixed stream writes (that grow the mapping) and direct writes into the mapping
+                size_t pos = 0;
+                for (size_t n = 1; pos + n <= data.size() / 2; n = n * 3 + 1)
+                {
+                    file(cc::span<std::byte const>(data).subspan(pos, n));
+                    pos += n;
+                }
+                auto const rest = data.size() - pos;
+                auto target = file.allocate(rest);
+                CHECK(target.size() == rest);
+                std::memcpy(target.data(), data.data() + pos, rest);
+
+                CHECK(file.size() == data.size());
+                CHECK(file.capacity() >= file.size());
+                CHECK(std::memcmp(file.data().data(), data.data(), data.size()) == 0);
+                CHECK(file.commit());
+                CHECK(!file.has_error());
+            }
+
+            // truncated to the written size
+            auto const content = babel::file::read_all_bytes(tmp_file);
+            CHECK(content.size() == data.size());
+            CHECK(std::memcmp(content.data(), data.data(), data.size()) == 0);
+        }
+
+    // reserve + resize for compress_to-style writers
+    {
+        auto file = babel::file::mapped_output_file(tmp_file);
+        CHECK(file.reserve(10'000'000));
+        CHECK(file.capacity() == 10'000'000);
+        std::memset(file.data().data(), 'x', 5);
+        CHECK(file.resize(5));
+        auto moved = cc::move(file);
+        CHECK(!file.valid());
+        CHECK(moved.valid());
+    }
+    CHECK(babel::file::read_all_text(tmp_file) == "xxxxx");
+
+    // empty files
+    {
+        auto file = babel::file::mapped_output_file(tmp_file);
+        CHECK(file.commit());
+    }
+    CHECK(babel::file::size_of(tmp_file) == 0);
+    std::remove(tmp_file);
+
+    auto errors = babel::error_collector();
+    auto invalid = babel::file::mapped_output_file("_tmp_babel_missing_dir/file", errors);
+    CHECK(!invalid.valid());
+    CHECK(errors.error_count() == 1);
+    invalid(cc::string_view("ignored"));
+    CHECK(invalid.allocate(10).empty());
+    CHECK(!invalid.commit());
+
+#if defined(CC_OS_LINUX)
+    // /dev/full can be neither preallocated nor truncated
+    auto throwing = [&](cc::span<std::byte const> input, cc::span<std::byte const> pos, cc::string_view message, babel::severity s)
+    {
+        errors(input, pos, message, s);
+        throw 17;
+    };
+    {
+        // exceptions of the error handler do not escape the dtor
+        auto cfg = babel::file::mapped_output_config();
+        cfg.initial_capacity = 0;
+        auto file = babel::file::mapped_output_file("/dev/full", cfg, throwing);
+        CHECK(file.valid());
+    }
+    CHECK(errors.error_count() == 2);
+
+    auto threw = false;
+    try
+    {
+        auto file = babel::file::mapped_output_file("/dev/full", throwing);
+    }
+    catch (int)
+    {
+        threw = true;
+    }
+    CHECK(threw);
+    CHECK(errors.error_count() == 3);
+#endif
+}
+
+TEST("file read all bytes mapped")
+{
+    auto const tmp_file = "_tmp_babel_read_mapped.bin";
+
+    auto data = cc::vector<std::byte>::uninitialized(300'000);
+    for (size_t i = 0; i < data.size(); ++i)
+        data[i] = std::byte(i * 13 + (i >> 9));
+    babel::file::write(tmp_file, data);
+
+    for (size_t threshold : {0, 4096, 1 << 20})
+    {
+        auto cfg = babel::file::read_bytes_config();
+        cfg.mmap_threshold = threshold;
+
+        auto content = babel::file::read_all_bytes(tmp_file, cfg);
+        CHECK(content.is_mapped() == (threshold <= data.size()));
+        CHECK(content.size() == data.size());
+        CHECK(std::memcmp(content.data(), data.data(), data.size()) == 0);
+
+        // moving keeps the data valid
+        auto moved = cc::move(content);
+        CHECK(content.empty());
+        cc::span<std::byte const> span = moved;
+        CHECK(span.size() == data.size());
+        CHECK(span[1234] == data[1234]);
+    }
+
+    // empty files are never mapped
+    babel::file::write(tmp_file, cc::string_view(""));
+    auto cfg = babel::file::read_bytes_config();
+    cfg.mmap_threshold = 0;
+    auto empty = babel::file::read_all_bytes(tmp_file, cfg);
+    CHECK(empty.empty());
+    CHECK(!empty.is_mapped());
+    std::remove(tmp_file);
+
+    auto errors = babel::error_collector();
+    auto missing = babel::file::read_all_bytes("_tmp_babel_missing_file", cfg, errors);
+    CHECK(missing.empty());
+    CHECK(errors.error_count() == 1);
+
+#if defined(CC_OS_LINUX)
+    // directories can be opened but not mapped, which is reported instead of asserting
+    auto dir = babel::file::read_all_bytes(".", cfg, errors);
+    CHECK(dir.empty());
+    CHECK(!dir.is_mapped());
+    CHECK(errors.error_count() == 2);
+#endif
+
+    // integrity check (of read and mapped files)
+    errors.clear();
+    babel::file::write(tmp_file, data);
+    for (size_t threshold : {0, 1 << 20})
+    {
+        cfg.mmap_threshold = threshold;
+        cfg.expected_xxh64 = babel::hash::xxh64(data);
+        CHECK(babel::file::read_all_bytes(tmp_file, cfg, errors).size() == data.size());
+        CHECK(errors.error_count() == 0);
+
+        cfg.expected_xxh64 = babel::hash::xxh64(data) ^ 1;
+        CHECK(babel::file::read_all_bytes(tmp_file, cfg, errors).empty());
+        CHECK(errors.error_count() == 1);
+        errors.clear();
+    }
+    std::remove(tmp_file);
+}
@@ -0,0 +1,57 @@
+#include <nexus/fuzz_test.hh>
+#include <nexus/test.hh>
+
+#include <clean-core/utility.hh>
+#include <clean-core/vector.hh>
+
+#include <babel-serializer/file.hh>
+#include <babel-serializer/hash.hh>
+
+TEST("hash known values")
+{
+    CHECK(babel::hash::xxh64({}) == 0xEF46DB3751D8E999uLL);
+    CHECK(babel::hash::xxh32({}) == 0x02CC5D05u);
+
+    auto const abc = cc::as_byte_span(cc::string_view("abc"));
+    CHECK(babel::hash::xxh64(abc) == 0x44BC2CF5AD770999uLL);
+    CHECK(babel::hash::xxh32(abc) == 0x32D153FFu);
+    CHECK(babel::hash::xxh64(abc, 1) != babel::hash::xxh64(abc));
+}
+
+FUZZ_TEST("hash stream fuzzer")(tg::rng& rng)
+{
+    auto data = cc::vector<std::byte>(uniform(rng, 0, 10000));
+    for (auto& b : data)
+        b = std::byte(uniform(rng, 0, 255));
+
+    auto const seed = uint32_t(uniform(rng, 0, 1000));
+    auto h64 = babel::hash::xxh64_stream(seed);
+    auto h32 = babel::hash::xxh32_stream(seed);
+    for (size_t pos = 0; pos < data.size();)
+    {
+        auto const n = cc::min(size_t(uniform(rng, 0, 100)), data.size() - pos);
+        auto const chunk = cc::span<std::byte const>(data).subspan(pos, n);
+        h64(chunk);
+        h32(chunk);
+        pos += n;
+    }
+
+    CHECK(h64.digest() == babel::hash::xxh64(data, seed));
+    CHECK(h32.digest() == babel::hash::xxh32(data, seed));
+
+    h64.reset(seed);
+    h64(data);
+    CHECK(h64.digest() == babel::hash::xxh64(data, seed));
+}
+
+TEST("hash file")
+{
+    auto data = cc::vector<std::byte>(100000);
+    for (size_t i = 0; i < data.size(); ++i)
+        data[i] = std::byte(i * 31 + i / 1000);
+
+    auto tmp_file = "_tmp_babel_hash";
+    babel::file::write(tmp_file, data);
+    CHECK(babel::hash::xxh64_file(tmp_file) == babel::hash::xxh64(data));
+    CHECK(babel::hash::xxh64_file(tmp_file, 5) == babel::hash::xxh64(data, 5));
+}
@@ -1,5 +1,7 @@
 #include <nexus/test.hh>
 
+#include <clean-core/string.hh>
+
 #include <babel-serializer/source_map.hh>
 
 TEST("source_map")
@@ -31,3 +33,46 @@ TEST("source_map")
         CHECK(map.lines().size() == 0);
     }
 }
+
+TEST("source_map lookup")
+{
+    // long enough for the vectorized scan, with lines crossing block boundaries
+    cc::string s;
+    cc::vector<int> line_starts;
+    for (auto l = 0; l < 500; ++l)
+    {
+        line_starts.push_back(int(s.size()));
+        for (auto i = 0; i < (l * 7) % 37; ++i)
+            s += char('a' + i % 26);
+        s += l % 3 == 0 ? "\r\n" : "\n";
+    }
+    s += "tail\tend";
+
+    auto map = babel::source_map(cc::string_view(s));
+    CHECK(!map.is_binary());
+    CHECK(map.lines().size() == 501);
+    CHECK(map.lines()[3] == "abcdefghijklmnopqrstu");
+    CHECK(map.lines()[6] == "abcde"); // '\r' is trimmed
+    CHECK(map.lines().back() == "tail\tend");
+
+    auto all_correct = true;
+    for (auto l = 0; l < 500; ++l)
+    {
+        auto const start = line_starts[l];
+        auto const end = l + 1 < 500 ? line_starts[l + 1] : int(s.size()) - 8;
+        for (auto i = start; i < end; ++i)
+            all_correct = all_correct && map.line_of(&s[i]) == l && map.column_of(&s[i]) == i - start;
+    }
+    CHECK(all_correct);
+    CHECK(map.line_of(&s.back()) == 500);
+    CHECK(map.column_of(&s.back()) == 7);
+
+    // control chars (other than tab, cr, lf) make the source binary
+    for (auto pos : {3, 17, 40})
+    {
+        cc::string b = cc::string(cc::string_view(s).subview(0, 64));
+        b[pos] = '\x01';
+        CHECK(babel::source_map(cc::string_view(b)).is_binary());
+        CHECK(babel::source_map(cc::string_view(b)).lines().empty());
+    }
+}